@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lpool.h"
+
+struct larena_chunk {
+    larena_chunk* next;
+    size_t size;
+};
+
+// round up to the next power of two, at least LPOOL_MIN_SIZE
+static size_t lpool_round_pow2(size_t size) {
+    size_t n = LPOOL_MIN_SIZE;
+    while (n < size) { n <<= 1; }
+    return n;
+}
+
+void larena_init(larena* a) {
+    a->chunks = NULL;
+    a->bump = NULL;
+    a->end = NULL;
+}
+
+void* larena_realloc(larena* a, void* p, size_t old_size, size_t new_size) {
+    if (p == NULL || old_size == 0) { return larena_alloc(a, new_size); }
+    if (new_size == 0) { return NULL; }
+
+    // still fits in the block handed out for old_size
+    if (new_size <= lpool_round_pow2(old_size)) { return p; }
+
+    void* q = larena_alloc(a, new_size);
+    memcpy(q, p, old_size);
+    return q;
+}
+
+void larena_free(larena* a) {
+    while (a->chunks) {
+        larena_chunk* next = a->chunks->next;
+        free(a->chunks);
+        a->chunks = next;
+    }
+    larena_init(a);
+}
+
+#ifdef LPOOL_DISABLE
+
+void* larena_alloc(larena* a, size_t size) {
+    if (size == 0) { return NULL; }
+
+    // one chunk per block so every block is visible to the sanitizers
+    size_t block = lpool_round_pow2(size);
+    larena_chunk* c = malloc(sizeof(larena_chunk) + block);
+    c->next = a->chunks;
+    c->size = block;
+    a->chunks = c;
+    return c + 1;
+}
+
+void larena_reset(larena* a) {
+    larena_free(a);
+}
+
+void* lpool_alloc(size_t size) {
+    return size ? malloc(size) : NULL;
+}
+
+void* lpool_realloc(void* p, size_t old_size, size_t new_size) {
+    if (new_size == 0) { free(p); return NULL; }
+    return realloc(p, new_size);
+}
+
+void lpool_free(void* p, size_t size) {
+    free(p);
+}
+
+#else
+
+// size classes are 8, 16, 32, 64, 128 and 256 bytes
+#define LPOOL_CLASSES 6
+
+typedef struct lpool_block {
+    struct lpool_block* next;
+} lpool_block;
+
+typedef struct {
+    lpool_block* free;  // blocks returned by lpool_free
+    char* bump;         // next unused byte in the current slab
+    char* end;          // end of the current slab
+} lpool_class;
+
+static lpool_class classes[LPOOL_CLASSES];
+
+// maps (size-1)/8 to the smallest class that fits the size
+static const unsigned char class_of[LPOOL_MAX_SIZE / LPOOL_MIN_SIZE] = {
+    0, 1, 2, 2, 3, 3, 3, 3,
+    4, 4, 4, 4, 4, 4, 4, 4,
+    5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5,
+};
+
+static size_t lpool_class_size(int c) {
+    return (size_t)LPOOL_MIN_SIZE << c;
+}
+
+static int lpool_class_index(size_t size) {
+    return class_of[(size - 1) / LPOOL_MIN_SIZE];
+}
+
+static void* lpool_refill(lpool_class* pc, size_t block) {
+    // slabs are never returned to libc, freed blocks go back on the list
+    char* slab = malloc(LPOOL_SLAB_SIZE);
+    if (slab == NULL) { return NULL; }
+    pc->bump = slab + block;
+    pc->end = slab + LPOOL_SLAB_SIZE;
+    return slab;
+}
+
+void* lpool_alloc(size_t size) {
+    if (size == 0) { return NULL; }
+    if (size > LPOOL_MAX_SIZE) { return malloc(size); }
+
+    int c = lpool_class_index(size);
+    lpool_class* pc = &classes[c];
+
+    // reuse a freed block first
+    if (pc->free) {
+        lpool_block* b = pc->free;
+        pc->free = b->next;
+        return b;
+    }
+
+    // otherwise bump the slab pointer
+    size_t block = lpool_class_size(c);
+    if (pc->bump != NULL && pc->bump + block <= pc->end) {
+        void* p = pc->bump;
+        pc->bump += block;
+        return p;
+    }
+
+    return lpool_refill(pc, block);
+}
+
+void lpool_free(void* p, size_t size) {
+    if (p == NULL || size == 0) { return; }
+    if (size > LPOOL_MAX_SIZE) { free(p); return; }
+
+    lpool_class* pc = &classes[lpool_class_index(size)];
+    lpool_block* b = p;
+    b->next = pc->free;
+    pc->free = b;
+}
+
+void* lpool_realloc(void* p, size_t old_size, size_t new_size) {
+    if (p == NULL || old_size == 0) { return lpool_alloc(new_size); }
+    if (new_size == 0) { lpool_free(p, old_size); return NULL; }
+
+    // both sizes outside the pool, let libc resize in place
+    if (old_size > LPOOL_MAX_SIZE && new_size > LPOOL_MAX_SIZE) {
+        return realloc(p, new_size);
+    }
+
+    // same class, the block already fits
+    if (old_size <= LPOOL_MAX_SIZE && new_size <= LPOOL_MAX_SIZE
+        && lpool_class_index(old_size) == lpool_class_index(new_size)) {
+        return p;
+    }
+
+    void* q = lpool_alloc(new_size);
+    if (q == NULL) { return NULL; }
+    memcpy(q, p, old_size < new_size ? old_size : new_size);
+    lpool_free(p, old_size);
+    return q;
+}
+
+static void* larena_grow(larena* a, size_t block) {
+    size_t size = block > LARENA_CHUNK_SIZE ? block : LARENA_CHUNK_SIZE;
+    larena_chunk* c = malloc(sizeof(larena_chunk) + size);
+    if (c == NULL) { return NULL; }
+
+    c->next = a->chunks;
+    c->size = size;
+    a->chunks = c;
+
+    a->bump = (char*)(c + 1) + block;
+    a->end = (char*)(c + 1) + size;
+    return c + 1;
+}
+
+void* larena_alloc(larena* a, size_t size) {
+    if (size == 0) { return NULL; }
+
+    size_t block = lpool_round_pow2(size);
+    if (a->bump != NULL && a->bump + block <= a->end) {
+        void* p = a->bump;
+        a->bump += block;
+        return p;
+    }
+
+    return larena_grow(a, block);
+}
+
+void larena_reset(larena* a) {
+    if (a->chunks == NULL) { return; }
+
+    // keep the oldest chunk for the next round, drop the overflow chunks
+    while (a->chunks->next) {
+        larena_chunk* next = a->chunks->next;
+        free(a->chunks);
+        a->chunks = next;
+    }
+
+    a->bump = (char*)(a->chunks + 1);
+    a->end = a->bump + a->chunks->size;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef LPOOL_H
+#define LPOOL_H
+
+#include <stddef.h>
+
+/*
+ * Size class pool allocator used for lval structs and small cell arrays.
+ *
+ * Requests are rounded up to a power of two size class between
+ * LPOOL_MIN_SIZE and LPOOL_MAX_SIZE bytes. Each class keeps its own free
+ * list and carves new blocks out of a slab with a pointer bump, so the
+ * common allocation is a list pop or a pointer increment. Larger requests
+ * go straight to malloc.
+ *
+ * The caller passes the size of the block back when freeing or resizing,
+ * which lets the pool avoid storing a header in every block.
+ *
+ * Build with -DLPOOL_DISABLE to route every call to malloc/realloc/free,
+ * which is useful when hunting leaks with valgrind or ASan.
+ */
+
+#define LPOOL_MIN_SIZE   8
+#define LPOOL_MAX_SIZE   256
+#define LPOOL_SLAB_SIZE  (64 * 1024)
+
+void* lpool_alloc(size_t size);
+void* lpool_realloc(void* p, size_t old_size, size_t new_size);
+void lpool_free(void* p, size_t size);
+
+/*
+ * Region allocator for short lived values.
+ *
+ * Blocks are bumped out of a chunk and are never freed individually,
+ * larena_reset releases everything allocated since the last reset in one
+ * go. Block sizes are rounded up to a power of two so a block can be
+ * grown in place until it crosses into the next size.
+ *
+ * With -DLPOOL_DISABLE each block is a separate malloc that is released
+ * on reset, so ASan still sees every overflow and use after reset.
+ */
+
+#define LARENA_CHUNK_SIZE (64 * 1024)
+
+typedef struct larena_chunk larena_chunk;
+
+typedef struct {
+    larena_chunk* chunks;   // most recent chunk first
+    char* bump;             // next unused byte in chunks
+    char* end;              // end of chunks
+} larena;
+
+void larena_init(larena* a);
+void* larena_alloc(larena* a, size_t size);
+void* larena_realloc(larena* a, void* p, size_t old_size, size_t new_size);
+void larena_reset(larena* a);
+void larena_free(larena* a);
+
+#endif
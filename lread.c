@@ -0,0 +1,190 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "lread.h"
+
+// what mpc reports as expected at each kind of position
+#define LREAD_DIGITS "'0123456789'"
+#define LREAD_SYMBOLS "'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_+-*/\\=<>!&'"
+#define LREAD_EXPECT_NUMBER "one or more of one of " LREAD_DIGITS ", "
+#define LREAD_EXPECT_SYMBOL "one or more of one of " LREAD_SYMBOLS ", "
+#define LREAD_EXPECT_TOP    "'(', ''', newline or end of input"
+#define LREAD_EXPECT_LIST   "'(', ''' or ')'"
+#define LREAD_EXPECT_QUOTE  "'(' or '''"
+
+// kind of the last number or symbol read
+enum { LREAD_NONE, LREAD_NUMBER, LREAD_SYMBOL, LREAD_MINUS };
+
+typedef struct {
+    const char* filename;
+    const char* input;
+    const char* p;
+    const char* token_end;  // end of the last number or symbol
+    int token;
+    char* error;
+} lreader;
+
+static int lread_is_space(char c) {
+    return c == ' ' || c == '\f' || c == '\n' || c == '\r' || c == '\t' || c == '\v';
+}
+
+static int lread_is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static int lread_is_symbol(char c) {
+    if (c >= 'a' && c <= 'z') { return 1; }
+    if (c >= 'A' && c <= 'Z') { return 1; }
+    if (lread_is_digit(c)) { return 1; }
+    return c != '\0' && strchr("_+-*/\\=<>!&", c) != NULL;
+}
+
+static void lread_skip_space(lreader* r) {
+    while (lread_is_space(*r->p)) { r->p++; }
+}
+
+// record an error at the current position, formatted like mpc does
+static lval* lread_error(lreader* r, const char* expected) {
+    long row = 0, col = 0;
+    for (const char* s = r->input; s < r->p; s++) {
+        if (*s == '\n') { row++; col = 0; } else { col++; }
+    }
+
+    char at[4] = { '\'', *r->p, '\'', '\0' };
+    const char* found = at;
+    switch (*r->p)
+    {
+    case '\a': found = "bell"; break;
+    case '\b': found = "backspace"; break;
+    case '\f': found = "formfeed"; break;
+    case '\r': found = "carriage return"; break;
+    case '\v': found = "vertical tab"; break;
+    case '\0': found = "end of input"; break;
+    case '\n': found = "newline"; break;
+    case '\t': found = "tab"; break;
+    case ' ' : found = "space"; break;
+    }
+
+    // right after a number or symbol mpc also expected it to go on, 
+    // after a lone - the number it started is expected first
+    const char* more = "";
+    const char* number = LREAD_EXPECT_NUMBER;
+    if (r->p == r->token_end) {
+        switch (r->token)
+        {
+        case LREAD_NUMBER:
+            more = "one of " LREAD_DIGITS ", ";
+            break;
+        case LREAD_SYMBOL:
+            more = "one of " LREAD_SYMBOLS ", ";
+            break;
+        case LREAD_MINUS:
+            more = LREAD_EXPECT_NUMBER "one of " LREAD_SYMBOLS ", ";
+            number = "";
+            break;
+        }
+    }
+
+    size_t size = strlen(r->filename) + strlen(more) + strlen(number) 
+        + strlen(LREAD_EXPECT_SYMBOL) + strlen(expected) + strlen(found) + 64;
+    r->error = malloc(size);
+    snprintf(r->error, size, "%s:%li:%li: error: expected %s'-', %s%s%s at %s\n",
+        r->filename, row + 1, col + 1, more, number, LREAD_EXPECT_SYMBOL, 
+        expected, found);
+    return NULL;
+}
+
+static lval* lread_number(lreader* r) {
+    errno = 0;
+    char* end;
+    long x = strtol(r->p, &end, 10);
+    r->p = end;
+    r->token_end = end;
+    r->token = LREAD_NUMBER;
+    return errno != ERANGE ? lval_num(x) : lval_err("invalid number");
+}
+
+static lval* lread_symbol(lreader* r) {
+    const char* start = r->p;
+    while (lread_is_symbol(*r->p)) { r->p++; }
+    r->token_end = r->p;
+    r->token = (r->p - start == 1 && *start == '-') ? LREAD_MINUS : LREAD_SYMBOL;
+
+    // lval_sym wants a terminated name
+    char buffer[64];
+    size_t len = r->p - start;
+    char* name = len < sizeof(buffer) ? buffer : malloc(len + 1);
+    memcpy(name, start, len);
+    name[len] = '\0';
+
+    lval* x = lval_sym(name);
+    if (name != buffer) { free(name); }
+    return x;
+}
+
+// an S-expression still being filled, or a Q-expression waiting for the 
+// expression it quotes
+typedef struct {
+    lval* x;
+    char open;
+} lread_frame;
+
+lval* lread_string(const char* filename, const char* input, char** error) {
+    lreader r = { filename, input, input, NULL, LREAD_NONE, NULL };
+    lread_skip_space(&r);
+
+    // open lists are kept on an explicit stack, so deeply nested input can 
+    // not overflow the C stack
+    lread_frame* stack = NULL;
+    int count = 0;
+    int slots = 0;
+
+    lval* root = lval_sexpr();
+    while (count > 0 || *r.p != '\0') {
+        lval* y;
+        char c = r.p[0];
+
+        if (count > 0 && stack[count - 1].open == '(' && c == ')') {
+            r.p++;
+            lread_skip_space(&r);
+            y = stack[--count].x;
+        } else if (lread_is_digit(c) || (c == '-' && lread_is_digit(r.p[1]))) {
+            // numbers are tried first, as in the grammar
+            y = lread_number(&r);
+            lread_skip_space(&r);
+        } else if (lread_is_symbol(c)) {
+            y = lread_symbol(&r);
+            lread_skip_space(&r);
+        } else if (c == '(' || c == '\'') {
+            r.p++;
+            lread_skip_space(&r);
+            if (count == slots) {
+                slots = slots ? slots * 2 : 64;
+                stack = realloc(stack, sizeof(lread_frame) * slots);
+            }
+            stack[count++] = (lread_frame){ c == '(' ? lval_sexpr() : lval_qexpr(), c };
+            continue;
+        } else {
+            const char* expected = LREAD_EXPECT_TOP;
+            if (count > 0) {
+                expected = stack[count - 1].open == '(' ? LREAD_EXPECT_LIST : LREAD_EXPECT_QUOTE;
+            }
+            lread_error(&r, expected);
+            free(stack);
+            *error = r.error;
+            return NULL;
+        }
+
+        // a quote is done as soon as it holds its expression
+        while (count > 0 && stack[count - 1].open == '\'') {
+            y = lval_add(stack[--count].x, y);
+        }
+        lval_add(count > 0 ? stack[count - 1].x : root, y);
+    }
+
+    free(stack);
+    return root;
+}
@@ -0,0 +1,30 @@
+#ifndef LREAD_H
+#define LREAD_H
+
+#include "main.h"
+
+/*
+ * Hand written reader for the lispy grammar.
+ *
+ * Builds lvals straight from the input in a single pass, without the mpc
+ * combinators or an intermediate AST. It accepts exactly what the
+ * mpca_lang grammar in main accepts, including its quirks: a number is
+ * tried before a symbol so "12abc" reads as 12 followed by abc, and
+ * whitespace is any of " \f\n\r\t\v".
+ *
+ * The result has the same shape as lval_read of the mpc AST, a root
+ * S-expression holding every top level expression.
+ */
+
+/**
+ * @brief reads every expression in input
+ *
+ * @param filename name used in error messages
+ * @param input NUL terminated source
+ * @param error set to a malloc'd message in the style of mpc_err_string
+ * when input is rejected
+ * @return root S-expression, or NULL on error
+ */
+lval* lread_string(const char* filename, const char* input, char** error);
+
+#endif
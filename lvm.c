@@ -0,0 +1,296 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "lvm.h"
+
+// value stack shared by every running chunk
+static lval** lvm_stack = NULL;
+static int lvm_sp = 0;
+static int lvm_stack_slots = 0;
+
+// innermost running chunk, its constants are gc roots
+static lchunk* lvm_chunks = NULL;
+
+void lchunk_init(lchunk* c) {
+    c->code = NULL;
+    c->code_count = 0;
+    c->code_slots = 0;
+    c->consts = NULL;
+    c->consts_count = 0;
+    c->consts_slots = 0;
+    c->next = NULL;
+}
+
+void lchunk_free(lchunk* c) {
+    free(c->code);
+    free(c->consts);
+}
+
+static void lchunk_emit(lchunk* c, unsigned char op, int arg) {
+    int size = 1 + sizeof(int);
+    if (c->code_count + size > c->code_slots) {
+        c->code_slots = c->code_slots ? c->code_slots * 2 : 64;
+        c->code = realloc(c->code, c->code_slots);
+    }
+    c->code[c->code_count] = op;
+    memcpy(&c->code[c->code_count + 1], &arg, sizeof(int));
+    c->code_count += size;
+}
+
+static int lchunk_const(lchunk* c, lval* v) {
+    if (c->consts_count == c->consts_slots) {
+        c->consts_slots = c->consts_slots ? c->consts_slots * 2 : 16;
+        c->consts = realloc(c->consts, sizeof(lval*) * c->consts_slots);
+    }
+    c->consts[c->consts_count] = v;
+    return c->consts_count++;
+}
+
+// opcode for a call with two operands, specialised if the head is
+// currently bound to one of the arithmetic builtins
+static unsigned char lvm_arith_op(lenv* e, lval* head) {
+    if (lval_typeof(head) != LVAL_SYM) { return OP_CALL; }
+
+    int slot = lenv_slot(e, head);
+    if (slot < 0 || !LVAL_IS_FUN(e->vals[slot])) { return OP_CALL; }
+
+    lbuiltin f = lval_to_fun(e->vals[slot]);
+    if (f == builtin_add) { return OP_ADD; }
+    if (f == builtin_sub) { return OP_SUB; }
+    if (f == builtin_mul) { return OP_MUL; }
+    if (f == builtin_div) { return OP_DIV; }
+    return OP_CALL;
+}
+
+static void lvm_compile_atom(lchunk* c, lenv* e, lval* v) {
+    if (lval_typeof(v) != LVAL_SYM) {
+        lchunk_emit(c, OP_CONST, lchunk_const(c, v));
+        return;
+    }
+
+    // bound symbols keep their slot, others are looked up when run
+    int slot = lenv_slot(e, v);
+    if (slot >= 0) {
+        lchunk_emit(c, OP_GLOBAL, slot);
+    } else {
+        lchunk_emit(c, OP_SYM, lchunk_const(c, v));
+    }
+}
+
+// S-expression being compiled and the index of its next element
+typedef struct {
+    lval* v;
+    int i;
+} lvm_frame;
+
+static void lvm_compile_expr(lchunk* c, lenv* e, lval* v) {
+    // S-expressions whose elements are still being compiled are kept on an
+    // explicit stack, so deeply nested input can not overflow the C stack
+    lvm_frame* stack = NULL;
+    int count = 0;
+    int slots = 0;
+
+    while (v) {
+        if (lval_typeof(v) == LVAL_SEXPR) {
+            if (count == slots) {
+                slots = slots ? slots * 2 : 64;
+                stack = realloc(stack, sizeof(lvm_frame) * slots);
+            }
+            stack[count++] = (lvm_frame){ v, 0 };
+        } else {
+            lvm_compile_atom(c, e, v);
+        }
+
+        // the call of a list follows all of its elements
+        v = NULL;
+        while (count > 0) {
+            lvm_frame* f = &stack[count - 1];
+            if (f->i < f->v->count) {
+                v = f->v->cell[f->i++];
+                break;
+            }
+            lchunk_emit(c, f->v->count == 3 ? lvm_arith_op(e, f->v->cell[0]) : OP_CALL, 
+                f->v->count);
+            count--;
+        }
+    }
+
+    free(stack);
+}
+
+void lvm_compile(lchunk* c, lenv* e, lval* v) {
+    lvm_compile_expr(c, e, v);
+    lchunk_emit(c, OP_RETURN, 0);
+}
+
+static void lvm_push(lval* v) {
+    if (lvm_sp == lvm_stack_slots) {
+        lvm_stack_slots = lvm_stack_slots ? lvm_stack_slots * 2 : 256;
+        lvm_stack = realloc(lvm_stack, sizeof(lval*) * lvm_stack_slots);
+    }
+    lvm_stack[lvm_sp++] = v;
+}
+
+// value of a list whose n evaluated elements are on top of the stack
+static lval* lvm_call(lenv* e, int n) {
+    lval** args = &lvm_stack[lvm_sp - n];
+
+    // empty expression
+    if (n == 0) { return lval_sexpr(); }
+
+    // single expression
+    if (n == 1) { return args[0]; }
+
+    // ensure 1st element is function after evaluation
+    if (lval_typeof(args[0]) != LVAL_FUN) {
+        return lval_err("First element must be a function.");
+    }
+
+    lbuiltin f = lval_to_fun(args[0]);
+    lval* a = lval_sexpr();
+    for (int i = 1; i < n; i++) { lval_add(a, args[i]); }
+
+    // call builtin with operator, the arguments are a root until it returns
+    lval_gc_push_root(a);
+    lval_gc_poll(e);
+    lval* result = f(e, a);
+    lval_gc_pop_root();
+    return result;
+}
+
+// decode the next opcode and its operand
+#define LVM_FETCH() \
+    (op = *ip, memcpy(&arg, ip + 1, sizeof(int)), ip += 1 + sizeof(int))
+
+#if LVM_COMPUTED_GOTO
+#define LVM_NEXT() do { LVM_FETCH(); goto *labels[op]; } while (0)
+#define LVM_CASE(name) L_##name
+#else
+#define LVM_NEXT() goto next
+#define LVM_CASE(name) case name
+#endif
+
+// both operands of a specialised arithmetic opcode are fixnums and the
+// head of the list is still the builtin the opcode was compiled for
+#define LVM_ARITH_OK(func) \
+    (LVAL_IS_FUN(lvm_stack[lvm_sp - 3]) \
+        && lval_to_fun(lvm_stack[lvm_sp - 3]) == (func) \
+        && LVAL_IS_FIXNUM(lvm_stack[lvm_sp - 2]) \
+        && LVAL_IS_FIXNUM(lvm_stack[lvm_sp - 1]))
+
+lval* lvm_run(lenv* e, lchunk* c) {
+    int base = lvm_sp;
+    unsigned char* ip = c->code;
+    unsigned char op;
+    int arg;
+    long n, m;
+    lval* x;
+
+#if LVM_COMPUTED_GOTO
+    static void* labels[] = {
+        &&L_OP_CONST, &&L_OP_GLOBAL, &&L_OP_SYM, &&L_OP_CALL, &&L_OP_RETURN,
+        &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_DIV
+    };
+#endif
+
+    c->next = lvm_chunks;
+    lvm_chunks = c;
+
+#if LVM_COMPUTED_GOTO
+    LVM_NEXT();
+#else
+next:
+    LVM_FETCH();
+    switch (op) {
+#endif
+
+    LVM_CASE(OP_CONST):
+        x = c->consts[arg];
+        goto push;
+
+    LVM_CASE(OP_GLOBAL):
+        x = e->vals[arg];
+        goto push;
+
+    LVM_CASE(OP_SYM):
+        x = lenv_get(e, c->consts[arg]);
+        goto push;
+
+    LVM_CASE(OP_CALL):
+    call:
+        x = lvm_call(e, arg);
+        lvm_sp -= arg;
+        goto push;
+
+    LVM_CASE(OP_ADD):
+        if (!LVM_ARITH_OK(builtin_add)) { goto call; }
+        n = lval_to_num(lvm_stack[lvm_sp - 2]);
+        m = lval_to_num(lvm_stack[lvm_sp - 1]);
+        x = lval_num(n + m);
+        lvm_sp -= 3;
+        goto push;
+
+    LVM_CASE(OP_SUB):
+        if (!LVM_ARITH_OK(builtin_sub)) { goto call; }
+        n = lval_to_num(lvm_stack[lvm_sp - 2]);
+        m = lval_to_num(lvm_stack[lvm_sp - 1]);
+        x = lval_num(n - m);
+        lvm_sp -= 3;
+        goto push;
+
+    LVM_CASE(OP_MUL):
+        if (!LVM_ARITH_OK(builtin_mul)) { goto call; }
+        n = lval_to_num(lvm_stack[lvm_sp - 2]);
+        m = lval_to_num(lvm_stack[lvm_sp - 1]);
+        x = lval_num(n * m);
+        lvm_sp -= 3;
+        goto push;
+
+    LVM_CASE(OP_DIV):
+        // division by zero takes the builtin path for its error
+        if (!LVM_ARITH_OK(builtin_div)) { goto call; }
+        n = lval_to_num(lvm_stack[lvm_sp - 2]);
+        m = lval_to_num(lvm_stack[lvm_sp - 1]);
+        if (m == 0) { goto call; }
+        x = lval_num(n / m);
+        lvm_sp -= 3;
+        goto push;
+
+    LVM_CASE(OP_RETURN):
+        x = lvm_stack[--lvm_sp];
+        goto done;
+
+#if !LVM_COMPUTED_GOTO
+    }
+#endif
+
+push:
+    // the first error aborts the whole expression
+    if (lval_typeof(x) == LVAL_ERR) { goto done; }
+    lvm_push(x);
+    LVM_NEXT();
+
+done:
+    lvm_sp = base;
+    lvm_chunks = c->next;
+    return x;
+}
+
+lval* lvm_eval(lenv* e, lval* v) {
+    lchunk c;
+    lchunk_init(&c);
+    lvm_compile(&c, e, v);
+
+    lval* x = lvm_run(e, &c);
+    lchunk_free(&c);
+    return x;
+}
+
+void lvm_mark_roots(void (*mark)(lval*)) {
+    for (int i = 0; i < lvm_sp; i++) { mark(lvm_stack[i]); }
+
+    for (lchunk* c = lvm_chunks; c; c = c->next) {
+        for (int i = 0; i < c->consts_count; i++) { mark(c->consts[i]); }
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef LVM_H
+#define LVM_H
+
+#include "main.h"
+
+/*
+ * Bytecode compiler and stack machine for the evaluator.
+ *
+ * An expression is compiled to a flat list of instructions before it is
+ * run. Symbols that are already bound compile to the index of their lenv
+ * slot, so running the code reads the value without a lookup. Everything
+ * else that is not a list is pushed from the constant table.
+ *
+ * An S-expression compiles to its elements followed by OP_CALL with the
+ * element count. The call has the same rules as the tree walker it
+ * replaces: () is itself, a single element is its own value, and longer
+ * lists call the builtin in the first position with the rest.
+ * The first error stops the machine and becomes the result.
+ *
+ * Calls of + - * / with two operands compile to their own opcodes, which
+ * do the arithmetic inline while the head is still that builtin and both
+ * operands are fixnums, and otherwise fall back to OP_CALL.
+ *
+ * The language has no lambdas or conditionals yet, so there are no local
+ * slots or jumps.
+ *
+ * The dispatch loop uses computed goto when built with GCC or clang,
+ * define LVM_SWITCH_DISPATCH to use a portable switch instead.
+ */
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(LVM_SWITCH_DISPATCH)
+#define LVM_COMPUTED_GOTO 1
+#else
+#define LVM_COMPUTED_GOTO 0
+#endif
+
+enum {
+    OP_CONST,   // push constant n
+    OP_GLOBAL,  // push the value in lenv slot n
+    OP_SYM,     // look up the symbol in constant n and push its value
+    OP_CALL,    // replace the top n values with the value of the list
+    OP_RETURN,  // return the top value
+    OP_ADD,     // OP_CALL with n = 3 and a fixnum fast path for +
+    OP_SUB,
+    OP_MUL,
+    OP_DIV
+};
+
+typedef struct lchunk lchunk;
+
+struct lchunk {
+    unsigned char* code;    // opcodes, each followed by an int operand
+    int code_count;
+    int code_slots;
+
+    lval** consts;
+    int consts_count;
+    int consts_slots;
+
+    lchunk* next;           // chunk that was running when this one started
+};
+
+void lchunk_init(lchunk* c);
+void lchunk_free(lchunk* c);
+
+void lvm_compile(lchunk* c, lenv* e, lval* v);
+lval* lvm_run(lenv* e, lchunk* c);
+
+/**
+ * @brief compiles v and runs it, the entry point used by lval_eval
+ *
+ * @param e environment
+ * @param v expression
+ * @return value of v or the first error
+ */
+lval* lvm_eval(lenv* e, lval* v);
+
+/**
+ * @brief calls mark on every value the vm holds, the value stack and
+ * the constants of each running chunk
+ */
+void lvm_mark_roots(void (*mark)(lval*));
+
+#endif
@@ -2,6 +2,14 @@
 #include <stdlib.h>
 
 #include "main.h"
+#include "lpool.h"
+#include "lvm.h"
+#include "lread.h"
+
+// built by make, see lispy_image.h in the Makefile
+#ifdef LISPY_IMAGE
+#include "lispy_image.h"
+#endif
 
 // Declare a bufffer for user input of size 2048
 static char buffer[2048];
@@ -29,237 +37,519 @@ void add_history(char* unused) {}
 lenv* lenv_new(void) {
     lenv* e = malloc(sizeof(lenv));
     e->count = 0; 
+    e->capacity = 0;
     e->syms = NULL;
     e->vals = NULL;
+    e->slots = 0;
+    e->index = NULL;
     return e;
 }
 
 void free_lenv(lenv* e) {
     for (int i = 0; i < e->count; i++) {
-        free(e->syms[i]);
         free_lval(e->vals[i]);
     }
 
     free(e->syms); 
     free(e->vals);
+    free(e->index);
+
+    // nothing is reachable without the environment, reclaim the heap
+    e->count = 0;
+    lval_gc_collect(e);
     free(e);
 }
 
+// interned symbol strings are unique, so the address is the key
+static int lenv_hash(lenv* e, char* sym) {
+    uintptr_t h = (uintptr_t)sym;
+    h ^= h >> 17;
+    h *= 0x9E3779B1u;
+    return (int)((h ^ (h >> 15)) & (e->slots - 1));
+}
+
+// find the index slot of sym, or the empty slot it would go in
+static int lenv_find(lenv* e, char* sym) {
+    int i = lenv_hash(e, sym);
+    while (e->index[i] && e->syms[e->index[i] - 1]->sym != sym) {
+        i = (i + 1) & (e->slots - 1);
+    }
+    return i;
+}
+
+static void lenv_grow(lenv* e) {
+    // bindings keep their position, only the index is rebuilt
+    e->capacity = e->capacity ? e->capacity * 2 : 32;
+    e->syms = realloc(e->syms, sizeof(lval*) * e->capacity);
+    e->vals = realloc(e->vals, sizeof(lval*) * e->capacity);
+
+    free(e->index);
+    e->slots = e->capacity * 2;
+    e->index = calloc(e->slots, sizeof(int));
+    for (int i = 0; i < e->count; i++) {
+        e->index[lenv_find(e, e->syms[i]->sym)] = i + 1;
+    }
+}
+
+int lenv_slot(lenv* e, lval* k) {
+    if (e->count == 0) { return -1; }
+    return e->index[lenv_find(e, k->sym)] - 1;
+}
+
 lval* lenv_get(lenv* e, lval* k) {
-    // Iterate over all items in enironment
-    for(int i = 0; i < e->count; i++) {
-        // check if store symbol string matches k symbol
-        // if it does return a copyof the value
-        if(strcmp(e->syms[i], k->sym) == 0){
-            return lval_copy(e->vals[i]);
-        }
+    // look the symbol up in the index
+    // if it is bound return a shared reference to the value
+    if (e->count) {
+        int i = e->index[lenv_find(e, k->sym)];
+        if (i) { return e->vals[i - 1]; }
     }
     // If no symbol found return error
     return lval_err("unbound symbol '%s'", k->sym);
 }
 
 void lenv_put(lenv* e, lval* k, lval* v) {
-    // iterate over all items in env to check if variable already exists
-    for (int i = 0; i < e->count; i++){
-
-        // if variable found delete item at that position
-        // and replace parameter lval
-        if(strcmp(e->syms[i], k->sym) == 0){
-            free_lval(e->vals[i]); 
-            e->vals[i] = lval_copy(v);
+    // if variable already exists replace its value
+    if (e->count) {
+        int i = e->index[lenv_find(e, k->sym)];
+        if (i) {
+            e->vals[i - 1] = lval_promote(v);
             return;
         }
     }
 
-    // if no existing entry found allocate space
+    // if no existing entry found make space, the index stays half empty
+    if (e->count == e->capacity) { lenv_grow(e); }
     e->count++; 
-    e->syms = realloc(e->syms, sizeof(char*) * e->count);
-    e->vals = realloc(e->vals, sizeof(lval*) * e->count);
 
-    // copy content of lval and symbol string into new location
-    e->syms[e->count-1] = malloc(strlen(k->sym) + 1); 
-    strcpy(e->syms[e->count-1], k->sym);
-    e->vals[e->count-1] = lval_copy(v); 
+    // holding the symbol keeps it interned, so its string stays the key
+    e->syms[e->count-1] = k;
+    e->vals[e->count-1] = lval_promote(v); 
+    e->index[lenv_find(e, k->sym)] = e->count;
 }
 
-// Create a new number type lval
-lval* lval_num(long x) { 
-    lval* v = malloc(sizeof(lval));
+// builtin functions are stored by index so a function lval fits in a word
+#define LVAL_BUILTIN_MAX 64
+static lbuiltin builtins[LVAL_BUILTIN_MAX];
+static int builtins_count = 0;
 
-    v->type = LVAL_NUM; 
-    v->num = x;
+// region used for temporaries while a top-level form is evaluated
+static larena eval_arena;
+static int eval_arena_active = 0;
+
+void lval_arena_begin(void) {
+    eval_arena_active = 1;
+}
+
+void lval_arena_end(void) {
+    eval_arena_active = 0;
+    larena_reset(&eval_arena);
+}
+
+// every lval allocated outside the arena, scanned by the sweep phase
+static lval** gc_objects = NULL;
+static size_t gc_objects_count = 0;
+static size_t gc_objects_slots = 0;
+
+// lists currently being evaluated, scanned by the mark phase
+static lval** gc_roots = NULL;
+static int gc_roots_count = 0;
+static int gc_roots_slots = 0;
+
+// marked lists whose cells are still to be marked, so marking does not
+// recurse once per level of nesting
+static lval** gc_gray = NULL;
+static size_t gc_gray_count = 0;
+static size_t gc_gray_slots = 0;
+
+// interned symbols are not in gc_objects, the symbol table sweeps them and
+// returns how many are left
+static size_t lval_sym_sweep(void);
+
+static size_t gc_heap_size = LVAL_GC_HEAP_SIZE;
+static size_t gc_allocated = 0;
+static lval_gc_stats gc_stats;
+
+static void gc_track(lval* v) {
+    if (gc_objects_count == gc_objects_slots) {
+        gc_objects_slots = gc_objects_slots ? gc_objects_slots * 2 : 256;
+        gc_objects = realloc(gc_objects, sizeof(lval*) * gc_objects_slots);
+    }
+    gc_objects[gc_objects_count++] = v;
+    gc_stats.live_objects++;
+}
 
-    v->err = NULL;
-    v->sym = NULL;
-    v->fun = NULL;
+static void gc_account(long bytes) {
+    gc_stats.live_bytes += bytes;
+    if (bytes > 0) { gc_allocated += bytes; }
+}
+
+// allocate from the arena while one is active, from the pool otherwise
+static void* lval_mem_alloc(size_t size) {
+    if (eval_arena_active) { return larena_alloc(&eval_arena, size); }
+    gc_account(size);
+    return lpool_alloc(size);
+}
+
+static char* lval_strdup(const char* s) {
+    char* x = lval_mem_alloc(strlen(s) + 1);
+    strcpy(x, s);
+    return x;
+}
+
+// resize the cell array of v from its current capacity to capacity
+static void lval_resize_cells(lval* v, int capacity) {
+    size_t old_size = sizeof(lval*) * v->capacity;
+    size_t new_size = sizeof(lval*) * capacity;
+    if (v->flags & LVAL_FLAG_ARENA) {
+        v->cell = larena_realloc(&eval_arena, v->cell, old_size, new_size);
+    } else {
+        gc_account((long)new_size - (long)old_size);
+        v->cell = lpool_realloc(v->cell, old_size, new_size);
+    }
+    v->capacity = capacity;
+}
 
+static lval* lval_alloc(int type) {
+    lval* v = lval_mem_alloc(sizeof(lval));
+    v->type = type;
+    v->flags = eval_arena_active ? LVAL_FLAG_ARENA : 0;
     v->count = 0;
+    v->capacity = 0;
     v->cell = NULL;
-    
+    if (!eval_arena_active) { gc_track(v); }
     return v;
 }
 
+// release the storage of a single heap lval, elements are swept on their own
+static size_t lval_release(lval* v) {
+    size_t bytes = sizeof(lval);
+    switch (v->type)
+    {
+    case LVAL_ERR:
+        bytes += strlen(v->err) + 1;
+        lpool_free(v->err, strlen(v->err) + 1);
+        break;
+    case LVAL_QEXPR:
+    case LVAL_SEXPR:
+        bytes += sizeof(lval*) * v->capacity;
+        lpool_free(v->cell, sizeof(lval*) * v->capacity);
+        break;
+    default:
+        break;
+    }
+    lpool_free(v, sizeof(lval));
+    return bytes;
+}
+
+void lval_gc_push_root(lval* v) {
+    if (gc_roots_count == gc_roots_slots) {
+        gc_roots_slots = gc_roots_slots ? gc_roots_slots * 2 : 64;
+        gc_roots = realloc(gc_roots, sizeof(lval*) * gc_roots_slots);
+    }
+    gc_roots[gc_roots_count++] = v;
+}
+
+void lval_gc_pop_root(void) {
+    gc_roots_count--;
+}
+
+static void lval_mark(lval* v) {
+    if (!LVAL_IS_HEAP(v)) { return; }
+
+    // arena values are walked but not marked, they are not swept
+    if (!(v->flags & LVAL_FLAG_ARENA)) {
+        if (v->flags & LVAL_FLAG_MARK) { return; }
+        v->flags |= LVAL_FLAG_MARK;
+    }
+
+    if ((v->type == LVAL_SEXPR || v->type == LVAL_QEXPR) && v->count > 0) {
+        if (gc_gray_count == gc_gray_slots) {
+            gc_gray_slots = gc_gray_slots ? gc_gray_slots * 2 : 256;
+            gc_gray = realloc(gc_gray, sizeof(lval*) * gc_gray_slots);
+        }
+        gc_gray[gc_gray_count++] = v;
+    }
+}
+
+// marks the cells of every list waiting in the worklist
+static void lval_mark_gray(void) {
+    while (gc_gray_count > 0) {
+        lval* v = gc_gray[--gc_gray_count];
+        for (int i = 0; i < v->count; i++) { lval_mark(v->cell[i]); }
+    }
+}
+
+void lval_gc_collect(lenv* e) {
+    // mark everything reachable from the environment and evaluator stack
+    for (int i = 0; i < e->count; i++) {
+        lval_mark(e->syms[i]);
+        lval_mark(e->vals[i]);
+    }
+    for (int i = 0; i < gc_roots_count; i++) { lval_mark(gc_roots[i]); }
+    lvm_mark_roots(lval_mark);
+    lval_mark_gray();
+
+    // sweep unmarked objects and compact the object table
+    size_t live = 0;
+    for (size_t i = 0; i < gc_objects_count; i++) {
+        lval* v = gc_objects[i];
+        if (v->flags & LVAL_FLAG_MARK) {
+            v->flags &= ~LVAL_FLAG_MARK;
+            gc_objects[live++] = v;
+        } else {
+            size_t bytes = lval_release(v);
+            gc_stats.live_bytes -= bytes;
+            gc_stats.freed_bytes += bytes;
+            gc_stats.freed_objects++;
+        }
+    }
+
+    gc_objects_count = live;
+    gc_stats.live_objects = live + lval_sym_sweep();
+    gc_stats.collections++;
+    gc_allocated = 0;
+}
+
+void lval_gc_poll(lenv* e) {
+    if (gc_allocated >= gc_heap_size) { lval_gc_collect(e); }
+}
+
+void lval_gc_set_heap_size(size_t bytes) {
+    gc_heap_size = bytes;
+}
+
+lval_gc_stats lval_gc_get_stats(void) {
+    lval_gc_stats stats = gc_stats;
+    stats.heap_size = gc_heap_size;
+    return stats;
+}
+
+void lval_gc_print_stats(void) {
+    lval_gc_stats stats = lval_gc_get_stats();
+    printf("gc: %lu collections, %lu live objects (%lu bytes), "
+        "%lu freed objects (%lu bytes), heap size %lu bytes\n",
+        stats.collections,
+        (unsigned long)stats.live_objects, (unsigned long)stats.live_bytes,
+        (unsigned long)stats.freed_objects, (unsigned long)stats.freed_bytes,
+        (unsigned long)stats.heap_size);
+}
+
+// Create a new number type lval
+lval* lval_num(long x) { 
+    // small numbers are encoded directly in the pointer
+    if (x >= LVAL_FIXNUM_MIN && x <= LVAL_FIXNUM_MAX) {
+        return (lval*)(((uintptr_t)x << 1) | LVAL_TAG_FIXNUM);
+    }
+
+    // box numbers that do not fit
+    lval* v = lval_alloc(LVAL_NUM);
+    v->num = x;
+    return v;
+}
+
+// interned symbols, an open addressing table of symbol lvals. The table 
+// does not keep them alive, symbols the collector finds unreachable are 
+// dropped from it, so memory follows the names in use rather than every 
+// name ever read
+static lval** symbols = NULL;
+static size_t symbols_count = 0;
+static size_t symbols_slots = 0;
+
+static size_t lval_sym_hash(const char* s) {
+    // FNV-1a
+    size_t h = 2166136261u;
+    for (; *s; s++) { h = (h ^ (unsigned char)*s) * 16777619u; }
+    return h;
+}
+
+static void lval_sym_rehash(size_t slots) {
+    lval** table = calloc(slots, sizeof(lval*));
+
+    for (size_t i = 0; i < symbols_slots; i++) {
+        if (!symbols[i]) { continue; }
+        size_t j = lval_sym_hash(symbols[i]->sym) & (slots - 1);
+        while (table[j]) { j = (j + 1) & (slots - 1); }
+        table[j] = symbols[i];
+    }
+
+    free(symbols);
+    symbols = table;
+    symbols_slots = slots;
+}
+
+// frees the symbols the last mark phase did not reach
+static size_t lval_sym_sweep(void) {
+    size_t live = 0;
+    for (size_t i = 0; i < symbols_slots; i++) {
+        lval* v = symbols[i];
+        if (!v) { continue; }
+        if (v->flags & LVAL_FLAG_MARK) {
+            v->flags &= ~LVAL_FLAG_MARK;
+            live++;
+            continue;
+        }
+        size_t bytes = sizeof(lval) + strlen(v->sym) + 1;
+        gc_stats.live_bytes -= bytes;
+        gc_stats.freed_bytes += bytes;
+        gc_stats.freed_objects++;
+        free(v->sym);
+        free(v);
+        symbols[i] = NULL;
+    }
+    if (live == symbols_count) { return live; }
+
+    // removing entries breaks probe chains, so the survivors are reinserted
+    // into a table sized for them
+    size_t slots = 256;
+    while (live * 4 > slots) { slots *= 2; }
+    symbols_count = live;
+    lval_sym_rehash(slots);
+    return live;
+}
+
 lval* lval_sym(char* s) {
-    lval* v = malloc(sizeof(lval));
+    // keep the table at most half full
+    if ((symbols_count + 1) * 2 > symbols_slots) {
+        lval_sym_rehash(symbols_slots ? symbols_slots * 2 : 256);
+    }
+
+    size_t i = lval_sym_hash(s) & (symbols_slots - 1);
+    while (symbols[i]) {
+        if (strcmp(symbols[i]->sym, s) == 0) { return symbols[i]; }
+        i = (i + 1) & (symbols_slots - 1);
+    }
 
+    // first occurrence of the name, the symbol lives until nothing refers 
+    // to it
+    lval* v = malloc(sizeof(lval));
     v->type = LVAL_SYM;
+    v->flags = LVAL_FLAG_INTERN;
+    v->count = 0;
+    v->capacity = 0;
     v->sym = malloc(strlen(s) + 1);
     strcpy(v->sym, s);
 
-    v->num = INT_MIN;
-    v->err = NULL;
-    v->fun = NULL;
+    symbols[i] = v;
+    symbols_count++;
 
-    v->count = 0;
-    v->cell = NULL;
-    
+    // counted like any heap value, so reading new names leads to collections
+    gc_stats.live_objects++;
+    gc_account(sizeof(lval) + strlen(s) + 1);
     return v;
 }
 
 // Create a new error type lval
 lval* lval_err(char* fmsg, ...){ 
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_ERR;
+    lval* v = lval_alloc(LVAL_ERR);
 
     // Create a va and initialize 
     va_list va; 
     va_start(va, fmsg);
 
-    v->err = malloc(512);
+    char buffer[512];
     
     // printf the error string with max of 511 chars
-    vsnprintf(v->err, 511, fmsg, va);
+    vsnprintf(buffer, 511, fmsg, va);
 
-    // reallocate number of bytees actually used
-    v->err = realloc(v->err, strlen(v->err)+1);
+    // allocate number of bytees actually used
+    v->err = lval_strdup(buffer);
 
     // cleanup va list 
     va_end(va);
 
-    // initialize unused struct members
-    v->num = INT_MIN;
-    v->sym = NULL;
-    v->fun = NULL;
-
-    v->count = 0;
-    v->cell = NULL;
-
     return v;
 }
 
 lval* lval_fun(lbuiltin func) {
-    lval* v = malloc(sizeof(lval));
-    
-    v->type = LVAL_FUN; 
-    v->fun = func;
-    
-    v->num = INT_MIN;
-    v->err = NULL;
-    v->sym = NULL;
+    // reuse the slot if this builtin is already registered
+    int i;
+    for (i = 0; i < builtins_count; i++) {
+        if (builtins[i] == func) { break; }
+    }
 
-    v->count = 0;
-    v->cell = NULL;
+    if (i == builtins_count) {
+        if (builtins_count == LVAL_BUILTIN_MAX) {
+            return lval_err("too many builtin functions");
+        }
+        builtins[builtins_count++] = func;
+    }
 
-    return v;
+    return (lval*)(((uintptr_t)i << 2) | LVAL_TAG_FUN);
 }
 
-lval* lval_sexpr(void) {
-    lval* v = malloc(sizeof(lval)); 
-    
-    v->type = LVAL_SEXPR; 
-    v->count = 0; 
-    v->cell = NULL; // NULL is a special constant that points to memory location 0
-    
-    v->num = INT_MIN;
-    v->err = NULL;
-    v->sym = NULL;
-    v->fun = NULL;
+lbuiltin lval_to_fun(lval* v) {
+    return builtins[((uintptr_t)v) >> 2];
+}
 
-    return v;
+lval* lval_sexpr(void) {
+    return lval_alloc(LVAL_SEXPR);
 }
 
 lval* lval_qexpr(void) {
-    lval* v = malloc(sizeof(lval));
-    
-    v->type = LVAL_QEXPR;
-    v->count = 0; 
-    v->cell = NULL;
-    
-    v->num = INT_MIN;
-    v->err = NULL;
-    v->sym = NULL;
-    v->fun = NULL;
-
-    return v;
+    return lval_alloc(LVAL_QEXPR);
 }
 
 void free_lval(lval* v){
+    // arena values go away with the arena and heap values are reclaimed by
+    // the collector, so dropping a reference needs no work
+    (void)v;
+}
+
+lval* lval_own(lval* v) {
+    // only arena values are unique, anything on the heap may be shared
+    if (!LVAL_IS_HEAP(v) || (v->flags & LVAL_FLAG_ARENA)) { return v; }
+    if (v->flags & LVAL_FLAG_INTERN) { return v; }
+
+    // copy the top node only, the elements stay shared
+    lval* x = lval_alloc(v->type);
     switch (v->type)
     {
     case LVAL_NUM:
+        x->num = v->num;
         break;
     case LVAL_ERR:
-        free(v->err);
-        break;
-    case LVAL_SYM:
-        free(v->sym);
-        break;
-    case LVAL_FUN:
+        x->err = lval_strdup(v->err);
         break;
     case LVAL_QEXPR:
     case LVAL_SEXPR:
-        // free all elements inside
-        for(int i = 0; i < v->count; i++){
-            free_lval(v->cell[i]);
-        }
-        // also free memory allocated to contain pointers
-        free(v->cell);
+        lval_resize_cells(x, v->count);
+        x->count = v->count; 
+        memcpy(x->cell, v->cell, sizeof(lval*) * v->count);
         break;
     default:
         break;
     }
-    // free memory allocated for lval struct itself
-    free(v);
+    return x;
 }
 
 lval* lval_add(lval* v, lval* x){ 
+    // grow geometrically so appending n elements is linear
+    if (v->count == v->capacity) {
+        lval_resize_cells(v, v->capacity ? v->capacity * 2 : 4);
+    }
     v->count++; 
-    v->cell = realloc(v->cell, sizeof(lval*) * v->count);
     v->cell[v->count-1] = x;
     return v;
 }
 
 lval* lval_copy(lval* v) { 
-    lval* x = malloc(sizeof(lval));
-    x->type = v->type;
-    
-    x->num = INT_MIN;
-    x->err = NULL;
-    x->sym = NULL;
-    x->fun = NULL;
-    x->count = 0;
-    x->cell = NULL;
+    // immediates are copied by value, interned symbols are shared
+    if (!LVAL_IS_HEAP(v) || (v->flags & LVAL_FLAG_INTERN)) { return v; }
+
+    lval* x = lval_alloc(v->type);
 
     switch (v->type)
     {
     case LVAL_NUM:
         x->num = v->num;
         break;
-    case LVAL_SYM:
-        x->sym = malloc(strlen(v->sym) + 1);
-        strcpy(x->sym, v->sym);
-        break;
     case LVAL_ERR:
-        x->err = malloc(strlen(v->err) + 1);
-        strcpy(x->err, v->err); 
-        break;
-    case LVAL_FUN:
-        x->fun = v->fun;
+        x->err = lval_strdup(v->err);
         break;
     case LVAL_QEXPR:
     case LVAL_SEXPR:
+        lval_resize_cells(x, v->count);
         x->count = v->count; 
-        x->cell = malloc(sizeof(lval*) * x->count); 
         for(int i = 0; i < x->count; i++){
             x->cell[i] = lval_copy(v->cell[i]);
         }
@@ -270,11 +560,78 @@ lval* lval_copy(lval* v) {
     return x;
 }
 
+// heap copy of an arena value, a list still holding its arena elements
+static lval* lval_promote_node(lval* v) {
+    lval* x = lval_alloc(v->type);
+    switch (v->type)
+    {
+    case LVAL_NUM:
+        x->num = v->num;
+        break;
+    case LVAL_ERR:
+        x->err = lval_strdup(v->err);
+        break;
+    case LVAL_QEXPR:
+    case LVAL_SEXPR:
+        lval_resize_cells(x, v->count);
+        x->count = v->count; 
+        memcpy(x->cell, v->cell, sizeof(lval*) * v->count);
+        break;
+    default:
+        break;
+    }
+    return x;
+}
+
+static int lval_in_arena(lval* v) {
+    return LVAL_IS_HEAP(v) && (v->flags & LVAL_FLAG_ARENA);
+}
+
+lval* lval_promote(lval* v) {
+    // values already outside the arena are shared
+    if (!lval_in_arena(v)) { return v; }
+
+    // copy with the arena switched off so the result outlives the form
+    int active = eval_arena_active;
+    eval_arena_active = 0;
+
+    // copied lists whose elements are still in the arena are kept on an 
+    // explicit stack, so deeply nested values can not overflow the C stack
+    lval** stack = NULL;
+    int count = 0;
+    int slots = 0;
+
+    lval* x = lval_promote_node(v);
+    lval* y = x;
+    while (y) {
+        // promote the elements of the list, pushing the lists among them
+        int list = y->type == LVAL_SEXPR || y->type == LVAL_QEXPR;
+        for (int i = 0; list && i < y->count; i++) {
+            if (!lval_in_arena(y->cell[i])) { continue; }
+
+            lval* c = lval_promote_node(y->cell[i]);
+            y->cell[i] = c;
+            if (c->type != LVAL_SEXPR && c->type != LVAL_QEXPR) { continue; }
+
+            if (count == slots) {
+                slots = slots ? slots * 2 : 64;
+                stack = realloc(stack, sizeof(lval*) * slots);
+            }
+            stack[count++] = c;
+        }
+        y = count > 0 ? stack[--count] : NULL;
+    }
+
+    free(stack);
+    eval_arena_active = active;
+    return x;
+}
+
 lval* lval_cons(lval* x, lval* y) {
-    // for each cell in y add it to x
-    while(y->count) {
-        lval* yprim = lval_pop(y, 0); 
-        if (yprim->type == LVAL_SEXPR){ 
+    // for each cell in y add it to x, y itself is left untouched
+    for (int i = 0; i < y->count; i++) {
+        lval* yprim = y->cell[i]; 
+        if (lval_typeof(yprim) == LVAL_SEXPR){ 
             x = lval_cons(x, yprim);
         }else{
             x = lval_add(x, yprim);
@@ -306,33 +663,64 @@ char* lval_type(int t) {
 }
 
 
+// list being printed and the index of its next element
+typedef struct {
+    lval* v;
+    int i;
+} lval_print_frame;
+
 void lval_print(lval* v){
-    switch (v->type)
-    {
-    case LVAL_NUM:
-        printf("%li", v->num);
-        break;
-    case LVAL_ERR:
-        printf("%s", v->err);
-        break;
-    case LVAL_SYM:
-        printf("%s", v->sym);
-        break;
-    case LVAL_FUN:
-        printf("<function>");
-        break;
-    case LVAL_SEXPR:
-        putchar('(');
-        lval_expr_print(v);
-        putchar(')');
-        break;
-    case LVAL_QEXPR:
-        putchar('\'');
-        lval_expr_print(v);
-        break;
-    default:
-        break;
+    // lists still being printed are kept on an explicit stack, so deeply 
+    // nested values can not overflow the C stack
+    lval_print_frame* stack = NULL;
+    int count = 0;
+    int slots = 0;
+
+    while (v) {
+        switch (lval_typeof(v))
+        {
+        case LVAL_NUM:
+            printf("%li", lval_to_num(v));
+            break;
+        case LVAL_ERR:
+            printf("%s", v->err);
+            break;
+        case LVAL_SYM:
+            printf("%s", v->sym);
+            break;
+        case LVAL_FUN:
+            printf("<function>");
+            break;
+        case LVAL_SEXPR:
+        case LVAL_QEXPR:
+            putchar(lval_typeof(v) == LVAL_SEXPR ? '(' : '\'');
+            if (count == slots) {
+                slots = slots ? slots * 2 : 64;
+                stack = realloc(stack, sizeof(lval_print_frame) * slots);
+            }
+            stack[count++] = (lval_print_frame){ v, 0 };
+            break;
+        default:
+            break;
+        }
+
+        // next element of the innermost unfinished list, closing the
+        // lists that are done
+        v = NULL;
+        while (count > 0) {
+            lval_print_frame* f = &stack[count - 1];
+            if (f->i < f->v->count) {
+                // don't print a trailing white space characer
+                if (f->i > 0) { putchar(' '); }
+                v = f->v->cell[f->i++];
+                break;
+            }
+            if (lval_typeof(f->v) == LVAL_SEXPR) { putchar(')'); }
+            count--;
+        }
     }
+
+    free(stack);
 }
 
 void lval_expr_print(lval* v){
@@ -359,63 +747,26 @@ lval* lval_pop(lval* v, int index) {
     // shift memory afer item 
     memmove(&v->cell[index], &v->cell[index+1], sizeof(lval*) * (v->count-index-1));
 
-    // decrease count of items in list
+    // decrease count of items in list, the capacity is kept for reuse
     v->count--; 
-
-    // realllocate memory used
-    v->cell = realloc(v->cell, sizeof(lval*) * v->count);
     return x;
 }
 
 lval* lval_take(lval* v, int index) {
+    // a shared list is left intact, only the element is referenced
+    if (LVAL_IS_HEAP(v) && !(v->flags & LVAL_FLAG_ARENA)) {
+        return v->cell[index];
+    }
+
     lval* x = lval_pop(v, index);
     free_lval(v);
     return x;
 }
 
-lval* lval_eval_sexpr(lenv* e, lval* v)
-{
-    // eval children
-    for (int i = 0; i < v->count; i++){ 
-        v->cell[i] = lval_eval(e, v->cell[i]);
-
-        // error checking
-        if (v->cell[i]->type == LVAL_ERR){
-            return lval_take(v, i);
-        }
-    }
-
-    // empty expression
-    if (v->count == 0) { return v; }
-
-    // single expression
-    if (v->count == 1) { return lval_take(v, 0); }
-
-    // ensure 1st element is function after evaluation
-    lval* f = lval_pop(v, 0);
-    if(f->type != LVAL_FUN){
-        free_lval(f); 
-        free_lval(v);
-        return lval_err("First element must be a function.");
-    }
-
-    // call builtin with operator
-    lval* result = f->fun(e, v); 
-    free_lval(f); 
-    return result;
-}
-
 lval* lval_eval(lenv* e, lval* v) {
-    
-    // Evaluate/resolve symbols using environment map
-    if (v->type == LVAL_SYM){
-        lval* x = lenv_get(e, v);
-        free_lval(v);
-        return x;
-    }
-
-    // evaluate S-expression
-    if (v->type == LVAL_SEXPR) { return lval_eval_sexpr(e, v); }
+    // symbols and S-expressions are compiled and run on the vm
+    int type = lval_typeof(v);
+    if (type == LVAL_SYM || type == LVAL_SEXPR) { return lvm_eval(e, v); }
 
     // all other lvals evaluate to themself
     return v;
@@ -441,6 +792,7 @@ void lenv_add_builtins(lenv* e){
     lenv_add_builtin(e, "cdr", builtin_cdr);
     lenv_add_builtin(e, "cons", builtin_cons);
     lenv_add_builtin(e, "eval", builtin_eval);
+    lenv_add_builtin(e, "gc", builtin_gc);
 }
 
 lval* builtin_add(lenv* e, lval* a) {
@@ -460,10 +812,10 @@ lval* builtin_div(lenv* e, lval* a) {
 }
 
 lval* builtin_set(lenv* e, lval* a) {
-    LASSERT(a, a->cell[0]->type == LVAL_QEXPR,
+    LASSERT(a, lval_typeof(a->cell[0]) == LVAL_QEXPR,
         "Function 'set' passed incorrect typefor argument 0. "
             "Got %s, Expected %s.",
-            lval_type(a->cell[0]->type), lval_type(LVAL_QEXPR));
+            lval_type(lval_typeof(a->cell[0])), lval_type(LVAL_QEXPR));
 
     // first argument is symbol
     lval* sym = a->cell[0];
@@ -491,14 +843,14 @@ lval* builtin_car(lenv* e, lval* a) {
         "Got %i, Expected %i",
         a->count, 1);
     
-    LASSERT(a, a->cell[0]->type == LVAL_QEXPR, 
+    LASSERT(a, lval_typeof(a->cell[0]) == LVAL_QEXPR, 
         "Function 'car' passed incorrect typefor argument 0. "
             "Got %s, Expected %s.",
-            lval_type(a->cell[0]->type), lval_type(LVAL_QEXPR));
+            lval_type(lval_typeof(a->cell[0])), lval_type(LVAL_QEXPR));
 
     lval* v = lval_take(lval_take(a, 0), 0); 
-    if(v->type == LVAL_SEXPR){
-        return lval_pop(v, 0);
+    if(lval_typeof(v) == LVAL_SEXPR){
+        return lval_take(v, 0);
     }
     return v;
 }
@@ -510,16 +862,17 @@ lval* builtin_cdr(lenv* e, lval* a) {
         "Got %i, Expected %i",
         a->count, 1);
     
-    LASSERT(a, a->cell[0]->type == LVAL_QEXPR, 
+    LASSERT(a, lval_typeof(a->cell[0]) == LVAL_QEXPR, 
         "Function 'cdr' passed incorrect typefor argument 0. "
             "Got %s, Expected %s.",
-            lval_type(a->cell[0]->type), lval_type(LVAL_QEXPR));
+            lval_type(lval_typeof(a->cell[0])), lval_type(LVAL_QEXPR));
     
     LASSERT(a, a->cell[0]->count != 0, 
         "Function 'cdr' passed passed {}");
 
     lval* v = lval_take(lval_take(a, 0), 0);
-    if (v->type == LVAL_SEXPR){
+    if (lval_typeof(v) == LVAL_SEXPR){
+        v = lval_own(v);
         free_lval(lval_pop(v,0));
         return lval_add(lval_qexpr(), v);
     }
@@ -529,21 +882,24 @@ lval* builtin_cdr(lenv* e, lval* a) {
 lval* builtin_cons(lenv* e, lval* a){
     
     for (int i = 0; i < a->count; i++) {
-        LASSERT(a, a->cell[i]->type == LVAL_QEXPR,
+        LASSERT(a, lval_typeof(a->cell[i]) == LVAL_QEXPR,
             "Function 'cons' passed incorrect typefor argument 0. "
             "Got %s, Expected %s.",
-            lval_type(a->cell[0]->type), lval_type(LVAL_QEXPR));
+            lval_type(lval_typeof(a->cell[0])), lval_type(LVAL_QEXPR));
     }
 
-    lval* x = lval_pop(lval_pop(a, 0), 0);
-    if (x->type == LVAL_QEXPR) {
+    lval* x = lval_take(a->cell[0], 0);
+    if (lval_typeof(x) == LVAL_QEXPR) {
+        x = lval_own(x);
         x->type = LVAL_SEXPR;
-    } else if (x->type != LVAL_SEXPR) {
+    } else if (lval_typeof(x) != LVAL_SEXPR) {
         x = lval_add(lval_sexpr(), x); 
+    } else {
+        x = lval_own(x);
     }
 
-    while (a->count){ 
-        x = lval_cons(x, lval_pop(a, 0));
+    for (int i = 1; i < a->count; i++){ 
+        x = lval_cons(x, a->cell[i]);
     }
 
     free_lval(a);
@@ -553,52 +909,75 @@ lval* builtin_cons(lenv* e, lval* a){
 lval* builtin_eval(lenv* e, lval* a) {
     LASSERT(a, a->count == 1, 
         "Function 'eval' passed too may arguments");
-    LASSERT(a, a->cell[0]->type == LVAL_QEXPR, 
+    LASSERT(a, lval_typeof(a->cell[0]) == LVAL_QEXPR, 
         "Function 'eval' passed incorrect type");
     
-        lval* x = lval_take(a, 0); 
+        lval* x = lval_own(lval_take(a, 0)); 
         x->type = LVAL_SEXPR; 
         return lval_eval(e, x);
 }
 
+lval* builtin_gc(lenv* e, lval* a) {
+    LASSERT(a, a->count == 1, 
+        "Function 'gc' passed too many arguments");
+    LASSERT(a, lval_typeof(a->cell[0]) == LVAL_NUM && lval_to_num(a->cell[0]) >= 0, 
+        "Function 'gc' passed incorrect type");
+
+    // (gc n) also sets the heap size between collections, (gc 0) only 
+    // collects and prints the stats, as (gc) would evaluate to gc itself
+    long bytes = lval_to_num(a->cell[0]);
+    if (bytes > 0) { lval_gc_set_heap_size(bytes); }
+
+    free_lval(a);
+    lval_gc_collect(e);
+    lval_gc_print_stats();
+    return lval_sexpr();
+}
+
 lval* builtin_op(lenv* e, lval* a, char* op){
 
     // check that all arguments are numeric
     for (int i = 0; i < a->count; i++){
-        if(a->cell[i]->type != LVAL_NUM){
+        if(lval_typeof(a->cell[i]) != LVAL_NUM){
             free_lval(a);
             return lval_err("Illegal non-numeric operand.");
         }
     }
 
-    // pop first element
-    lval* x = lval_pop(a, 0); 
+    // first element
+    long result = lval_to_num(a->cell[0]);
 
     // if no argument and sub then preform unary negation
-    if ((strcmp(op, "-") == 0) && a->count == 0) { 
-        x->num = -x->num;
+    if (op[0] == '-' && a->count == 1) { 
+        result = -result;
     }
 
-    // while there more elements remaining
-    while (a->count > 0){ 
-        // pop next element
-        lval* y = lval_pop(a, 0);
+    // fold the remaining elements in order
+    for (int i = 1; i < a->count; i++){ 
+        long n = lval_to_num(a->cell[i]);
     
-        if (strcmp("+", op) == 0) { x->num += y->num; }
-        if (strcmp("-", op) == 0) { x->num -= y->num; }
-        if (strcmp("*", op) == 0) { x->num *= y->num; }
-        if (strcmp("/", op) == 0) { 
-            if (y->num == 0 ) {
-                free_lval(x); 
-                free_lval(y);
+        switch (op[0])
+        {
+        case '+':
+            result += n;
+            break;
+        case '-':
+            result -= n;
+            break;
+        case '*':
+            result *= n;
+            break;
+        case '/':
+            if (n == 0 ) {
+                free_lval(a);
                 return lval_err("division by zero");
             }
-            x->num /= y->num; 
+            result /= n; 
+            break;
         }
-        free_lval(y);
     }
     free_lval(a);
-    return x;
+    return lval_num(result);
 }
 
 lval* lval_read_num(mpc_ast_t* t){
@@ -607,43 +986,92 @@ lval* lval_read_num(mpc_ast_t* t){
     return errno != ERANGE ? lval_num(x) : lval_err("invalid number");
 }
 
+// value of a number or symbol node, or the empty list a node's children 
+// are read into
+static lval* lval_read_node(mpc_ast_t* t){
+    switch (t->id)
+    {
+    case LISPY_NUMBER: return lval_read_num(t);
+    case LISPY_SYMBOL: return lval_sym(t->contents);
+    case LISPY_QEXPR: return lval_qexpr();
+
+    // root (>) or sexpr
+    default: return lval_sexpr();
+    }
+}
+
+// list being filled and the index of the next child to read into it
+typedef struct {
+    mpc_ast_t* t;
+    lval* x;
+    int i;
+} lval_read_frame;
+
 lval* lval_read(mpc_ast_t* t){
-    // if symbol or number return conversion to that type
-    if(strstr(t->tag, "number")) { return lval_read_num(t); }
-    if(strstr(t->tag, "symbol")) { return lval_sym(t->contents); }
-
-    // if root (>) or sexpr ten create empty list
-    lval* x = NULL;
-    if(strcmp(t->tag, ">") == 0) { x = lval_sexpr(); }
-    if(strstr(t->tag, "sexpr")) { x = lval_sexpr(); }
-    if(strstr(t->tag, "qexpr")) { x = lval_qexpr(); }
-
-    // fill this list with valid expression contained within
-    for(int i = 0; i < t->children_num; i++){
-        if(strcmp(t->children[i]->contents, "(") == 0) { continue; }
-        if(strcmp(t->children[i]->contents, ")") == 0) { continue; }
-        if(strcmp(t->children[i]->contents, "\'") == 0) { continue; }
-        if(strcmp(t->children[i]->tag, "regex") == 0) { continue; }
-        x = lval_add(x, lval_read(t->children[i]));
+    // lists still being filled are kept on an explicit stack, so deeply 
+    // nested input can not overflow the C stack
+    lval_read_frame* stack = NULL;
+    int count = 0;
+    int slots = 0;
+
+    lval* x = lval_read_node(t);
+    int i = 0;
+
+    while (1) {
+        if (i < t->children_num) {
+            // skip brackets, quotes and anchors
+            mpc_ast_t* c = t->children[i++];
+            if (c->punct) { continue; }
+
+            lval* y = lval_read_node(c);
+            if (c->children_num == 0) {
+                x = lval_add(x, y);
+                continue;
+            }
+
+            // fill the child list before going on with this one
+            if (count == slots) {
+                slots = slots ? slots * 2 : 64;
+                stack = realloc(stack, sizeof(lval_read_frame) * slots);
+            }
+            stack[count++] = (lval_read_frame){ t, x, i };
+            t = c;
+            x = y;
+            i = 0;
+            continue;
+        }
+
+        if (count == 0) { break; }
+
+        lval* y = x;
+        count--;
+        t = stack[count].t;
+        x = lval_add(stack[count].x, y);
+        i = stack[count].i;
     }
+
+    free(stack);
     return x;
 }
 
 lval* eval_op(lval* x, char* op, lval* y){
     // if either of the valuies is an error return immediately
-    if(x->type == LVAL_ERR && y->type == LVAL_ERR) { return lval_err("bad number"); }
-    if(x->type == LVAL_ERR) { return y; }
-    if(y->type == LVAL_ERR) { return x; }
+    if(lval_typeof(x) == LVAL_ERR && lval_typeof(y) == LVAL_ERR) { return lval_err("bad number"); }
+    if(lval_typeof(x) == LVAL_ERR) { return y; }
+    if(lval_typeof(y) == LVAL_ERR) { return x; }
 
-    if(strcmp("+", op) == 0) { return lval_num(x->num + y->num); }
-    if(strcmp("-", op) == 0) { return lval_num(x->num - y->num); }
-    if(strcmp("*", op) == 0) { return lval_num(x->num * y->num); }
+    long a = lval_to_num(x);
+    long b = lval_to_num(y);
+
+    if(strcmp("+", op) == 0) { return lval_num(a + b); }
+    if(strcmp("-", op) == 0) { return lval_num(a - b); }
+    if(strcmp("*", op) == 0) { return lval_num(a * b); }
     if(strcmp("/", op) == 0) { 
-        if(y->num == 0){ return lval_err("divide by zero"); }
-        return lval_num(x->num / y->num); 
+        if(b == 0){ return lval_err("divide by zero"); }
+        return lval_num(a / b); 
     }
-    if(strcmp("min", op) == 0) { return ((x->num) > (y->num)) ? lval_num(y->num): lval_num(x->num); }
-    if(strcmp("max", op) == 0) { return ((x->num) > (y->num)) ? lval_num(x->num): lval_num(y->num); }
+    if(strcmp("min", op) == 0) { return (a > b) ? lval_num(b): lval_num(a); }
+    if(strcmp("max", op) == 0) { return (a > b) ? lval_num(a): lval_num(b); }
 
     return lval_err("bad operation");
 }
@@ -699,6 +1127,68 @@ lval* eval(mpc_ast_t* t) {
     return x;
 }
 
+void lval_eval_print(lenv* e, lval* x) {
+    printf("lispy: "); lval_println(x);
+
+    // output sexpr eval
+    lval* res = lval_eval(e, x);
+    printf("lispy eval: "); lval_println(res);
+    free_lval(res);
+}
+
+// reads, evaluates and frees one top-level form of the script at a time,
+// printing each value, returns non-zero if the script does not parse
+int lval_run_script(lenv* e, mpc_parser_t* form, const char* filename, FILE* f) {
+    mpc_stream_t* s = mpc_stream_new(MPC_PARSE_ARENA, filename, f);
+    mpc_result_t r;
+    int status = 0;
+
+    while (1) {
+        if (!mpc_stream_parse(s, form, &r)) {
+            mpc_err_print(r.error);
+            mpc_err_delete(r.error);
+            status = 1;
+            break;
+        }
+
+        // the expression read, or none at the end of the script
+        mpc_ast_t* a = r.output;
+        mpc_ast_t* x = NULL;
+        for (int i = 0; i < a->children_num; i++) {
+            if (!a->children[i]->punct) { x = a->children[i]; }
+        }
+
+        if (!x) {
+            mpc_ast_delete(a);
+            break;
+        }
+
+        lval_arena_begin();
+        lval* res = lval_eval(e, lval_read(x));
+        lval_println(res);
+        free_lval(res);
+        lval_arena_end();
+
+        mpc_ast_delete(a);
+    }
+
+    mpc_stream_delete(s);
+    return status;
+}
+
+// the language given to mpca_lang, also hashed into lispy_image.h so an 
+// image saved from another grammar is not loaded
+static const char* lispy_grammar = 
+    "                                                           \
+        number  : /-?[0-9]+/;                                   \
+        symbol  : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&]+/;    \
+        sexpr   : '(' <expr>* ')';                              \
+        qexpr   : '\''<expr>;                              \
+        expr    : <number> | <symbol> | <sexpr> | <qexpr>;                \
+        lispy   : /^/ <expr>* /$/;                               \
+        form    : /\\s*/ (<expr> | /$/);                         \
+    ";
+
 int main(int argc, char** argv){
     // Create parsers
     mpc_parser_t* Number    = mpc_new("number");
@@ -707,23 +1197,70 @@ int main(int argc, char** argv){
     mpc_parser_t* Qexpr     = mpc_new("qexpr");
     mpc_parser_t* Expr      = mpc_new("expr");
     mpc_parser_t* Lispy     = mpc_new("lispy");
+    mpc_parser_t* Form      = mpc_new("form");
+
+    // Define language, loading the grammar image main was built with when 
+    // there is one, and building it again if the image was saved from 
+    // another grammar or by another version of mpc
+    int loaded = 0;
+#ifdef LISPY_IMAGE
+    mpc_err_t* image_err = mpc_image_load(lispy_image, sizeof(lispy_image), 
+        lispy_grammar, 7, Number, Symbol, Sexpr, Qexpr, Expr, Lispy, Form);
+    if (image_err) { mpc_err_delete(image_err); } else { loaded = 1; }
+#endif
+    if (!loaded) {
+        mpca_lang(MPCA_LANG_DEFAULT, lispy_grammar, 
+            Number, Symbol, Sexpr, Qexpr, Expr, Lispy, Form);
+    }
+
+    // main --grammar-image [file] writes the grammar as a C array for 
+    // lispy_image.h, to stdout when no file is given
+    if (argc > 1 && strcmp(argv[1], "--grammar-image") == 0) {
+        FILE* out = argc > 2 ? fopen(argv[2], "w") : stdout;
+        if (out == NULL) {
+            perror(argv[2]);
+            mpc_cleanup(7, Number, Symbol, Sexpr, Qexpr, Expr, Lispy, Form);
+            return 1;
+        }
+        mpc_err_t* err = mpc_image_save_c(out, "lispy_image", lispy_grammar, 
+            7, Number, Symbol, Sexpr, Qexpr, Expr, Lispy, Form);
+        mpc_cleanup(7, Number, Symbol, Sexpr, Qexpr, Expr, Lispy, Form);
+        if (out != stdout) { fclose(out); }
+        if (err) {
+            mpc_err_print(err);
+            mpc_err_delete(err);
+            return 1;
+        }
+        return 0;
+    }
+
+    // LISPY_READER=lread reads input without the mpc grammar
+    char* reader = getenv("LISPY_READER");
+    int use_lread = reader && strcmp(reader, "lread") == 0;
 
-    // Define language
-    mpca_lang(MPCA_LANG_DEFAULT, 
-        "                                                           \
-            number  : /-?[0-9]+/;                                   \
-            symbol  : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&]+/;    \
-            sexpr   : '(' <expr>* ')';                              \
-            qexpr   : '\''<expr>;                              \
-            expr    : <number> | <symbol> | <sexpr> | <qexpr>;                \
-            lispy   : /^/ <expr>* /$/;                               \
-        ", 
-    Number, Symbol, Sexpr, Qexpr, Expr, Lispy);
+    // heap size between collections can be tuned from the environment
+    char* heap_size = getenv("LISPY_GC_HEAP");
+    if (heap_size) { lval_gc_set_heap_size(strtoul(heap_size, NULL, 10)); }
 
     // define alist
     lenv* e = lenv_new(); 
     lenv_add_builtins(e);
 
+    // ./main file.lisp runs a script, ./main - reads one from stdin
+    if (argc > 1) {
+        FILE* f = strcmp(argv[1], "-") == 0 ? stdin : fopen(argv[1], "rb");
+        if (!f) {
+            perror(argv[1]);
+            return 1;
+        }
+
+        int status = lval_run_script(e, Form, f == stdin ? "<stdin>" : argv[1], f);
+        if (f != stdin) { fclose(f); }
+
+        mpc_cleanup(7, Number, Symbol, Sexpr, Qexpr, Expr, Lispy, Form);
+        return status;
+    }
+
     // Print version and exit information
     puts("Lispy Version 0.0.0.0.1");
     puts("Press Ctrl+c to exit\n"); 
@@ -736,7 +1273,21 @@ int main(int argc, char** argv){
         
         // Attempt to parse user input
         mpc_result_t r; 
-        if(mpc_parse("<stdin>", input, Lispy, &r)){
+        if (use_lread) {
+            // the reader allocates straight into the arena
+            lval_arena_begin();
+
+            char* error = NULL;
+            lval* x = lread_string("<stdin>", input, &error);
+            if (x) {
+                lval_eval_print(e, x);
+            } else {
+                printf("%s", error);
+                free(error);
+            }
+
+            lval_arena_end();
+        } else if(mpc_parse_flags(MPC_PARSE_ARENA, "<stdin>", input, Lispy, &r)){
 
             // load AST from output
             mpc_ast_t* a = r.output; 
@@ -759,15 +1310,15 @@ int main(int argc, char** argv){
             // printf("First Child Contents: %s\n", c0->contents);
             // printf("First Child number of children: %i\n", c0->children_num);
 
+            // temporaries of this form live in the arena until it is printed
+            lval_arena_begin();
+
             // transform ast to sexptr
-            lval* x = lval_read(a);
-            printf("lispy: "); lval_println(x);
+            lval_eval_print(e, lval_read(a));
 
-            // output sexpr eval
-            lval* res = lval_eval(e, x);
-            printf("lispy eval: "); lval_println(res);
-            free_lval(res);
+            lval_arena_end();
 
+            // the whole tree lives in one arena owned by its root
             mpc_ast_delete(a); 
         } else {
             // On error print message
@@ -779,7 +1330,7 @@ int main(int argc, char** argv){
     }
 
     // undefine and delete parser
-    mpc_cleanup(6, Number, Symbol, Sexpr, Qexpr, Expr, Lispy);
+    mpc_cleanup(7, Number, Symbol, Sexpr, Qexpr, Expr, Lispy, Form);
 
     return 0; 
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef MAIN_H
 #define MAIN_H
 
+#include <stdint.h>
+
 #include "mpc.h"
 
 #define LASSERT(args, cond, fmsg, ...) if (!(cond)) { free_lval(args); return lval_err(fmsg, ##__VA_ARGS__); }
@@ -16,23 +18,75 @@ enum { LVAL_NUM, LVAL_SYM, LVAL_ERR,
 
 typedef lval* (*lbuiltin)(lenv*, lval*);
 
-struct lval{ 
-    int type;
+/*
+ * An lval* is a tagged word. The low two bits select how it is stored:
+ *   ...x1  fixnum, the number lives in the upper bits
+ *   ...10  builtin function, index into the builtin table in the upper bits
+ *   ...00  pointer to a heap allocated struct lval
+ * Only lists, symbols, errors and numbers too large for a fixnum are 
+ * allocated on the heap.
+ */
+#define LVAL_TAG_MASK   ((uintptr_t)3)
+#define LVAL_TAG_FIXNUM ((uintptr_t)1)
+#define LVAL_TAG_FUN    ((uintptr_t)2)
+
+#define LVAL_FIXNUM_MAX (INTPTR_MAX >> 1)
+#define LVAL_FIXNUM_MIN (INTPTR_MIN >> 1)
+
+#define LVAL_IS_FIXNUM(v) (((uintptr_t)(v)) & LVAL_TAG_FIXNUM)
+#define LVAL_IS_FUN(v)    ((((uintptr_t)(v)) & LVAL_TAG_MASK) == LVAL_TAG_FUN)
+#define LVAL_IS_HEAP(v)   ((((uintptr_t)(v)) & LVAL_TAG_MASK) == 0)
+
+// lval is allocated in the evaluation arena
+#define LVAL_FLAG_ARENA 1
+
+// lval was reached by the last mark phase
+#define LVAL_FLAG_MARK 2
 
-    long num;
-    char* err;
-    char* sym;
-    lbuiltin fun;
+// lval is an interned symbol, shared by every occurrence of its name and 
+// freed by the collector once nothing refers to it
+#define LVAL_FLAG_INTERN 4
 
-    // pointer to a list of lval*
+// bytes allocated on the heap between collections unless tuned at startup
+#define LVAL_GC_HEAP_SIZE (1 << 20)
+
+struct lval{ 
+    unsigned char type;
+    unsigned char flags;
+
+    // number of elements in cell and number of slots allocated
     int count; 
-    lval** cell;
+    int capacity;
+
+    union {
+        long num;       // number that does not fit in a fixnum
+        char* err;
+        char* sym;
+        lval** cell;    // pointer to a list of lval*
+    };
 }; 
 
+// lval accessors, valid for both immediate and heap values
+static inline int lval_typeof(lval* v) {
+    if (LVAL_IS_FIXNUM(v)) { return LVAL_NUM; }
+    if (LVAL_IS_FUN(v)) { return LVAL_FUN; }
+    return v->type;
+}
+
+static inline long lval_to_num(lval* v) {
+    if (LVAL_IS_FIXNUM(v)) { return (long)(((intptr_t)v) >> 1); }
+    return v->num;
+}
+
 struct lenv {
     int count; 
-    char** syms; 
+    int capacity;
+    lval** syms; 
     lval** vals;
+
+    // open addressing index into syms/vals, 0 for an empty slot
+    int slots;
+    int* index;
 };
 
 // lenv alllocation/deallocation
@@ -41,6 +95,7 @@ void free_lenv(lenv* e);
 
 // lenv methods
 lval* lenv_get(lenv* e, lval* k);
+int lenv_slot(lenv* e, lval* k);
 void lenv_put(lenv* e, lval* k, lval* v);
 
 // lval alllocation/deallocation
@@ -48,10 +103,53 @@ lval* lval_num(long x);
 lval* lval_sym(char* s);
 lval* lval_err(char* fmsg, ...);
 lval* lval_fun(lbuiltin func);
+lbuiltin lval_to_fun(lval* v);
 lval* lval_sexpr(void);
 lval* lval_qexpr(void);
 void free_lval(lval* v);
 
+/**
+ * @brief while the arena is active every new lval is allocated in a region
+ * that is released in one step by lval_arena_end. Values stored in an lenv
+ * are promoted out of the arena onto the collected heap.
+ */
+void lval_arena_begin(void);
+void lval_arena_end(void);
+lval* lval_promote(lval* v);
+
+/**
+ * @brief values outside the arena are immutable once shared.
+ * lval_own returns a version of v that the caller may modify, 
+ * copying the top node if v is on the heap.
+ * 
+ * @param v
+ * @return v or a copy of v
+ */
+lval* lval_own(lval* v);
+
+/**
+ * @brief heap values are reclaimed by a mark and sweep collector. 
+ * The roots are the values of the lenv, the vm stack and the argument
+ * lists of running builtins, a collection runs once heap_size bytes were allocated since the
+ * last one. 
+ */
+typedef struct {
+    unsigned long collections;
+    size_t live_objects;
+    size_t live_bytes;
+    size_t freed_objects;
+    size_t freed_bytes;
+    size_t heap_size;
+} lval_gc_stats;
+
+void lval_gc_push_root(lval* v);
+void lval_gc_pop_root(void);
+void lval_gc_collect(lenv* e);
+void lval_gc_poll(lenv* e);
+void lval_gc_set_heap_size(size_t bytes);
+lval_gc_stats lval_gc_get_stats(void);
+void lval_gc_print_stats(void);
+
 // lval methods
 // create lval from abstract syntax tree (ast).
 lval* lval_add(lval* v, lval* x);
@@ -85,8 +183,8 @@ lval* lval_pop(lval* v, int index);
 lval* lval_take(lval* v, int index);
 
 //
-lval* lval_eval_sexpr(lenv* e, lval* v);
 lval* lval_eval(lenv* e, lval* v);
+void lval_eval_print(lenv* e, lval* x);
 
 //
 void lenv_add_builtin(lenv* e, char* name, lbuiltin func);
@@ -103,15 +201,21 @@ lval* builtin_car(lenv* e, lval* a);
 lval* builtin_cdr(lenv* e, lval* a);
 lval* builtin_cons(lenv* e, lval* a);
 lval* builtin_eval(lenv* e, lval* a);
+lval* builtin_gc(lenv* e, lval* a);
 
 lval* builtin_op(lenv* e, lval* a, char* op);
 
+// rule ids of the grammar, the position of each parser passed to mpca_lang
+enum { LISPY_NUMBER = 1, LISPY_SYMBOL, LISPY_SEXPR, LISPY_QEXPR, LISPY_EXPR, LISPY, LISPY_FORM };
+
 // ast evaluation methods
 lval* lval_read_num(mpc_ast_t* t);
 lval* lval_read(mpc_ast_t* t);
 int number_of_nodes(mpc_ast_t* t);
 int number_of_leaves(mpc_ast_t* t);
 
+int lval_run_script(lenv* e, mpc_parser_t* form, const char* filename, FILE* f);
+
 lval* eval_op(lval* x, char* op, lval* y);
 lval* eval(mpc_ast_t* t);
 
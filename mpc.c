@@ -1,4 +1,41 @@
+/*
+** Files are memory mapped where the platform
+** allows it, define MPC_NO_MMAP to always read
+** them through stdio instead.
+*/
+
+#if !defined(MPC_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define MPC_USE_MMAP 1
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#else
+#define MPC_USE_MMAP 0
+#endif
+
 #include "mpc.h"
+#include <time.h>
+
+#if MPC_USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/*
+** Runs of a repeated character class in string
+** and mapped input are scanned 32 or 16 bytes at
+** a time with AVX2 or SSE2 when the compiler
+** targets them, define MPC_NO_SIMD to always scan
+** one byte at a time.
+*/
+
+#if !defined(MPC_NO_SIMD) && defined(__AVX2__)
+#define MPC_USE_AVX2 1
+#include <immintrin.h>
+#elif !defined(MPC_NO_SIMD) && defined(__SSE2__)
+#define MPC_USE_SSE2 1
+#include <emmintrin.h>
+#endif
 
 /*
 ** State Type
@@ -27,8 +64,8 @@ static mpc_state_t mpc_state_new(void) {
 */
 
 /*
-** In mpc the input type has three modes of
-** operation: String, File and Pipe.
+** In mpc the input type has four modes of
+** operation: String, File, Pipe and Mmap.
 **
 ** String is easy. The whole contents are
 ** loaded into a buffer and scanned through.
@@ -51,6 +88,16 @@ static mpc_state_t mpc_state_new(void) {
 ** back we can simply start reading from the
 ** buffer instead of the input.
 **
+** The last is Mmap, which a File becomes when
+** mpc_parse_file is given a regular file on a
+** system with mmap, unless built with
+** MPC_NO_MMAP. The rest of the file from its
+** current position is mapped and read like a
+** String. The file must not be modified or
+** truncated while it is mapped, which is until
+** the parse returns, or the input read will
+** change under the parser or fault.
+**
 ** Of course using `mpc_predictive` will disable
 ** backtracking and make LL(1) grammars easy
 ** to parse for all input methods.
@@ -60,21 +107,74 @@ static mpc_state_t mpc_state_new(void) {
 enum {
   MPC_INPUT_STRING = 0,
   MPC_INPUT_FILE   = 1,
-  MPC_INPUT_PIPE   = 2
+  MPC_INPUT_PIPE   = 2,
+  MPC_INPUT_MMAP   = 3
 };
 
 enum {
   MPC_INPUT_MARKS_MIN = 32
 };
 
-enum {
-  MPC_INPUT_MEM_NUM = 512
-};
+/*
+** Each input has a pool of MPC_INPUT_MEM_NUM
+** small blocks for results and errors, with the
+** free ones marked in a bitmap. Define it on the
+** command line to change the pool size.
+*/
+
+#ifndef MPC_INPUT_MEM_NUM
+#define MPC_INPUT_MEM_NUM 512
+#endif
+
+#define MPC_INPUT_MEM_BITS (sizeof(unsigned long) * 8)
+#define MPC_INPUT_MEM_WORDS ((MPC_INPUT_MEM_NUM + MPC_INPUT_MEM_BITS - 1) / MPC_INPUT_MEM_BITS)
+
+static unsigned long mpc_mem_hits = 0;
+static unsigned long mpc_mem_fallbacks = 0;
 
 typedef struct {
   char mem[64];
 } mpc_mem_t;
 
+/*
+** Packrat Memo
+**
+** Parsing with MPC_PARSE_MEMO records each failure
+** of a composite parser that leaves the input where
+** it started, keyed by the parser and the position.
+** Trying that parser there again gives back a copy
+** of the recorded error without running it. Outputs
+** are passed on to folds and destructors so there is
+** nothing to share, successes are always run. At most
+** MPC_MEMO_MAX failures are kept for one parse, give
+** -DMPC_MEMO_MAX=n on the command line to change it.
+*/
+
+#ifndef MPC_MEMO_MAX
+#define MPC_MEMO_MAX 65536
+#endif
+
+enum {
+  MPC_MEMO_SLOTS_MIN = 64
+};
+
+static unsigned long mpc_memo_hits = 0;
+
+typedef struct {
+  mpc_parser_t *p;
+  long pos;
+  int flags;
+  mpc_err_t *err;
+} mpc_memo_t;
+
+/* Set with MPC_PARSE_ARENA, see the AST section */
+typedef struct mpc_ast_arena_t mpc_ast_arena_t;
+
+static mpc_ast_arena_t *mpc_ast_arena_create(void);
+static void mpc_ast_arena_delete(mpc_ast_arena_t *r);
+static mpc_ast_t *mpc_ast_arena_node(mpc_ast_arena_t *r, const char *tag, const char *contents);
+static int mpc_ast_arena_adopt(mpc_ast_arena_t *r, mpc_ast_t *a);
+
 typedef struct {
 
   int type;
@@ -85,6 +185,19 @@ typedef struct {
   char *buffer;
   FILE *file;
 
+  long buffer_pos;
+  size_t buffer_len;
+  size_t buffer_slots;
+
+  char *map;
+  long map_size;
+  long map_offset;
+
+  long length;
+
+  int lazy;
+  long err_pos;
+
   int suppress;
   int backtrack;
   int marks_slots;
@@ -94,12 +207,29 @@ typedef struct {
   char *lasts;
   char last;
 
+  mpc_memo_t *memo;
+  size_t memo_slots;
+  size_t memo_num;
+
+  mpc_ast_arena_t *ast_arena;
+
   size_t mem_index;
-  char mem_full[MPC_INPUT_MEM_NUM];
+  unsigned long mem_free[MPC_INPUT_MEM_WORDS];
   mpc_mem_t mem[MPC_INPUT_MEM_NUM];
 
 } mpc_input_t;
 
+static void mpc_mem_init(mpc_input_t *i) {
+  size_t j;
+  i->mem_index = 0;
+  for (j = 0; j < MPC_INPUT_MEM_WORDS; j++) {
+    i->mem_free[j] = ~0UL;
+  }
+  if (MPC_INPUT_MEM_NUM % MPC_INPUT_MEM_BITS) {
+    i->mem_free[MPC_INPUT_MEM_WORDS-1] = (1UL << (MPC_INPUT_MEM_NUM % MPC_INPUT_MEM_BITS)) - 1;
+  }
+}
+
 static mpc_input_t *mpc_input_new_string(const char *filename, const char *string) {
 
   mpc_input_t *i = malloc(sizeof(mpc_input_t));
@@ -110,10 +240,17 @@ static mpc_input_t *mpc_input_new_string(const char *filename, const char *strin
 
   i->state = mpc_state_new();
 
-  i->string = malloc(strlen(string) + 1);
+  i->length = strlen(string);
+  i->string = malloc(i->length + 1);
   strcpy(i->string, string);
+  i->lazy = 1;
+  i->err_pos = 0;
   i->buffer = NULL;
+  i->buffer_pos = 0;
+  i->buffer_len = 0;
+  i->buffer_slots = 0;
   i->file = NULL;
+  i->map = NULL;
 
   i->suppress = 0;
   i->backtrack = 1;
@@ -123,8 +260,12 @@ static mpc_input_t *mpc_input_new_string(const char *filename, const char *strin
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
 
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  i->memo = NULL;
+  i->memo_slots = 0;
+  i->memo_num = 0;
+  i->ast_arena = NULL;
+
+  mpc_mem_init(i);
 
   return i;
 }
@@ -142,8 +283,15 @@ static mpc_input_t *mpc_input_new_nstring(const char *filename, const char *stri
   i->string = malloc(length + 1);
   strncpy(i->string, string, length);
   i->string[length] = '\0';
+  i->length = length;
+  i->lazy = 1;
+  i->err_pos = 0;
   i->buffer = NULL;
+  i->buffer_pos = 0;
+  i->buffer_len = 0;
+  i->buffer_slots = 0;
   i->file = NULL;
+  i->map = NULL;
 
   i->suppress = 0;
   i->backtrack = 1;
@@ -153,8 +301,12 @@ static mpc_input_t *mpc_input_new_nstring(const char *filename, const char *stri
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
 
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  i->memo = NULL;
+  i->memo_slots = 0;
+  i->memo_num = 0;
+  i->ast_arena = NULL;
+
+  mpc_mem_init(i);
 
   return i;
 
@@ -171,8 +323,15 @@ static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
   i->state = mpc_state_new();
 
   i->string = NULL;
+  i->length = 0;
+  i->lazy = 0;
+  i->err_pos = 0;
   i->buffer = NULL;
+  i->buffer_pos = 0;
+  i->buffer_len = 0;
+  i->buffer_slots = 0;
   i->file = pipe;
+  i->map = NULL;
 
   i->suppress = 0;
   i->backtrack = 1;
@@ -182,13 +341,50 @@ static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
 
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  i->memo = NULL;
+  i->memo_slots = 0;
+  i->memo_num = 0;
+  i->ast_arena = NULL;
+
+  mpc_mem_init(i);
 
   return i;
 
 }
 
+#if MPC_USE_MMAP
+
+/*
+** Map a regular file into memory so it can be
+** read like a string, peeking and rewinding are
+** then just moves of the position. Anything that
+** can not be mapped stays a stdio file input.
+*/
+
+static void mpc_input_map_file(mpc_input_t *i) {
+
+  struct stat st;
+  long offset = ftell(i->file);
+  void *map;
+
+  if (offset < 0) { return; }
+  if (fstat(fileno(i->file), &st) != 0) { return; }
+  if (!S_ISREG(st.st_mode) || st.st_size <= offset) { return; }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(i->file), 0);
+  if (map == MAP_FAILED) { return; }
+
+  i->type = MPC_INPUT_MMAP;
+  i->map = map;
+  i->map_size = st.st_size;
+  i->map_offset = offset;
+  i->string = i->map + offset;
+  i->length = st.st_size - offset;
+  i->lazy = 1;
+}
+
+#endif
+
 static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
 
   mpc_input_t *i = malloc(sizeof(mpc_input_t));
@@ -199,8 +395,15 @@ static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
   i->state = mpc_state_new();
 
   i->string = NULL;
+  i->length = 0;
+  i->lazy = 0;
+  i->err_pos = 0;
   i->buffer = NULL;
+  i->buffer_pos = 0;
+  i->buffer_len = 0;
+  i->buffer_slots = 0;
   i->file = file;
+  i->map = NULL;
 
   i->suppress = 0;
   i->backtrack = 1;
@@ -210,18 +413,61 @@ static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
 
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  i->memo = NULL;
+  i->memo_slots = 0;
+  i->memo_num = 0;
+  i->ast_arena = NULL;
+
+  mpc_mem_init(i);
+
+#if MPC_USE_MMAP
+  mpc_input_map_file(i);
+#endif
 
   return i;
 }
 
+/*
+** Pipes can not seek, so characters read while a
+** mark is held are kept in a buffer starting at
+** stream position buffer_pos until they can no
+** longer be rewound to. Characters read ahead of
+** the position are served from the buffer too, so
+** they are never pushed back into the stream, which
+** is only sure to take back a single character.
+*/
+
+static void mpc_input_buffer_restore(mpc_input_t *i) {
+  /* Only a single read ahead character can be given back to the stream */
+  if (i->state.pos == i->buffer_pos + (long)i->buffer_len - 1) {
+    ungetc(i->buffer[i->buffer_len - 1], i->file);
+  }
+  free(i->buffer);
+}
+
 static void mpc_input_delete(mpc_input_t *i) {
 
+  size_t j;
+
   free(i->filename);
 
+  for (j = 0; j < i->memo_slots; j++) {
+    if (i->memo[j].err) { mpc_err_delete(i->memo[j].err); }
+  }
+  free(i->memo);
+
+  if (i->ast_arena) { mpc_ast_arena_delete(i->ast_arena); }
+
   if (i->type == MPC_INPUT_STRING) { free(i->string); }
-  if (i->type == MPC_INPUT_PIPE) { free(i->buffer); }
+  if (i->type == MPC_INPUT_PIPE) { mpc_input_buffer_restore(i); }
+
+#if MPC_USE_MMAP
+  if (i->type == MPC_INPUT_MMAP) {
+    /* Leave the stream after the input consumed, as reading it would */
+    fseek(i->file, i->map_offset + i->state.pos, SEEK_SET);
+    munmap(i->map, i->map_size);
+  }
+#endif
 
   free(i->marks);
   free(i->lasts);
@@ -234,23 +480,35 @@ static int mpc_mem_ptr(mpc_input_t *i, void *p) {
     (char*)p <  (char*)(i->mem) + (MPC_INPUT_MEM_NUM * sizeof(mpc_mem_t));
 }
 
+static int mpc_mem_ctz(unsigned long x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzl(x);
+#else
+  int n = 0;
+  while (!(x & 1)) { x >>= 1; n++; }
+  return n;
+#endif
+}
+
 static void *mpc_malloc(mpc_input_t *i, size_t n) {
-  size_t j;
-  char *p;
+  size_t j, w;
+  int b;
 
   if (n > sizeof(mpc_mem_t)) { return malloc(n); }
 
-  j = i->mem_index;
-  do {
-    if (!i->mem_full[i->mem_index]) {
-      p = (void*)(i->mem + i->mem_index);
-      i->mem_full[i->mem_index] = 1;
-      i->mem_index = (i->mem_index+1) % MPC_INPUT_MEM_NUM;
-      return p;
+  /* Start at the word that last had a free block */
+  for (j = 0; j < MPC_INPUT_MEM_WORDS; j++) {
+    w = (i->mem_index + j) % MPC_INPUT_MEM_WORDS;
+    if (i->mem_free[w]) {
+      b = mpc_mem_ctz(i->mem_free[w]);
+      i->mem_free[w] &= i->mem_free[w] - 1;
+      i->mem_index = w;
+      mpc_mem_hits++;
+      return (void*)(i->mem + w * MPC_INPUT_MEM_BITS + b);
     }
-    i->mem_index = (i->mem_index+1) % MPC_INPUT_MEM_NUM;
-  } while (j != i->mem_index);
+  }
 
+  mpc_mem_fallbacks++;
   return malloc(n);
 }
 
@@ -264,7 +522,7 @@ static void mpc_free(mpc_input_t *i, void *p) {
   size_t j;
   if (!mpc_mem_ptr(i, p)) { free(p); return; }
   j = ((size_t)(((char*)p) - ((char*)i->mem))) / sizeof(mpc_mem_t);
-  i->mem_full[j] = 0;
+  i->mem_free[j / MPC_INPUT_MEM_BITS] |= 1UL << (j % MPC_INPUT_MEM_BITS);
 }
 
 static void *mpc_realloc(mpc_input_t *i, void *p, size_t n) {
@@ -298,6 +556,30 @@ static void mpc_input_backtrack_enable(mpc_input_t *i) { i->backtrack++; }
 static void mpc_input_suppress_disable(mpc_input_t *i) { i->suppress--; }
 static void mpc_input_suppress_enable(mpc_input_t *i) { i->suppress++; }
 
+static void mpc_input_buffer_trim(mpc_input_t *i) {
+
+  size_t used = (size_t)(i->state.pos - i->buffer_pos);
+
+  /* Drop characters before the position once they are at least half */
+  if (used >= i->buffer_len) {
+    i->buffer_pos = i->state.pos;
+    i->buffer_len = 0;
+  } else if (used >= i->buffer_len - used) {
+    memmove(i->buffer, i->buffer + used, i->buffer_len - used);
+    i->buffer_pos = i->state.pos;
+    i->buffer_len -= used;
+  }
+
+}
+
+static void mpc_input_buffer_push(mpc_input_t *i, char c) {
+  if (i->buffer_len == i->buffer_slots) {
+    i->buffer_slots = i->buffer_slots ? i->buffer_slots * 2 : 64;
+    i->buffer = realloc(i->buffer, i->buffer_slots);
+  }
+  i->buffer[i->buffer_len++] = c;
+}
+
 static void mpc_input_mark(mpc_input_t *i) {
 
   if (i->backtrack < 1) { return; }
@@ -314,13 +596,12 @@ static void mpc_input_mark(mpc_input_t *i) {
   i->lasts[i->marks_num-1] = i->last;
 
   if (i->type == MPC_INPUT_PIPE && i->marks_num == 1) {
-    i->buffer = calloc(1, 1);
+    mpc_input_buffer_trim(i);
   }
 
 }
 
 static void mpc_input_unmark(mpc_input_t *i) {
-  int j;
 
   if (i->backtrack < 1) { return; }
 
@@ -336,11 +617,7 @@ static void mpc_input_unmark(mpc_input_t *i) {
   }
 
   if (i->type == MPC_INPUT_PIPE && i->marks_num == 0) {
-    for (j = strlen(i->buffer) - 1; j >= 0; j--)
-      ungetc(i->buffer[j], i->file);
-
-    free(i->buffer);
-    i->buffer = NULL;
+    mpc_input_buffer_trim(i);
   }
 
 }
@@ -360,11 +637,17 @@ static void mpc_input_rewind(mpc_input_t *i) {
 }
 
 static int mpc_input_buffer_in_range(mpc_input_t *i) {
-  return i->state.pos < (long)(strlen(i->buffer) + i->marks[0].pos);
+  return i->state.pos < i->buffer_pos + (long)i->buffer_len;
 }
 
 static char mpc_input_buffer_get(mpc_input_t *i) {
-  return i->buffer[i->state.pos - i->marks[0].pos];
+  return i->buffer[i->state.pos - i->buffer_pos];
+}
+
+static char mpc_input_map_get(mpc_input_t *i) {
+  /* The mapping is not terminated, so the end reads as the terminator */
+  return i->map_offset + i->state.pos < i->map_size
+    ? i->string[i->state.pos] : '\0';
 }
 
 static char mpc_input_getc(mpc_input_t *i) {
@@ -374,12 +657,11 @@ static char mpc_input_getc(mpc_input_t *i) {
   switch (i->type) {
 
     case MPC_INPUT_STRING: return i->string[i->state.pos];
+    case MPC_INPUT_MMAP: return mpc_input_map_get(i);
     case MPC_INPUT_FILE: c = fgetc(i->file); return c;
     case MPC_INPUT_PIPE:
 
-      if (!i->buffer) { c = getc(i->file); return c; }
-
-      if (i->buffer && mpc_input_buffer_in_range(i)) {
+      if (mpc_input_buffer_in_range(i)) {
         c = mpc_input_buffer_get(i);
         return c;
       } else {
@@ -397,6 +679,7 @@ static char mpc_input_peekc(mpc_input_t *i) {
 
   switch (i->type) {
     case MPC_INPUT_STRING: return i->string[i->state.pos];
+    case MPC_INPUT_MMAP: return mpc_input_map_get(i);
     case MPC_INPUT_FILE:
 
       c = fgetc(i->file);
@@ -407,14 +690,7 @@ static char mpc_input_peekc(mpc_input_t *i) {
 
     case MPC_INPUT_PIPE:
 
-      if (!i->buffer) {
-        c = getc(i->file);
-        if (feof(i->file)) { return '\0'; }
-        ungetc(c, i->file);
-        return c;
-      }
-
-      if (i->buffer && mpc_input_buffer_in_range(i)) {
+      if (mpc_input_buffer_in_range(i)) {
         return mpc_input_buffer_get(i);
       } else {
         c = getc(i->file);
@@ -439,9 +715,7 @@ static int mpc_input_failure(mpc_input_t *i, char c) {
     case MPC_INPUT_FILE: fseek(i->file, -1, SEEK_CUR); { break; }
     case MPC_INPUT_PIPE: {
 
-      if (!i->buffer) { ungetc(c, i->file); break; }
-
-      if (i->buffer && mpc_input_buffer_in_range(i)) {
+      if (mpc_input_buffer_in_range(i)) {
         break;
       } else {
         ungetc(c, i->file);
@@ -455,16 +729,18 @@ static int mpc_input_failure(mpc_input_t *i, char c) {
 static int mpc_input_success(mpc_input_t *i, char c, char **o) {
 
   if (i->type == MPC_INPUT_PIPE
-  &&  i->buffer && !mpc_input_buffer_in_range(i)) {
-    i->buffer = realloc(i->buffer, strlen(i->buffer) + 2);
-    i->buffer[strlen(i->buffer) + 1] = '\0';
-    i->buffer[strlen(i->buffer) + 0] = c;
+  &&  i->marks_num > 0 && !mpc_input_buffer_in_range(i)) {
+    mpc_input_buffer_push(i, c);
   }
 
   i->last = c;
   i->state.pos++;
   i->state.col++;
 
+  if (i->type == MPC_INPUT_PIPE && i->marks_num == 0) {
+    mpc_input_buffer_trim(i);
+  }
+
   if (c == '\n') {
     i->state.col = 0;
     i->state.row++;
@@ -479,6 +755,30 @@ static int mpc_input_success(mpc_input_t *i, char c, char **o) {
   return 1;
 }
 
+/* Move over n characters of string or mapped input */
+static void mpc_input_advance(mpc_input_t *i, size_t n, int newlines) {
+
+  const char *s = i->string + i->state.pos;
+  size_t j;
+
+  if (n == 0) { return; }
+
+  if (newlines) {
+    for (j = 0; j < n; j++) {
+      i->state.col++;
+      if (s[j] == '\n') {
+        i->state.col = 0;
+        i->state.row++;
+      }
+    }
+  } else {
+    i->state.col += n;
+  }
+
+  i->state.pos += n;
+  i->last = s[n-1];
+}
+
 static int mpc_input_any(mpc_input_t *i, char **o) {
   char x;
   if (mpc_input_terminated(i)) { return 0; }
@@ -662,25 +962,44 @@ char *mpc_err_string(mpc_err_t *x) {
   return realloc(buffer, strlen(buffer) + 1);
 }
 
-static mpc_err_t *mpc_err_new(mpc_input_t *i, const char *expected) {
+/*
+** Only the errors at the furthest position a parse
+** fails at are ever reported, so an error short of
+** the furthest noted so far is not built. Lazy input
+** only notes positions and builds no errors at all,
+** it is parsed again if it fails to build the ones
+** at or past the furthest.
+*/
+
+static int mpc_err_skip(mpc_input_t *i, long pos) {
+  if (pos < i->err_pos) { return 1; }
+  i->err_pos = pos;
+  return i->lazy;
+}
+
+static mpc_err_t *mpc_err_new_at(mpc_input_t *i, mpc_state_t *s, char received, const char *expected) {
   mpc_err_t *x;
-  if (i->suppress) { return NULL; }
+  if (i->suppress || mpc_err_skip(i, s->pos)) { return NULL; }
   x = mpc_malloc(i, sizeof(mpc_err_t));
   x->filename = mpc_malloc(i, strlen(i->filename) + 1);
   strcpy(x->filename, i->filename);
-  x->state = i->state;
+  x->state = *s;
   x->expected_num = 1;
   x->expected = mpc_malloc(i, sizeof(char*));
   x->expected[0] = mpc_malloc(i, strlen(expected) + 1);
   strcpy(x->expected[0], expected);
   x->failure = NULL;
-  x->received = mpc_input_peekc(i);
+  x->received = received;
   return x;
 }
 
-static mpc_err_t *mpc_err_fail(mpc_input_t *i, const char *failure) {
+static mpc_err_t *mpc_err_new(mpc_input_t *i, const char *expected) {
+  if (i->suppress || mpc_err_skip(i, i->state.pos)) { return NULL; }
+  return mpc_err_new_at(i, &i->state, mpc_input_peekc(i), expected);
+}
+
+static mpc_err_t *mpc_err_failure(mpc_input_t *i, const char *failure) {
   mpc_err_t *x;
-  if (i->suppress) { return NULL; }
   x = mpc_malloc(i, sizeof(mpc_err_t));
   x->filename = mpc_malloc(i, strlen(i->filename) + 1);
   strcpy(x->filename, i->filename);
@@ -693,6 +1012,17 @@ static mpc_err_t *mpc_err_fail(mpc_input_t *i, const char *failure) {
   return x;
 }
 
+static mpc_err_t *mpc_err_fail(mpc_input_t *i, const char *failure) {
+  if (i->suppress || mpc_err_skip(i, i->state.pos)) { return NULL; }
+  return mpc_err_failure(i, failure);
+}
+
+static mpc_err_t *mpc_err_unknown(mpc_input_t *i) {
+  mpc_err_t *x = mpc_err_failure(i, "Unknown Error");
+  x->state = mpc_state_invalid();
+  return x;
+}
+
 static mpc_err_t *mpc_err_file(const char *filename, const char *failure) {
   mpc_err_t *x;
   x = malloc(sizeof(mpc_err_t));
@@ -861,6 +1191,7 @@ static mpc_err_t *mpc_err_count(mpc_input_t *i, mpc_err_t *x, int n) {
   mpc_err_t *y;
   int digits = n/10 + 1;
   char *prefix;
+  if (x == NULL) { return NULL; }
   prefix = mpc_malloc(i, digits + strlen(" of ") + 1);
   if (!prefix) {
     return NULL;
@@ -878,6 +1209,33 @@ static mpc_err_t *mpc_err_merge(mpc_input_t *i, mpc_err_t *x, mpc_err_t *y) {
   return mpc_err_or(i, errs, 2);
 }
 
+static void *mpc_err_alloc(mpc_input_t *i, size_t n) {
+  return i ? mpc_malloc(i, n) : malloc(n);
+}
+
+/* Copy into the input's memory, or with malloc when i is NULL */
+static mpc_err_t *mpc_err_copy(mpc_input_t *i, mpc_err_t *x) {
+  int j;
+  mpc_err_t *y = mpc_err_alloc(i, sizeof(mpc_err_t));
+  *y = *x;
+  y->filename = mpc_err_alloc(i, strlen(x->filename) + 1);
+  strcpy(y->filename, x->filename);
+  y->expected = NULL;
+  if (x->expected_num) {
+    y->expected = mpc_err_alloc(i, sizeof(char*) * x->expected_num);
+  }
+  for (j = 0; j < x->expected_num; j++) {
+    y->expected[j] = mpc_err_alloc(i, strlen(x->expected[j]) + 1);
+    strcpy(y->expected[j], x->expected[j]);
+  }
+  y->failure = NULL;
+  if (x->failure) {
+    y->failure = mpc_err_alloc(i, strlen(x->failure) + 1);
+    strcpy(y->failure, x->failure);
+  }
+  return y;
+}
+
 /*
 ** Parser Type
 */
@@ -918,9 +1276,47 @@ enum {
   MPC_TYPE_SOI        = 27,
   MPC_TYPE_EOI        = 28,
 
-  MPC_TYPE_SEPBY1     = 29
+  MPC_TYPE_SEPBY1     = 29,
+
+  MPC_TYPE_DFA        = 30
+};
+
+/*
+** A regular expression that is a sequence of
+** character classes, each matched once, maybe,
+** any number of times or at least once, is also
+** compiled to a table of transitions. State 2a+k
+** is at item a having taken k characters of it,
+** so each byte is a single lookup that gives the
+** next state or ends the match. The combinators
+** the expression was built from are kept and run
+** when the table fails, for their error.
+*/
+
+enum {
+  MPC_DFA_ITEMS_MAX = 32,
+  MPC_DFA_RANGES_MAX = 16,
+  MPC_DFA_ACCEPT = -1,
+  MPC_DFA_FAIL = -2
 };
 
+/* An item's class in the forms the vector scans test it */
+typedef struct {
+  int ranges;
+  unsigned char lo[MPC_DFA_RANGES_MAX];
+  unsigned char span[MPC_DFA_RANGES_MAX];
+  unsigned char nibbles[32];
+  int newline;
+} mpc_dfa_class_t;
+
+typedef struct {
+  int n;
+  char kind[MPC_DFA_ITEMS_MAX];
+  char *expect[MPC_DFA_ITEMS_MAX];
+  mpc_dfa_class_t *classes;
+  short *next;
+} mpc_dfa_t;
+
 typedef struct { char *m; } mpc_pdata_fail_t;
 typedef struct { mpc_ctor_t lf; void *x; } mpc_pdata_lift_t;
 typedef struct { mpc_parser_t *x; char *m; } mpc_pdata_expect_t;
@@ -936,9 +1332,10 @@ typedef struct { mpc_parser_t *x; mpc_dtor_t dx; mpc_check_with_t f; void *d; ch
 typedef struct { mpc_parser_t *x; } mpc_pdata_predict_t;
 typedef struct { mpc_parser_t *x; mpc_dtor_t dx; mpc_ctor_t lf; } mpc_pdata_not_t;
 typedef struct { int n; mpc_fold_t f; mpc_parser_t *x; mpc_dtor_t dx; } mpc_pdata_repeat_t;
-typedef struct { int n; mpc_parser_t **xs; } mpc_pdata_or_t;
+typedef struct { int n; mpc_parser_t **xs; unsigned char *first; unsigned char *jump; } mpc_pdata_or_t;
 typedef struct { int n; mpc_fold_t f; mpc_parser_t **xs; mpc_dtor_t *dxs;  } mpc_pdata_and_t;
 typedef struct { int n; mpc_fold_t f; mpc_parser_t *x; mpc_parser_t *sep; } mpc_pdata_sepby1;
+typedef struct { mpc_parser_t *x; mpc_dfa_t *d; } mpc_pdata_dfa_t;
 
 typedef union {
   mpc_pdata_fail_t fail;
@@ -959,6 +1356,7 @@ typedef union {
   mpc_pdata_and_t and;
   mpc_pdata_or_t or;
   mpc_pdata_sepby1 sepby1;
+  mpc_pdata_dfa_t dfa;
 } mpc_pdata_t;
 
 struct mpc_parser_t {
@@ -966,6 +1364,7 @@ struct mpc_parser_t {
   mpc_pdata_t data;
   char type;
   char retained;
+  int id;
 };
 
 static mpc_val_t *mpcf_input_nth_free(mpc_input_t *i, int n, mpc_val_t **xs, int x) {
@@ -1018,7 +1417,7 @@ static mpc_val_t *mpcf_input_free(mpc_input_t *i, mpc_val_t *x) {
 }
 
 static mpc_val_t *mpcf_input_str_ast(mpc_input_t *i, mpc_val_t *c) {
-  mpc_ast_t *a = mpc_ast_new("", c);
+  mpc_ast_t *a = i->ast_arena ? mpc_ast_arena_node(i->ast_arena, "", c) : mpc_ast_new("", c);
   mpc_free(i, c);
   return a;
 }
@@ -1038,3091 +1437,5055 @@ static void mpc_parse_dtor(mpc_input_t *i, mpc_dtor_t d, mpc_val_t *x) {
   d(mpc_export(i, x));
 }
 
-enum {
-  MPC_PARSE_STACK_MIN = 4
-};
+/*
+** Packrat Memo
+*/
 
-#define MPC_SUCCESS(x) r->output = x; return 1
-#define MPC_FAILURE(x) r->error = x; return 0
-#define MPC_PRIMITIVE(x) \
-  if (x) { MPC_SUCCESS(r->output); } \
-  else { MPC_FAILURE(NULL); }
+/* Input state other than the position that a result can depend on */
+static int mpc_memo_flags(mpc_input_t *i) {
+  return (i->state.term != 0) | (i->suppress != 0) << 1 | (i->backtrack != 0) << 2;
+}
 
-#define MPC_MAX_RECURSION_DEPTH 1000
+static size_t mpc_memo_hash(mpc_parser_t *p, long pos) {
+  return ((size_t)p >> 4) ^ ((size_t)pos * 2654435761UL);
+}
 
-static mpc_result_t *mpc_grow_results(mpc_input_t *i, int j, mpc_result_t *results_stk, mpc_result_t *results){
-  mpc_result_t *tmp_results = results;
+static int mpc_memo_find(mpc_input_t *i, mpc_parser_t *p, mpc_err_t **err) {
 
-  if (j == MPC_PARSE_STACK_MIN) {
-    int results_slots = j + j / 2;
-    tmp_results = mpc_malloc(i, sizeof(mpc_result_t) * results_slots);
-    memcpy(tmp_results, results_stk, sizeof(mpc_result_t) * MPC_PARSE_STACK_MIN);
-  } else if (j >= MPC_PARSE_STACK_MIN) {
-    int results_slots = j + j / 2;
-    tmp_results = mpc_realloc(i, tmp_results, sizeof(mpc_result_t) * results_slots);
-  }
+  size_t j, mask = i->memo_slots - 1;
+  int flags = mpc_memo_flags(i);
 
-  return tmp_results;
-}
+  if (i->memo_num == 0) { return 0; }
 
-static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_err_t **e, int depth) {
+  for (j = mpc_memo_hash(p, i->state.pos) & mask; i->memo[j].p; j = (j + 1) & mask) {
+    if (i->memo[j].p == p && i->memo[j].pos == i->state.pos && i->memo[j].flags == flags) {
+      *err = i->memo[j].err ? mpc_err_copy(i, i->memo[j].err) : NULL;
+      mpc_memo_hits++;
+      return 1;
+    }
+  }
 
-  int j = 0, k = 0;
-  mpc_result_t results_stk[MPC_PARSE_STACK_MIN];
-  mpc_result_t *results;
+  return 0;
+}
 
-  if (depth == MPC_MAX_RECURSION_DEPTH)
-  {
-    MPC_FAILURE(mpc_err_fail(i, "Maximum recursion depth exceeded!"));
-  }
+static void mpc_memo_insert(mpc_memo_t *memo, size_t slots, mpc_memo_t *m) {
+  size_t j, mask = slots - 1;
+  for (j = mpc_memo_hash(m->p, m->pos) & mask; memo[j].p; j = (j + 1) & mask);
+  memo[j] = *m;
+}
 
-  switch (p->type) {
+static void mpc_memo_add(mpc_input_t *i, mpc_parser_t *p, mpc_err_t *err) {
 
-    /* Basic Parsers */
+  size_t j, slots;
+  mpc_memo_t m, *memo;
 
-    case MPC_TYPE_ANY:     MPC_PRIMITIVE(mpc_input_any(i, (char**)&r->output));
-    case MPC_TYPE_SINGLE:  MPC_PRIMITIVE(mpc_input_char(i, p->data.single.x, (char**)&r->output));
-    case MPC_TYPE_RANGE:   MPC_PRIMITIVE(mpc_input_range(i, p->data.range.x, p->data.range.y, (char**)&r->output));
-    case MPC_TYPE_ONEOF:   MPC_PRIMITIVE(mpc_input_oneof(i, p->data.string.x, (char**)&r->output));
-    case MPC_TYPE_NONEOF:  MPC_PRIMITIVE(mpc_input_noneof(i, p->data.string.x, (char**)&r->output));
-    case MPC_TYPE_SATISFY: MPC_PRIMITIVE(mpc_input_satisfy(i, p->data.satisfy.f, (char**)&r->output));
-    case MPC_TYPE_STRING:  MPC_PRIMITIVE(mpc_input_string(i, p->data.string.x, (char**)&r->output));
-    case MPC_TYPE_ANCHOR:  MPC_PRIMITIVE(mpc_input_anchor(i, p->data.anchor.f, (char**)&r->output));
-    case MPC_TYPE_SOI:     MPC_PRIMITIVE(mpc_input_soi(i, (char**)&r->output));
-    case MPC_TYPE_EOI:     MPC_PRIMITIVE(mpc_input_eoi(i, (char**)&r->output));
+  if (i->memo_num == MPC_MEMO_MAX) { return; }
 
-    /* Other parsers */
+  if ((i->memo_num + 1) * 2 > i->memo_slots) {
+    slots = i->memo_slots * 2;
+    memo = calloc(slots, sizeof(mpc_memo_t));
+    for (j = 0; j < i->memo_slots; j++) {
+      if (i->memo[j].p) { mpc_memo_insert(memo, slots, &i->memo[j]); }
+    }
+    free(i->memo);
+    i->memo = memo;
+    i->memo_slots = slots;
+  }
 
-    case MPC_TYPE_UNDEFINED: MPC_FAILURE(mpc_err_fail(i, "Parser Undefined!"));
-    case MPC_TYPE_PASS:      MPC_SUCCESS(NULL);
-    case MPC_TYPE_FAIL:      MPC_FAILURE(mpc_err_fail(i, p->data.fail.m));
-    case MPC_TYPE_LIFT:      MPC_SUCCESS(p->data.lift.lf());
-    case MPC_TYPE_LIFT_VAL:  MPC_SUCCESS(p->data.lift.x);
-    case MPC_TYPE_STATE:     MPC_SUCCESS(mpc_input_state_copy(i));
+  m.p = p;
+  m.pos = i->state.pos;
+  m.flags = mpc_memo_flags(i);
+  m.err = err ? mpc_err_copy(NULL, err) : NULL;
+  mpc_memo_insert(i->memo, i->memo_slots, &m);
+  i->memo_num++;
+}
 
-    /* Application Parsers */
+static void mpc_memo_clear(mpc_input_t *i) {
+  size_t j;
+  for (j = 0; j < i->memo_slots; j++) {
+    if (i->memo[j].err) { mpc_err_delete(i->memo[j].err); }
+    i->memo[j].p = NULL;
+    i->memo[j].err = NULL;
+  }
+  i->memo_num = 0;
+}
 
+static int mpc_memo_type(mpc_parser_t *p) {
+  switch (p->type) {
     case MPC_TYPE_APPLY:
-      if (mpc_parse_run(i, p->data.apply.x, r, e, depth+1)) {
-        MPC_SUCCESS(mpc_parse_apply(i, p->data.apply.f, r->output));
-      } else {
-        MPC_FAILURE(r->output);
-      }
-
     case MPC_TYPE_APPLY_TO:
-      if (mpc_parse_run(i, p->data.apply_to.x, r, e, depth+1)) {
-        MPC_SUCCESS(mpc_parse_apply_to(i, p->data.apply_to.f, r->output, p->data.apply_to.d));
-      } else {
-        MPC_FAILURE(r->error);
-      }
-
-    case MPC_TYPE_CHECK:
-      if (mpc_parse_run(i, p->data.check.x, r, e, depth+1)) {
-        if (p->data.check.f(&r->output)) {
-          MPC_SUCCESS(r->output);
-        } else {
-          mpc_parse_dtor(i, p->data.check.dx, r->output);
-          MPC_FAILURE(mpc_err_fail(i, p->data.check.e));
-        }
-      } else {
-        MPC_FAILURE(r->error);
-      }
-
-    case MPC_TYPE_CHECK_WITH:
-      if (mpc_parse_run(i, p->data.check_with.x, r, e, depth+1)) {
-        if (p->data.check_with.f(&r->output, p->data.check_with.d)) {
-          MPC_SUCCESS(r->output);
-        } else {
-          mpc_parse_dtor(i, p->data.check.dx, r->output);
-          MPC_FAILURE(mpc_err_fail(i, p->data.check_with.e));
-        }
-      } else {
-        MPC_FAILURE(r->error);
-      }
-
     case MPC_TYPE_EXPECT:
-      mpc_input_suppress_enable(i);
-      if (mpc_parse_run(i, p->data.expect.x, r, e, depth+1)) {
-        mpc_input_suppress_disable(i);
-        MPC_SUCCESS(r->output);
-      } else {
-        mpc_input_suppress_disable(i);
-        MPC_FAILURE(mpc_err_new(i, p->data.expect.m));
-      }
-
     case MPC_TYPE_PREDICT:
-      mpc_input_backtrack_disable(i);
-      if (mpc_parse_run(i, p->data.predict.x, r, e, depth+1)) {
-        mpc_input_backtrack_enable(i);
-        MPC_SUCCESS(r->output);
-      } else {
-        mpc_input_backtrack_enable(i);
-        MPC_FAILURE(r->error);
-      }
+    case MPC_TYPE_NOT:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_SEPBY1:
+    case MPC_TYPE_COUNT:
+    case MPC_TYPE_OR:
+    case MPC_TYPE_AND:
+    case MPC_TYPE_CHECK:
+    case MPC_TYPE_CHECK_WITH:
+    case MPC_TYPE_DFA:
+      return 1;
+    default:
+      return 0;
+  }
+}
 
-    /* Optional Parsers */
+/*
+** Regular Expression Tables
+*/
 
-    /* TODO: Update Not Error Message */
+/* Bytes a character parser takes, and the message it fails with */
+static int mpc_dfa_class(mpc_parser_t *p, char *set, char **expect) {
 
-    case MPC_TYPE_NOT:
-      mpc_input_mark(i);
-      mpc_input_suppress_enable(i);
-      if (mpc_parse_run(i, p->data.not.x, r, e, depth+1)) {
-        mpc_input_rewind(i);
-        mpc_input_suppress_disable(i);
-        mpc_parse_dtor(i, p->data.not.dx, r->output);
-        MPC_FAILURE(mpc_err_new(i, "opposite"));
-      } else {
-        mpc_input_unmark(i);
-        mpc_input_suppress_disable(i);
-        MPC_SUCCESS(p->data.not.lf());
-      }
+  int c;
 
-    case MPC_TYPE_MAYBE:
-      if (mpc_parse_run(i, p->data.not.x, r, e, depth+1)) {
-        MPC_SUCCESS(r->output);
-      } else {
-        *e = mpc_err_merge(i, *e, r->error);
-        MPC_SUCCESS(p->data.not.lf());
-      }
+  switch (p->type) {
+    case MPC_TYPE_EXPECT:
+      if (!mpc_dfa_class(p->data.expect.x, set, expect)) { return 0; }
+      *expect = p->data.expect.m;
+      return 1;
+    case MPC_TYPE_ANY:
+    case MPC_TYPE_SINGLE:
+    case MPC_TYPE_RANGE:
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+    case MPC_TYPE_SATISFY:
+      break;
+    default:
+      return 0;
+  }
 
-    /* Repeat Parsers */
+  /* The terminator is never taken */
+  set[0] = 0;
+  for (c = 1; c < 256; c++) {
+    char x = (char)c;
+    switch (p->type) {
+      case MPC_TYPE_ANY:     set[c] = 1; break;
+      case MPC_TYPE_SINGLE:  set[c] = x == p->data.single.x; break;
+      case MPC_TYPE_RANGE:   set[c] = x >= p->data.range.x && x <= p->data.range.y; break;
+      case MPC_TYPE_ONEOF:   set[c] = strchr(p->data.string.x, x) != NULL; break;
+      case MPC_TYPE_NONEOF:  set[c] = strchr(p->data.string.x, x) == NULL; break;
+      case MPC_TYPE_SATISFY: set[c] = p->data.satisfy.f(x) != 0; break;
+    }
+  }
 
-    case MPC_TYPE_MANY:
+  *expect = NULL;
+  return 1;
+}
 
-      results = results_stk;
+/* Flatten p into items, returns 0 if it is not a plain sequence */
+static int mpc_dfa_items(mpc_parser_t *p, mpc_dfa_t *d, char *sets) {
 
-      while (mpc_parse_run(i, p->data.repeat.x, &results[j], e, depth+1)) {
-        j++;
-        results = mpc_grow_results(i, j, results_stk, results);
-      }
+  int j;
+  char kind = '1';
+  mpc_parser_t *x = p;
 
-      *e = mpc_err_merge(i, *e, results[j].error);
+  if (p->type == MPC_TYPE_AND) {
+    if (p->data.and.f != mpcf_strfold) { return 0; }
+    for (j = 0; j < p->data.and.n; j++) {
+      if (!mpc_dfa_items(p->data.and.xs[j], d, sets)) { return 0; }
+    }
+    return 1;
+  }
 
-      MPC_SUCCESS(
-        mpc_parse_fold(i, p->data.repeat.f, j, (mpc_val_t**)results);
-        if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
+  if (p->type == MPC_TYPE_LIFT) { return p->data.lift.lf == mpcf_ctor_str; }
 
-    case MPC_TYPE_MANY1:
+  if (p->type == MPC_TYPE_COUNT) {
+    if (p->data.repeat.f != mpcf_strfold || p->data.repeat.n < 1) { return 0; }
+    for (j = 0; j < p->data.repeat.n; j++) {
+      if (!mpc_dfa_items(p->data.repeat.x, d, sets)) { return 0; }
+    }
+    return 1;
+  }
 
-      results = results_stk;
+  if (p->type == MPC_TYPE_MANY || p->type == MPC_TYPE_MANY1) {
+    if (p->data.repeat.f != mpcf_strfold) { return 0; }
+    kind = p->type == MPC_TYPE_MANY ? '*' : '+';
+    x = p->data.repeat.x;
+  }
 
-      while (mpc_parse_run(i, p->data.repeat.x, &results[j], e, depth+1)) {
-        j++;
-        results = mpc_grow_results(i, j, results_stk, results);
-      }
+  if (p->type == MPC_TYPE_MAYBE) {
+    if (p->data.not.lf != mpcf_ctor_str) { return 0; }
+    kind = '?';
+    x = p->data.not.x;
+  }
 
-      if (j == 0) {
-        MPC_FAILURE(
-          mpc_err_many1(i, results[j].error);
-          if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-      } else {
+  if (d->n == MPC_DFA_ITEMS_MAX) { return 0; }
+  if (!mpc_dfa_class(x, sets + d->n * 256, &d->expect[d->n])) { return 0; }
+  d->kind[d->n++] = kind;
+  return 1;
+}
 
-        *e = mpc_err_merge(i, *e, results[j].error);
+static void mpc_dfa_delete(mpc_dfa_t *d) {
+  int j;
+  for (j = 0; j < d->n; j++) { free(d->expect[j]); }
+  free(d->classes);
+  free(d->next);
+  free(d);
+}
 
-        MPC_SUCCESS(
-          mpc_parse_fold(i, p->data.repeat.f, j, (mpc_val_t**)results);
-          if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-      }
+static void mpc_dfa_class_compile(mpc_dfa_class_t *k, const char *set) {
 
-   case MPC_TYPE_SEPBY1:
+  int c, e;
 
-      results = results_stk;
+  k->ranges = 0;
+  for (c = 1; c < 256; c = e) {
+    for (e = c; e < 256 && set[e]; e++);
+    if (e == c) { e++; continue; }
+    if (k->ranges == MPC_DFA_RANGES_MAX) { k->ranges = 0; break; }
+    k->lo[k->ranges] = (unsigned char)c;
+    k->span[k->ranges] = (unsigned char)(e - 1 - c);
+    k->ranges++;
+  }
 
-      if(mpc_parse_run(i, p->data.sepby1.x, &results[j], e, depth+1)){
-        j++;
-        results = mpc_grow_results(i, j, results_stk, results);
+  /* Row by low nibble, bit by high nibble, high half of bytes in 16..31 */
+  memset(k->nibbles, 0, sizeof(k->nibbles));
+  for (c = 0; c < 256; c++) {
+    if (set[c]) { k->nibbles[(c & 15) + (c >> 7) * 16] |= 1 << ((c >> 4) & 7); }
+  }
 
-        while (
-          mpc_parse_run(i, p->data.sepby1.sep, &results[j], e, depth+1) &&
-          mpc_parse_run(i, p->data.sepby1.x, &results[j], e, depth+1)
-        ) {
-          j++;
-          results = mpc_grow_results(i, j, results_stk, results);
-        }
-      }
+  k->newline = set['\n'];
+}
 
-      if (j == 0) {
-        MPC_FAILURE(
-          mpc_err_many1(i, results[j].error);
-          if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-      } else {
-        *e = mpc_err_merge(i, *e, results[j].error);
+/*
+** Tables are sized in size_t from a count of items that
+** is checked first, as the count of a loaded image can be
+** anything. No table is made for a count out of range.
+*/
 
-        MPC_SUCCESS(
-          mpc_parse_fold(i, p->data.repeat.f, j, (mpc_val_t**)results);
-          if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-      }
+static int mpc_dfa_alloc(mpc_dfa_t *d) {
+  size_t n;
+  if (d->n <= 0 || d->n > MPC_DFA_ITEMS_MAX) { return 0; }
+  n = (size_t)d->n;
+  d->next = malloc(sizeof(short) * 2 * 256 * n);
+  d->classes = malloc(sizeof(mpc_dfa_class_t) * n);
+  return 1;
+}
 
-    case MPC_TYPE_COUNT:
+static mpc_dfa_t *mpc_dfa_compile(mpc_parser_t *p) {
 
-      results = p->data.repeat.n > MPC_PARSE_STACK_MIN
-        ? mpc_malloc(i, sizeof(mpc_result_t) * p->data.repeat.n)
-        : results_stk;
+  int a, b, k, c, j;
+  short t;
+  char *sets = malloc(MPC_DFA_ITEMS_MAX * 256);
+  mpc_dfa_t *d = malloc(sizeof(mpc_dfa_t));
+  d->n = 0;
 
-      while (mpc_parse_run(i, p->data.repeat.x, &results[j], e, depth+1)) {
-        j++;
-        if (j == p->data.repeat.n) { break; }
-      }
+  if (!mpc_dfa_items(p, d, sets) || d->n == 0) {
+    free(sets);
+    free(d);
+    return NULL;
+  }
 
-      if (j == p->data.repeat.n) {
-        MPC_SUCCESS(
-          mpc_parse_fold(i, p->data.repeat.f, j, (mpc_val_t**)results);
-          if (p->data.repeat.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-      } else {
-        for (k = 0; k < j; k++) {
-          mpc_parse_dtor(i, p->data.repeat.dx, results[k].output);
+  for (j = 0; j < d->n; j++) {
+    if (d->expect[j]) {
+      d->expect[j] = strcpy(malloc(strlen(d->expect[j]) + 1), d->expect[j]);
+    }
+  }
+
+  /*
+  ** Repeats are greedy and never give back what
+  ** they took, so from each state a byte either
+  ** extends the current item, skips over items
+  ** that are already satisfied, or fails.
+  */
+
+  if (!mpc_dfa_alloc(d)) {
+    for (j = 0; j < d->n; j++) { free(d->expect[j]); }
+    free(sets);
+    free(d);
+    return NULL;
+  }
+
+  for (a = 0; a < d->n; a++) {
+    mpc_dfa_class_compile(&d->classes[a], sets + a * 256);
+    for (k = 0; k < 2; k++) {
+      for (c = 0; c < 256; c++) {
+        b = a;
+        j = k;
+        for (;;) {
+          if (b == d->n) { t = MPC_DFA_ACCEPT; break; }
+          if ((j == 0 || d->kind[b] == '*' || d->kind[b] == '+') && sets[b * 256 + c]) {
+            t = 2 * b + 1;
+            break;
+          }
+          if (j == 0 && (d->kind[b] == '1' || d->kind[b] == '+')) { t = MPC_DFA_FAIL; break; }
+          b++;
+          j = 0;
         }
-        MPC_FAILURE(
-          mpc_err_count(i, results[j].error, p->data.repeat.n);
-          if (p->data.repeat.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
+        d->next[(2 * a + k) * 256 + c] = t;
       }
+    }
+  }
 
-    /* Combinatory Parsers */
-
-    case MPC_TYPE_OR:
+  free(sets);
+  return d;
+}
+
+/* Count the bytes at the start of s that stay in state t */
+static size_t mpc_dfa_span(mpc_dfa_t *d, int t, const char *s, size_t n) {
+
+  size_t j = 0;
+  const short *next = d->next + t * 256;
+  mpc_dfa_class_t *k = &d->classes[t >> 1];
+
+#if MPC_USE_AVX2
+
+  const __m256i lows = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)k->nibbles));
+  const __m256i highs = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(k->nibbles + 16)));
+  const __m256i bits = _mm256_setr_epi8(
+    1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+    1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  __m256i x, lo, hi, row, in;
+  unsigned int out;
+
+  while (j + 32 <= n) {
+    x = _mm256_loadu_si256((const __m256i*)(s + j));
+    lo = _mm256_and_si256(x, nibble);
+    hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble);
+    row = _mm256_blendv_epi8(_mm256_shuffle_epi8(lows, lo), _mm256_shuffle_epi8(highs, lo), x);
+    in = _mm256_and_si256(row, _mm256_shuffle_epi8(bits, hi));
+    out = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(in, _mm256_setzero_si256()));
+    if (out) { return j + mpc_mem_ctz(out); }
+    j += 32;
+  }
 
-      if (p->data.or.n == 0) { MPC_SUCCESS(NULL); }
+#elif MPC_USE_SSE2
 
-      results = p->data.or.n > MPC_PARSE_STACK_MIN
-        ? mpc_malloc(i, sizeof(mpc_result_t) * p->data.or.n)
-        : results_stk;
+  __m128i x, y, in;
+  unsigned int out;
+  int r;
 
-      for (j = 0; j < p->data.or.n; j++) {
-        if (mpc_parse_run(i, p->data.or.xs[j], &results[j], e, depth+1)) {
-          MPC_SUCCESS(results[j].output;
-            if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-        } else {
-          *e = mpc_err_merge(i, *e, results[j].error);
-        }
-      }
+  while (k->ranges && j + 16 <= n) {
+    x = _mm_loadu_si128((const __m128i*)(s + j));
+    in = _mm_setzero_si128();
+    for (r = 0; r < k->ranges; r++) {
+      y = _mm_sub_epi8(x, _mm_set1_epi8((char)k->lo[r]));
+      in = _mm_or_si128(in, _mm_cmpeq_epi8(_mm_min_epu8(y, _mm_set1_epi8((char)k->span[r])), y));
+    }
+    out = ~(unsigned int)_mm_movemask_epi8(in) & 0xFFFF;
+    if (out) { return j + mpc_mem_ctz(out); }
+    j += 16;
+  }
 
-      MPC_FAILURE(NULL;
-        if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
+#else
+  (void)k;
+#endif
 
-    case MPC_TYPE_AND:
-      if (p->data.and.n == 0) { MPC_SUCCESS(NULL); }
+  while (j < n && next[(unsigned char)s[j]] == t) { j++; }
+  return j;
+}
 
-      results = p->data.or.n > MPC_PARSE_STACK_MIN
-        ? mpc_malloc(i, sizeof(mpc_result_t) * p->data.or.n)
-        : results_stk;
+/*
+** Run a compiled regular expression. On success
+** the errors its repeats would have merged where
+** they stopped are merged too, on failure nothing
+** is consumed and the caller runs the combinators.
+*/
 
-      mpc_input_mark(i);
-      for (j = 0; j < p->data.and.n; j++) {
-        if (!mpc_parse_run(i, p->data.and.xs[j], &results[j], e, depth+1)) {
-          mpc_input_rewind(i);
-          for (k = 0; k < j; k++) {
-            mpc_parse_dtor(i, p->data.and.dxs[k], results[k].output);
-          }
-          MPC_FAILURE(results[j].error;
-            if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-        }
-      }
-      mpc_input_unmark(i);
-      MPC_SUCCESS(
-        mpc_parse_fold(i, p->data.and.f, j, (mpc_val_t**)results);
-        if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
+typedef struct {
+  mpc_state_t state;
+  char received;
+  int item;
+} mpc_dfa_stop_t;
 
-    /* End */
+static int mpc_dfa_run(mpc_input_t *i, mpc_dfa_t *d, char **o, mpc_err_t **e) {
 
-    default:
+  mpc_dfa_stop_t stops[MPC_DFA_ITEMS_MAX];
+  int s = 0, t, a, b, j, n = 0;
+  long start = i->state.pos;
+  size_t len = 0, slots = 0;
+  char c, *out = NULL;
+  int direct = i->type == MPC_INPUT_STRING || i->type == MPC_INPUT_MMAP;
 
-      MPC_FAILURE(mpc_err_fail(i, "Unknown Parser Type Id!"));
-  }
+  mpc_input_mark(i);
 
-  return 0;
+  for (;;) {
 
-}
+    c = mpc_input_peekc(i);
+    t = d->next[s * 256 + (unsigned char)c];
 
-#undef MPC_SUCCESS
-#undef MPC_FAILURE
-#undef MPC_PRIMITIVE
+    if (t == MPC_DFA_FAIL) {
+      mpc_input_rewind(i);
+      if (out) { mpc_free(i, out); }
+      return 0;
+    }
 
-int mpc_parse_input(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r) {
-  int x;
-  mpc_err_t *e = mpc_err_fail(i, "Unknown Error");
-  e->state = mpc_state_invalid();
-  x = mpc_parse_run(i, p, r, &e, 0);
-  if (x) {
-    mpc_err_delete_internal(i, e);
-    r->output = mpc_export(i, r->output);
-  } else {
-    r->error = mpc_err_export(i, mpc_err_merge(i, e, r->error));
-  }
-  return x;
-}
+    /* Items left behind here stopped on c */
+    a = s >> 1;
+    b = t == MPC_DFA_ACCEPT ? d->n : t >> 1;
+    for (j = a; j < b; j++) {
+      if (d->expect[j] == NULL) { continue; }
+      if (j == a && (s & 1) && (d->kind[j] == '1' || d->kind[j] == '?')) { continue; }
+      stops[n].state = i->state;
+      stops[n].received = c;
+      stops[n].item = j;
+      n++;
+    }
 
-int mpc_parse(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r) {
-  int x;
-  mpc_input_t *i = mpc_input_new_string(filename, string);
-  x = mpc_parse_input(i, p, r);
-  mpc_input_delete(i);
-  return x;
-}
+    if (t == MPC_DFA_ACCEPT) { break; }
 
-int mpc_nparse(const char *filename, const char *string, size_t length, mpc_parser_t *p, mpc_result_t *r) {
-  int x;
-  mpc_input_t *i = mpc_input_new_nstring(filename, string, length);
-  x = mpc_parse_input(i, p, r);
-  mpc_input_delete(i);
-  return x;
-}
+    mpc_input_getc(i);
+    mpc_input_success(i, c, NULL);
+    s = t;
 
-int mpc_parse_file(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r) {
-  int x;
-  mpc_input_t *i = mpc_input_new_file(filename, file);
-  x = mpc_parse_input(i, p, r);
-  mpc_input_delete(i);
-  return x;
-}
+    /* Take the rest of a run of a repeat at once */
+    if (direct && (d->kind[s >> 1] == '*' || d->kind[s >> 1] == '+')) {
+      mpc_input_advance(i, mpc_dfa_span(d, s, i->string + i->state.pos,
+        i->length - i->state.pos), d->classes[s >> 1].newline);
+    }
 
-int mpc_parse_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result_t *r) {
-  int x;
-  mpc_input_t *i = mpc_input_new_pipe(filename, pipe);
-  x = mpc_parse_input(i, p, r);
-  mpc_input_delete(i);
-  return x;
-}
+    if (!direct) {
+      if (len + 1 >= slots) {
+        slots = slots ? slots * 2 : 16;
+        out = out ? mpc_realloc(i, out, slots) : mpc_malloc(i, slots);
+      }
+      out[len++] = c;
+    }
+  }
 
-int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r) {
+  mpc_input_unmark(i);
 
-  FILE *f = fopen(filename, "rb");
-  int res;
+  for (j = 0; j < n; j++) {
+    mpc_err_t *x = mpc_err_new_at(i, &stops[j].state, stops[j].received, d->expect[stops[j].item]);
+    if (x) { *e = mpc_err_merge(i, *e, x); }
+  }
 
-  if (f == NULL) {
-    r->output = NULL;
-    r->error = mpc_err_file(filename, "Unable to open file!");
-    return 0;
+  if (direct) {
+    len = i->state.pos - start;
+    out = mpc_malloc(i, len + 1);
+    memcpy(out, i->string + start, len);
+  } else if (out == NULL) {
+    out = mpc_malloc(i, 1);
   }
 
-  res = mpc_parse_file(filename, f, p, r);
-  fclose(f);
-  return res;
+  out[len] = '\0';
+  *o = out;
+  return 1;
 }
 
 /*
-** Building a Parser
+** First Sets
 */
 
-static void mpc_undefine_unretained(mpc_parser_t *p, int force);
-
-static void mpc_undefine_or(mpc_parser_t *p) {
+/*
+** When an `or` is optimised each alternative gets
+** the set of bytes that can start a match of it, and
+** a table gives the first alternative to try for each
+** byte. The parse goes straight to the alternatives
+** that can match the next byte, and an `or` with
+** none fails without trying any. Skipped alternatives
+** would only have added errors at the position of the
+** `or`, so they are skipped wherever such errors would
+** not be built anyway.
+**
+** The sets are taken from the grammar as it is when
+** optimised, so rules should be defined before the
+** parsers using them are optimised.
+*/
 
-  int i;
-  for (i = 0; i < p->data.or.n; i++) {
-    mpc_undefine_unretained(p->data.or.xs[i], 0);
-  }
-  free(p->data.or.xs);
+enum {
+  MPC_FIRST_DEPTH_MAX = 32,
+  MPC_FIRST_ALTS_MAX = 255
+};
 
-}
+/* Adds the bytes that can start p to set, returns 1 if p can match nothing */
+static int mpc_first(mpc_parser_t *p, char *set, int depth) {
 
-static void mpc_undefine_and(mpc_parser_t *p) {
+  int j, c, empty;
+  char *expect, class[256];
 
-  int i;
-  for (i = 0; i < p->data.and.n; i++) {
-    mpc_undefine_unretained(p->data.and.xs[i], 0);
+  if (depth == MPC_FIRST_DEPTH_MAX) {
+    memset(set, 1, 256);
+    return 1;
   }
-  free(p->data.and.xs);
-  free(p->data.and.dxs);
-
-}
-
-static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
-
-  if (p->retained && !force) { return; }
 
   switch (p->type) {
 
-    case MPC_TYPE_FAIL: free(p->data.fail.m); break;
+    case MPC_TYPE_FAIL:
+      return 0;
 
+    case MPC_TYPE_ANY:
+    case MPC_TYPE_SINGLE:
+    case MPC_TYPE_RANGE:
     case MPC_TYPE_ONEOF:
     case MPC_TYPE_NONEOF:
-    case MPC_TYPE_STRING:
-      free(p->data.string.x);
-      break;
+    case MPC_TYPE_SATISFY:
+      mpc_dfa_class(p, class, &expect);
+      for (c = 0; c < 256; c++) { set[c] |= class[c]; }
+      return 0;
 
-    case MPC_TYPE_APPLY:    mpc_undefine_unretained(p->data.apply.x, 0);    break;
-    case MPC_TYPE_APPLY_TO: mpc_undefine_unretained(p->data.apply_to.x, 0); break;
-    case MPC_TYPE_PREDICT:  mpc_undefine_unretained(p->data.predict.x, 0);  break;
+    case MPC_TYPE_STRING:
+      if (p->data.string.x[0] == '\0') { return 1; }
+      set[(unsigned char)p->data.string.x[0]] = 1;
+      return 0;
 
-    case MPC_TYPE_MAYBE:
+    case MPC_TYPE_PASS:
+    case MPC_TYPE_LIFT:
+    case MPC_TYPE_LIFT_VAL:
+    case MPC_TYPE_ANCHOR:
+    case MPC_TYPE_STATE:
+    case MPC_TYPE_SOI:
+    case MPC_TYPE_EOI:
     case MPC_TYPE_NOT:
-      mpc_undefine_unretained(p->data.not.x, 0);
-      break;
+      return 1;
 
-    case MPC_TYPE_EXPECT:
-      mpc_undefine_unretained(p->data.expect.x, 0);
-      free(p->data.expect.m);
-      break;
+    case MPC_TYPE_EXPECT:     return mpc_first(p->data.expect.x, set, depth+1);
+    case MPC_TYPE_APPLY:      return mpc_first(p->data.apply.x, set, depth+1);
+    case MPC_TYPE_APPLY_TO:   return mpc_first(p->data.apply_to.x, set, depth+1);
+    case MPC_TYPE_CHECK:      return mpc_first(p->data.check.x, set, depth+1);
+    case MPC_TYPE_CHECK_WITH: return mpc_first(p->data.check_with.x, set, depth+1);
+    case MPC_TYPE_PREDICT:    return mpc_first(p->data.predict.x, set, depth+1);
+    case MPC_TYPE_SEPBY1:     return mpc_first(p->data.sepby1.x, set, depth+1);
+    case MPC_TYPE_DFA:        return mpc_first(p->data.dfa.x, set, depth+1);
+    case MPC_TYPE_MANY1:      return mpc_first(p->data.repeat.x, set, depth+1);
+
+    case MPC_TYPE_MAYBE:
+      mpc_first(p->data.not.x, set, depth+1);
+      return 1;
 
     case MPC_TYPE_MANY:
-    case MPC_TYPE_MANY1:
+      mpc_first(p->data.repeat.x, set, depth+1);
+      return 1;
+
     case MPC_TYPE_COUNT:
-      mpc_undefine_unretained(p->data.repeat.x, 0);
-      break;
+      empty = mpc_first(p->data.repeat.x, set, depth+1);
+      return empty || p->data.repeat.n < 1;
 
-    case MPC_TYPE_SEPBY1:
-      mpc_undefine_unretained(p->data.sepby1.x, 0);
-      mpc_undefine_unretained(p->data.sepby1.sep, 0);
-      break;
+    case MPC_TYPE_OR:
+      empty = 0;
+      for (j = 0; j < p->data.or.n; j++) {
+        empty = mpc_first(p->data.or.xs[j], set, depth+1) || empty;
+      }
+      return empty || p->data.or.n == 0;
 
-    case MPC_TYPE_OR:  mpc_undefine_or(p);  break;
-    case MPC_TYPE_AND: mpc_undefine_and(p); break;
+    case MPC_TYPE_AND:
+      for (j = 0; j < p->data.and.n; j++) {
+        if (!mpc_first(p->data.and.xs[j], set, depth+1)) { return 0; }
+      }
+      return 1;
 
-    case MPC_TYPE_CHECK:
-      mpc_undefine_unretained(p->data.check.x, 0);
-      free(p->data.check.e);
-      break;
+    /* Undefined parsers may be defined later, so could start with anything */
+    default:
+      memset(set, 1, 256);
+      return 1;
+  }
 
-    case MPC_TYPE_CHECK_WITH:
-      mpc_undefine_unretained(p->data.check_with.x, 0);
-      free(p->data.check_with.e);
-      break;
+}
 
-    default: break;
+static void mpc_first_compile(mpc_parser_t *p) {
+
+  int j, c, skips = 0;
+  char set[256];
+  mpc_pdata_or_t *o = &p->data.or;
+
+  free(o->first);
+  free(o->jump);
+  o->first = NULL;
+  o->jump = NULL;
+
+  if (o->n < 2 || o->n > MPC_FIRST_ALTS_MAX) { return; }
+
+  o->first = calloc(o->n, 32);
+  for (j = 0; j < o->n; j++) {
+    memset(set, 0, 256);
+    if (mpc_first(o->xs[j], set, 0)) { memset(set, 1, 256); }
+    /* The end of input is left to the alternatives */
+    set[0] = 1;
+    for (c = 0; c < 256; c++) {
+      if (set[c]) { o->first[j * 32 + c / 8] |= 1 << (c % 8); } else { skips++; }
+    }
   }
 
-  if (!force) {
-    free(p->name);
-    free(p);
+  if (skips == 0) {
+    free(o->first);
+    o->first = NULL;
+    return;
   }
 
+  o->jump = malloc(256);
+  for (c = 0; c < 256; c++) {
+    for (j = 0; j < o->n && !(o->first[j * 32 + c / 8] & (1 << (c % 8))); j++);
+    o->jump[c] = (unsigned char)j;
+  }
 }
 
-void mpc_delete(mpc_parser_t *p) {
-  if (p->retained) {
+/* First alternative from j that can start at the next byte */
+static int mpc_first_next(mpc_input_t *i, mpc_pdata_or_t *o, int j) {
 
-    if (p->type != MPC_TYPE_UNDEFINED) {
-      mpc_undefine_unretained(p, 0);
-    }
+  int k;
+  unsigned char c;
 
-    free(p->name);
-    free(p);
+  /* Skipping only loses errors short of the furthest */
+  if (o->first == NULL || (!i->lazy && i->state.pos >= i->err_pos)) { return j; }
 
+  c = (unsigned char)mpc_input_peekc(i);
+  if (j == 0) {
+    k = o->jump[c];
   } else {
-    mpc_undefine_unretained(p, 0);
+    for (k = j; k < o->n && !(o->first[k * 32 + c / 8] & (1 << (c % 8))); k++);
   }
-}
 
-static void mpc_soft_delete(mpc_val_t *x) {
-  mpc_undefine_unretained(x, 0);
+  return k;
 }
 
-static mpc_parser_t *mpc_undefined(void) {
-  mpc_parser_t *p = calloc(1, sizeof(mpc_parser_t));
-  p->retained = 0;
-  p->type = MPC_TYPE_UNDEFINED;
-  p->name = NULL;
-  return p;
-}
+enum {
+  MPC_PARSE_STACK_MIN = 4,
+  MPC_PARSE_FRAMES_MIN = 64
+};
 
-mpc_parser_t *mpc_new(const char *name) {
-  mpc_parser_t *p = mpc_undefined();
-  p->retained = 1;
-  p->name = realloc(p->name, strlen(name) + 1);
-  strcpy(p->name, name);
-  return p;
-}
+/*
+** The parse runs on an explicit stack of frames
+** instead of the C stack, so how deeply the input
+** nests is only limited by memory. A frame is first
+** entered, which parses primitives outright and
+** pushes the first child of combinators. It is then
+** resumed with the result of each child it pushed
+** until it is done and hands its own result back
+** to the frame below.
+*/
 
-mpc_parser_t *mpc_copy(mpc_parser_t *a) {
-  int i = 0;
+typedef struct {
   mpc_parser_t *p;
+  long pos;
+  int j;
+  int sep;
+  int slots;
+  mpc_result_t *results;
+  mpc_result_t results_stk[MPC_PARSE_STACK_MIN];
+} mpc_frame_t;
 
-  if (a->retained) { return a; }
-
-  p = mpc_undefined();
-  p->retained = a->retained;
-  p->type = a->type;
-  p->data = a->data;
-
-  if (a->name) {
-    p->name = malloc(strlen(a->name)+1);
-    strcpy(p->name, a->name);
+typedef struct {
+  int num;
+  int slots;
+  mpc_frame_t *frames;
+} mpc_stack_t;
+
+static void mpc_stack_push(mpc_stack_t *s, mpc_parser_t *p) {
+  mpc_frame_t *f;
+  if (s->num == s->slots) {
+    s->slots *= 2;
+    s->frames = realloc(s->frames, sizeof(mpc_frame_t) * s->slots);
   }
+  f = &s->frames[s->num++];
+  f->p = p;
+  f->j = 0;
+  f->sep = 0;
+  f->slots = MPC_PARSE_STACK_MIN;
+  f->results = NULL;
+}
+
+/* Store a child's result, making room for the next one */
+static void mpc_frame_add(mpc_input_t *i, mpc_frame_t *f, mpc_result_t *x) {
+  if (f->j == f->slots) {
+    f->slots = f->slots + f->slots / 2;
+    if (f->results == NULL) {
+      f->results = mpc_malloc(i, sizeof(mpc_result_t) * f->slots);
+      memcpy(f->results, f->results_stk, sizeof(mpc_result_t) * MPC_PARSE_STACK_MIN);
+    } else {
+      f->results = mpc_realloc(i, f->results, sizeof(mpc_result_t) * f->slots);
+    }
+  }
+  (f->results ? f->results : f->results_stk)[f->j++] = *x;
+}
 
-  switch (a->type) {
+/* Results array sized up front for n children */
+static mpc_result_t *mpc_frame_alloc(mpc_input_t *i, mpc_frame_t *f, int n) {
+  if (n > MPC_PARSE_STACK_MIN) {
+    f->slots = n;
+    f->results = mpc_malloc(i, sizeof(mpc_result_t) * n);
+    return f->results;
+  }
+  return f->results_stk;
+}
 
-    case MPC_TYPE_FAIL:
-      p->data.fail.m = malloc(strlen(a->data.fail.m)+1);
-      strcpy(p->data.fail.m, a->data.fail.m);
-    break;
+#define MPC_SUCCESS(v) { x.output = v; ok = 1; goto done; }
+#define MPC_FAILURE(v) { x.error = v; ok = 0; goto done; }
+#define MPC_PRIMITIVE(v) \
+  if (v) { MPC_SUCCESS(x.output); } \
+  else { MPC_FAILURE(NULL); }
+#define MPC_CALL(c) { mpc_stack_push(&s, c); resume = 0; continue; }
 
-    case MPC_TYPE_ONEOF:
-    case MPC_TYPE_NONEOF:
-    case MPC_TYPE_STRING:
-      p->data.string.x = malloc(strlen(a->data.string.x)+1);
-      strcpy(p->data.string.x, a->data.string.x);
-      break;
+static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_err_t **e) {
 
-    case MPC_TYPE_APPLY:    p->data.apply.x    = mpc_copy(a->data.apply.x);    break;
-    case MPC_TYPE_APPLY_TO: p->data.apply_to.x = mpc_copy(a->data.apply_to.x); break;
-    case MPC_TYPE_PREDICT:  p->data.predict.x  = mpc_copy(a->data.predict.x);  break;
+  mpc_stack_t s;
+  mpc_frame_t *f;
+  mpc_result_t *results;
+  mpc_result_t x;
+  int k, ok = 0, resume = 0;
 
-    case MPC_TYPE_MAYBE:
-    case MPC_TYPE_NOT:
-      p->data.not.x = mpc_copy(a->data.not.x);
-      break;
+  s.num = 0;
+  s.slots = MPC_PARSE_FRAMES_MIN;
+  s.frames = malloc(sizeof(mpc_frame_t) * s.slots);
+  mpc_stack_push(&s, p);
 
-    case MPC_TYPE_EXPECT:
-      p->data.expect.x = mpc_copy(a->data.expect.x);
-      p->data.expect.m = malloc(strlen(a->data.expect.m)+1);
-      strcpy(p->data.expect.m, a->data.expect.m);
-      break;
+  for (;;) {
 
-    case MPC_TYPE_MANY:
-    case MPC_TYPE_MANY1:
-    case MPC_TYPE_COUNT:
-      p->data.repeat.x = mpc_copy(a->data.repeat.x);
-      break;
+    f = &s.frames[s.num-1];
+    p = f->p;
+    results = f->results ? f->results : f->results_stk;
 
-    case MPC_TYPE_SEPBY1:
-      p->data.sepby1.x   = mpc_copy(a->data.sepby1.x);
-      p->data.sepby1.sep = mpc_copy(a->data.sepby1.sep);
-      break;
+    if (!resume) {
 
-    case MPC_TYPE_OR:
-      p->data.or.xs = malloc(a->data.or.n * sizeof(mpc_parser_t*));
-      for (i = 0; i < a->data.or.n; i++) {
-        p->data.or.xs[i] = mpc_copy(a->data.or.xs[i]);
-      }
-    break;
-    case MPC_TYPE_AND:
-      p->data.and.xs = malloc(a->data.and.n * sizeof(mpc_parser_t*));
-      for (i = 0; i < a->data.and.n; i++) {
-        p->data.and.xs[i] = mpc_copy(a->data.and.xs[i]);
-      }
-      if (a->data.and.n > 0) {
-          p->data.and.dxs = malloc((a->data.and.n-1) * sizeof(mpc_dtor_t));
-          for (i = 0; i < a->data.and.n-1; i++) {
-            p->data.and.dxs[i] = a->data.and.dxs[i];
-          }
+      if (i->memo && mpc_memo_type(p)) {
+        f->pos = i->state.pos;
+        if (mpc_memo_find(i, p, &x.error)) { ok = 0; goto pop; }
       }
-    break;
 
-    case MPC_TYPE_CHECK:
-      p->data.check.x      = mpc_copy(a->data.check.x);
-      p->data.check.e      = malloc(strlen(a->data.check.e)+1);
-      strcpy(p->data.check.e, a->data.check.e);
-      break;
-    case MPC_TYPE_CHECK_WITH:
-      p->data.check_with.x = mpc_copy(a->data.check_with.x);
-      p->data.check_with.e = malloc(strlen(a->data.check_with.e)+1);
-      strcpy(p->data.check_with.e, a->data.check_with.e);
-      break;
+      x.output = NULL;
 
-    default: break;
-  }
+      switch (p->type) {
 
+        /* Basic Parsers */
 
-  return p;
-}
+        case MPC_TYPE_ANY:     MPC_PRIMITIVE(mpc_input_any(i, (char**)&x.output));
+        case MPC_TYPE_SINGLE:  MPC_PRIMITIVE(mpc_input_char(i, p->data.single.x, (char**)&x.output));
+        case MPC_TYPE_RANGE:   MPC_PRIMITIVE(mpc_input_range(i, p->data.range.x, p->data.range.y, (char**)&x.output));
+        case MPC_TYPE_ONEOF:   MPC_PRIMITIVE(mpc_input_oneof(i, p->data.string.x, (char**)&x.output));
+        case MPC_TYPE_NONEOF:  MPC_PRIMITIVE(mpc_input_noneof(i, p->data.string.x, (char**)&x.output));
+        case MPC_TYPE_SATISFY: MPC_PRIMITIVE(mpc_input_satisfy(i, p->data.satisfy.f, (char**)&x.output));
+        case MPC_TYPE_STRING:  MPC_PRIMITIVE(mpc_input_string(i, p->data.string.x, (char**)&x.output));
+        case MPC_TYPE_ANCHOR:  MPC_PRIMITIVE(mpc_input_anchor(i, p->data.anchor.f, (char**)&x.output));
+        case MPC_TYPE_SOI:     MPC_PRIMITIVE(mpc_input_soi(i, (char**)&x.output));
+        case MPC_TYPE_EOI:     MPC_PRIMITIVE(mpc_input_eoi(i, (char**)&x.output));
 
-mpc_parser_t *mpc_undefine(mpc_parser_t *p) {
-  mpc_undefine_unretained(p, 1);
-  p->type = MPC_TYPE_UNDEFINED;
-  return p;
-}
+        /* Other parsers */
 
-mpc_parser_t *mpc_define(mpc_parser_t *p, mpc_parser_t *a) {
+        case MPC_TYPE_UNDEFINED: MPC_FAILURE(mpc_err_fail(i, "Parser Undefined!"));
+        case MPC_TYPE_PASS:      MPC_SUCCESS(NULL);
+        case MPC_TYPE_FAIL:      MPC_FAILURE(mpc_err_fail(i, p->data.fail.m));
+        case MPC_TYPE_LIFT:      MPC_SUCCESS(p->data.lift.lf());
+        case MPC_TYPE_LIFT_VAL:  MPC_SUCCESS(p->data.lift.x);
+        case MPC_TYPE_STATE:     MPC_SUCCESS(mpc_input_state_copy(i));
 
-  if (p->retained) {
-    p->type = a->type;
-    p->data = a->data;
-  } else {
-    mpc_parser_t *a2 = mpc_failf("Attempt to assign to Unretained Parser!");
-    p->type = a2->type;
-    p->data = a2->data;
-    free(a2);
-  }
+        /* Application Parsers */
 
-  free(a);
-  return p;
-}
+        case MPC_TYPE_APPLY:      MPC_CALL(p->data.apply.x);
+        case MPC_TYPE_APPLY_TO:   MPC_CALL(p->data.apply_to.x);
+        case MPC_TYPE_CHECK:      MPC_CALL(p->data.check.x);
+        case MPC_TYPE_CHECK_WITH: MPC_CALL(p->data.check_with.x);
 
-void mpc_cleanup(int n, ...) {
-  int i;
-  mpc_parser_t **list = malloc(sizeof(mpc_parser_t*) * n);
+        case MPC_TYPE_EXPECT:
+          mpc_input_suppress_enable(i);
+          MPC_CALL(p->data.expect.x);
 
-  va_list va;
-  va_start(va, n);
-  for (i = 0; i < n; i++) { list[i] = va_arg(va, mpc_parser_t*); }
-  for (i = 0; i < n; i++) { mpc_undefine(list[i]); }
-  for (i = 0; i < n; i++) { mpc_delete(list[i]); }
-  va_end(va);
+        case MPC_TYPE_PREDICT:
+          mpc_input_backtrack_disable(i);
+          MPC_CALL(p->data.predict.x);
 
-  free(list);
-}
+        /* Optional Parsers */
 
-mpc_parser_t *mpc_pass(void) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_PASS;
-  return p;
-}
+        case MPC_TYPE_NOT:
+          mpc_input_mark(i);
+          mpc_input_suppress_enable(i);
+          MPC_CALL(p->data.not.x);
 
-mpc_parser_t *mpc_fail(const char *m) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_FAIL;
-  p->data.fail.m = malloc(strlen(m) + 1);
-  strcpy(p->data.fail.m, m);
-  return p;
-}
+        case MPC_TYPE_MAYBE: MPC_CALL(p->data.not.x);
 
-/*
-** As `snprintf` is not ANSI standard this
-** function `mpc_failf` should be considered
-** unsafe.
-**
-** You have a few options if this is going to be
-** trouble.
-**
-** - Ensure the format string does not exceed
-**   the buffer length using precision specifiers
-**   such as `%.512s`.
-**
-** - Patch this function in your code base to
-**   use `snprintf` or whatever variant your
-**   system supports.
-**
-** - Avoid it altogether.
-**
-*/
+        /* Repeat Parsers */
 
-mpc_parser_t *mpc_failf(const char *fmt, ...) {
+        case MPC_TYPE_MANY:
+        case MPC_TYPE_MANY1:
+          MPC_CALL(p->data.repeat.x);
 
-  va_list va;
-  char *buffer;
+        case MPC_TYPE_SEPBY1:
+          MPC_CALL(p->data.sepby1.x);
 
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_FAIL;
+        case MPC_TYPE_COUNT:
+          mpc_frame_alloc(i, f, p->data.repeat.n);
+          MPC_CALL(p->data.repeat.x);
 
-  va_start(va, fmt);
-  buffer = malloc(2048);
-  if (!buffer) {
-    return NULL;
-  }
-  vsprintf(buffer, fmt, va);
-  va_end(va);
+        /* Combinatory Parsers */
 
-  buffer = realloc(buffer, strlen(buffer) + 1);
-  p->data.fail.m = buffer;
-  return p;
+        case MPC_TYPE_OR:
+          if (p->data.or.n == 0) { MPC_SUCCESS(NULL); }
+          f->j = mpc_first_next(i, &p->data.or, 0);
+          if (f->j < p->data.or.n) {
+            MPC_CALL(p->data.or.xs[f->j]);
+          }
+          MPC_FAILURE(NULL);
 
-}
+        case MPC_TYPE_AND:
+          if (p->data.and.n == 0) { MPC_SUCCESS(NULL); }
+          mpc_frame_alloc(i, f, p->data.and.n);
+          mpc_input_mark(i);
+          MPC_CALL(p->data.and.xs[0]);
 
-mpc_parser_t *mpc_lift_val(mpc_val_t *x) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_LIFT_VAL;
-  p->data.lift.x = x;
-  return p;
-}
+        case MPC_TYPE_DFA:
+          if (mpc_dfa_run(i, p->data.dfa.d, (char**)&x.output, e)) { MPC_SUCCESS(x.output); }
+          MPC_CALL(p->data.dfa.x);
 
-mpc_parser_t *mpc_lift(mpc_ctor_t lf) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_LIFT;
-  p->data.lift.lf = lf;
-  return p;
-}
+        /* End */
 
-mpc_parser_t *mpc_anchor(int(*f)(char,char)) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_ANCHOR;
-  p->data.anchor.f = f;
-  return mpc_expect(p, "anchor");
-}
+        default:
 
-mpc_parser_t *mpc_state(void) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_STATE;
-  return p;
-}
+          MPC_FAILURE(mpc_err_fail(i, "Unknown Parser Type Id!"));
+      }
 
-mpc_parser_t *mpc_expect(mpc_parser_t *a, const char *expected) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_EXPECT;
-  p->data.expect.x = a;
-  p->data.expect.m = malloc(strlen(expected) + 1);
-  strcpy(p->data.expect.m, expected);
-  return p;
-}
+    }
 
-/*
-** As `snprintf` is not ANSI standard this
-** function `mpc_expectf` should be considered
-** unsafe.
-**
-** You have a few options if this is going to be
-** trouble.
-**
-** - Ensure the format string does not exceed
-**   the buffer length using precision specifiers
-**   such as `%.512s`.
-**
-** - Patch this function in your code base to
-**   use `snprintf` or whatever variant your
-**   system supports.
-**
-** - Avoid it altogether.
-**
-*/
+    /* Resume with the result of the child in x */
 
-mpc_parser_t *mpc_expectf(mpc_parser_t *a, const char *fmt, ...) {
-  va_list va;
-  char *buffer;
+    switch (p->type) {
 
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_EXPECT;
+      /* Application Parsers */
 
-  va_start(va, fmt);
-  buffer = malloc(2048);
-  if (!buffer) {
-    return NULL;
-  }
-  vsprintf(buffer, fmt, va);
-  va_end(va);
+      case MPC_TYPE_APPLY:
+        if (ok) {
+          MPC_SUCCESS(mpc_parse_apply(i, p->data.apply.f, x.output));
+        } else {
+          MPC_FAILURE(x.error);
+        }
 
-  buffer = realloc(buffer, strlen(buffer) + 1);
-  p->data.expect.x = a;
-  p->data.expect.m = buffer;
-  return p;
-}
+      case MPC_TYPE_APPLY_TO:
+        if (ok) {
+          MPC_SUCCESS(mpc_parse_apply_to(i, p->data.apply_to.f, x.output, p->data.apply_to.d));
+        } else {
+          MPC_FAILURE(x.error);
+        }
 
-/*
-** Basic Parsers
-*/
+      case MPC_TYPE_CHECK:
+        if (ok) {
+          if (p->data.check.f(&x.output)) {
+            MPC_SUCCESS(x.output);
+          } else {
+            mpc_parse_dtor(i, p->data.check.dx, x.output);
+            MPC_FAILURE(mpc_err_fail(i, p->data.check.e));
+          }
+        } else {
+          MPC_FAILURE(x.error);
+        }
 
-mpc_parser_t *mpc_any(void) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_ANY;
-  return mpc_expect(p, "any character");
-}
+      case MPC_TYPE_CHECK_WITH:
+        if (ok) {
+          if (p->data.check_with.f(&x.output, p->data.check_with.d)) {
+            MPC_SUCCESS(x.output);
+          } else {
+            mpc_parse_dtor(i, p->data.check_with.dx, x.output);
+            MPC_FAILURE(mpc_err_fail(i, p->data.check_with.e));
+          }
+        } else {
+          MPC_FAILURE(x.error);
+        }
 
-mpc_parser_t *mpc_char(char c) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_SINGLE;
-  p->data.single.x = c;
-  return mpc_expectf(p, "'%c'", c);
-}
+      case MPC_TYPE_EXPECT:
+        mpc_input_suppress_disable(i);
+        if (ok) {
+          MPC_SUCCESS(x.output);
+        } else {
+          MPC_FAILURE(mpc_err_new(i, p->data.expect.m));
+        }
 
-mpc_parser_t *mpc_range(char s, char e) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_RANGE;
-  p->data.range.x = s;
-  p->data.range.y = e;
-  return mpc_expectf(p, "character between '%c' and '%c'", s, e);
-}
-
-mpc_parser_t *mpc_oneof(const char *s) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_ONEOF;
-  p->data.string.x = malloc(strlen(s) + 1);
-  strcpy(p->data.string.x, s);
-  return mpc_expectf(p, "one of '%s'", s);
-}
+      case MPC_TYPE_PREDICT:
+        mpc_input_backtrack_enable(i);
+        if (ok) {
+          MPC_SUCCESS(x.output);
+        } else {
+          MPC_FAILURE(x.error);
+        }
 
-mpc_parser_t *mpc_noneof(const char *s) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_NONEOF;
-  p->data.string.x = malloc(strlen(s) + 1);
-  strcpy(p->data.string.x, s);
-  return mpc_expectf(p, "none of '%s'", s);
+      /* Optional Parsers */
 
-}
+      /* TODO: Update Not Error Message */
 
-mpc_parser_t *mpc_satisfy(int(*f)(char)) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_SATISFY;
-  p->data.satisfy.f = f;
-  return mpc_expectf(p, "character satisfying function %p", f);
-}
+      case MPC_TYPE_NOT:
+        if (ok) {
+          mpc_input_rewind(i);
+          mpc_input_suppress_disable(i);
+          mpc_parse_dtor(i, p->data.not.dx, x.output);
+          MPC_FAILURE(mpc_err_new(i, "opposite"));
+        } else {
+          mpc_input_unmark(i);
+          mpc_input_suppress_disable(i);
+          MPC_SUCCESS(p->data.not.lf());
+        }
 
-mpc_parser_t *mpc_string(const char *s) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_STRING;
-  p->data.string.x = malloc(strlen(s) + 1);
-  strcpy(p->data.string.x, s);
-  return mpc_expectf(p, "\"%s\"", s);
-}
+      case MPC_TYPE_MAYBE:
+        if (ok) {
+          MPC_SUCCESS(x.output);
+        } else {
+          *e = mpc_err_merge(i, *e, x.error);
+          MPC_SUCCESS(p->data.not.lf());
+        }
 
-/*
-** Core Parsers
-*/
+      /* Repeat Parsers */
 
-mpc_parser_t *mpc_apply(mpc_parser_t *a, mpc_apply_t f) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_APPLY;
-  p->data.apply.x = a;
-  p->data.apply.f = f;
-  return p;
-}
+      case MPC_TYPE_MANY:
+        if (ok) {
+          mpc_frame_add(i, f, &x);
+          MPC_CALL(p->data.repeat.x);
+        }
+        *e = mpc_err_merge(i, *e, x.error);
+        MPC_SUCCESS(mpc_parse_fold(i, p->data.repeat.f, f->j, (mpc_val_t**)results));
 
-mpc_parser_t *mpc_apply_to(mpc_parser_t *a, mpc_apply_to_t f, void *x) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_APPLY_TO;
-  p->data.apply_to.x = a;
-  p->data.apply_to.f = f;
-  p->data.apply_to.d = x;
-  return p;
-}
+      case MPC_TYPE_MANY1:
+        if (ok) {
+          mpc_frame_add(i, f, &x);
+          MPC_CALL(p->data.repeat.x);
+        }
+        if (f->j == 0) {
+          MPC_FAILURE(mpc_err_many1(i, x.error));
+        }
+        *e = mpc_err_merge(i, *e, x.error);
+        MPC_SUCCESS(mpc_parse_fold(i, p->data.repeat.f, f->j, (mpc_val_t**)results));
+
+      case MPC_TYPE_SEPBY1:
+        /* The output of a separator is not kept */
+        if (ok && f->sep) {
+          f->sep = 0;
+          MPC_CALL(p->data.sepby1.x);
+        }
+        if (ok) {
+          mpc_frame_add(i, f, &x);
+          f->sep = 1;
+          MPC_CALL(p->data.sepby1.sep);
+        }
+        if (f->j == 0) {
+          MPC_FAILURE(mpc_err_many1(i, x.error));
+        }
+        *e = mpc_err_merge(i, *e, x.error);
+        MPC_SUCCESS(mpc_parse_fold(i, p->data.sepby1.f, f->j, (mpc_val_t**)results));
+
+      case MPC_TYPE_COUNT:
+        if (ok) {
+          mpc_frame_add(i, f, &x);
+          results = f->results ? f->results : f->results_stk;
+          if (f->j == p->data.repeat.n) {
+            MPC_SUCCESS(mpc_parse_fold(i, p->data.repeat.f, f->j, (mpc_val_t**)results));
+          }
+          MPC_CALL(p->data.repeat.x);
+        }
+        for (k = 0; k < f->j; k++) {
+          mpc_parse_dtor(i, p->data.repeat.dx, results[k].output);
+        }
+        MPC_FAILURE(mpc_err_count(i, x.error, p->data.repeat.n));
 
-mpc_parser_t *mpc_check(mpc_parser_t *a, mpc_dtor_t da, mpc_check_t f, const char *e) {
-  mpc_parser_t  *p = mpc_undefined();
-  p->type = MPC_TYPE_CHECK;
-  p->data.check.x = a;
-  p->data.check.dx = da;
-  p->data.check.f = f;
-  p->data.check.e = malloc(strlen(e) + 1);
-  strcpy(p->data.check.e, e);
-  return p;
-}
+      /* Combinatory Parsers */
 
-mpc_parser_t *mpc_check_with(mpc_parser_t *a, mpc_dtor_t da, mpc_check_with_t f, void *x, const char *e) {
-  mpc_parser_t  *p = mpc_undefined();
-  p->type = MPC_TYPE_CHECK_WITH;
-  p->data.check_with.x = a;
-  p->data.check_with.dx = da;
-  p->data.check_with.f = f;
-  p->data.check_with.d = x;
-  p->data.check_with.e = malloc(strlen(e) + 1);
-  strcpy(p->data.check_with.e, e);
-  return p;
-}
+      case MPC_TYPE_OR:
+        if (ok) {
+          MPC_SUCCESS(x.output);
+        }
+        *e = mpc_err_merge(i, *e, x.error);
+        f->j = mpc_first_next(i, &p->data.or, f->j + 1);
+        if (f->j < p->data.or.n) {
+          MPC_CALL(p->data.or.xs[f->j]);
+        }
+        MPC_FAILURE(NULL);
 
-mpc_parser_t *mpc_checkf(mpc_parser_t *a, mpc_dtor_t da, mpc_check_t f, const char *fmt, ...) {
-  va_list va;
-  char *buffer;
-  mpc_parser_t *p;
+      case MPC_TYPE_AND:
+        if (!ok) {
+          mpc_input_rewind(i);
+          for (k = 0; k < f->j; k++) {
+            mpc_parse_dtor(i, p->data.and.dxs[k], results[k].output);
+          }
+          MPC_FAILURE(x.error);
+        }
+        results[f->j++] = x;
+        if (f->j < p->data.and.n) {
+          MPC_CALL(p->data.and.xs[f->j]);
+        }
+        mpc_input_unmark(i);
+        MPC_SUCCESS(mpc_parse_fold(i, p->data.and.f, f->j, (mpc_val_t**)results));
 
-  va_start(va, fmt);
-  buffer = malloc(2048);
-  vsprintf(buffer, fmt, va);
-  va_end(va);
+      case MPC_TYPE_DFA:
+        if (ok) {
+          MPC_SUCCESS(x.output);
+        } else {
+          MPC_FAILURE(x.error);
+        }
 
-  p = mpc_check(a, da, f, buffer);
-  free(buffer);
+      default:
+        MPC_FAILURE(mpc_err_fail(i, "Unknown Parser Type Id!"));
+    }
 
-  return p;
-}
+  done:
 
-mpc_parser_t *mpc_check_withf(mpc_parser_t *a, mpc_dtor_t da, mpc_check_with_t f, void *x, const char *fmt, ...) {
-  va_list va;
-  char *buffer;
-  mpc_parser_t *p;
+    /* Failures that consumed input can not be replayed */
+    if (!ok && i->memo && mpc_memo_type(p) && i->state.pos == f->pos) {
+      mpc_memo_add(i, p, x.error);
+    }
 
-  va_start(va, fmt);
-  buffer = malloc(2048);
-  vsprintf(buffer, fmt, va);
-  va_end(va);
+  pop:
 
-  p = mpc_check_with(a, da, f, x, buffer);
-  free(buffer);
+    if (f->results) { mpc_free(i, f->results); }
+    resume = 1;
+    if (--s.num == 0) { break; }
+  }
 
-  return p;
+  free(s.frames);
+  *r = x;
+  return ok;
 }
 
-mpc_parser_t *mpc_predictive(mpc_parser_t *a) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_PREDICT;
-  p->data.predict.x = a;
-  return p;
-}
+#undef MPC_SUCCESS
+#undef MPC_FAILURE
+#undef MPC_PRIMITIVE
+#undef MPC_CALL
 
-mpc_parser_t *mpc_not_lift(mpc_parser_t *a, mpc_dtor_t da, mpc_ctor_t lf) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_NOT;
-  p->data.not.x = a;
-  p->data.not.dx = da;
-  p->data.not.lf = lf;
-  return p;
+int mpc_parse_input(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r) {
+  int x;
+  mpc_state_t start = i->state;
+  char last = i->last;
+  mpc_err_t *e = i->lazy ? NULL : mpc_err_unknown(i);
+  i->err_pos = start.pos;
+  x = mpc_parse_run(i, p, r, &e);
+
+  /* Parse again building the errors */
+  if (!x && i->lazy) {
+    mpc_err_delete_internal(i, mpc_err_merge(i, e, r->error));
+    mpc_memo_clear(i);
+    i->state = start;
+    i->last = last;
+    i->lazy = 0;
+    if (i->ast_arena) {
+      mpc_ast_arena_delete(i->ast_arena);
+      i->ast_arena = mpc_ast_arena_create();
+    }
+    e = mpc_err_unknown(i);
+    x = mpc_parse_run(i, p, r, &e);
+  }
+
+  if (x) {
+    mpc_err_delete_internal(i, e);
+    r->output = mpc_export(i, r->output);
+    if (i->ast_arena && mpc_ast_arena_adopt(i->ast_arena, r->output)) {
+      i->ast_arena = NULL;
+    }
+  } else {
+    r->error = mpc_err_export(i, mpc_err_merge(i, e, r->error));
+  }
+  return x;
 }
 
-mpc_parser_t *mpc_not(mpc_parser_t *a, mpc_dtor_t da) {
-  return mpc_not_lift(a, da, mpcf_ctor_null);
+int mpc_parse(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_string(filename, string);
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
 }
 
-mpc_parser_t *mpc_maybe_lift(mpc_parser_t *a, mpc_ctor_t lf) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_MAYBE;
-  p->data.not.x = a;
-  p->data.not.lf = lf;
-  return p;
+int mpc_nparse(const char *filename, const char *string, size_t length, mpc_parser_t *p, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_nstring(filename, string, length);
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
 }
 
-mpc_parser_t *mpc_maybe(mpc_parser_t *a) {
-  return mpc_maybe_lift(a, mpcf_ctor_null);
+int mpc_parse_file(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_file(filename, file);
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
 }
 
-mpc_parser_t *mpc_many(mpc_fold_t f, mpc_parser_t *a) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_MANY;
-  p->data.repeat.x = a;
-  p->data.repeat.f = f;
-  return p;
+int mpc_parse_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_pipe(filename, pipe);
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
 }
 
-mpc_parser_t *mpc_many1(mpc_fold_t f, mpc_parser_t *a) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_MANY1;
-  p->data.repeat.x = a;
-  p->data.repeat.f = f;
-  return p;
+int mpc_parse_flags(int flags, const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_string(filename, string);
+  if (flags & MPC_PARSE_MEMO) {
+    i->memo = calloc(MPC_MEMO_SLOTS_MIN, sizeof(mpc_memo_t));
+    i->memo_slots = MPC_MEMO_SLOTS_MIN;
+  }
+  if (flags & MPC_PARSE_ARENA) {
+    i->ast_arena = mpc_ast_arena_create();
+  }
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
 }
 
-mpc_parser_t *mpc_count(int n, mpc_fold_t f, mpc_parser_t *a, mpc_dtor_t da) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_COUNT;
-  p->data.repeat.n = n;
-  p->data.repeat.f = f;
-  p->data.repeat.x = a;
-  p->data.repeat.dx = da;
-  return p;
+struct mpc_stream_t {
+  mpc_input_t *input;
+  int flags;
+};
+
+mpc_stream_t *mpc_stream_new(int flags, const char *filename, FILE *file) {
+  mpc_stream_t *s = malloc(sizeof(mpc_stream_t));
+  s->input = mpc_input_new_pipe(filename, file);
+  s->flags = flags;
+  if (flags & MPC_PARSE_MEMO) {
+    s->input->memo = calloc(MPC_MEMO_SLOTS_MIN, sizeof(mpc_memo_t));
+    s->input->memo_slots = MPC_MEMO_SLOTS_MIN;
+  }
+  return s;
 }
 
-mpc_parser_t *mpc_sepby1(mpc_fold_t f, mpc_parser_t *sep, mpc_parser_t *a) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_SEPBY1;
-  p->data.sepby1.x   = a;
-  p->data.sepby1.f   = f;
-  p->data.sepby1.sep = sep;
-  return p;
+void mpc_stream_delete(mpc_stream_t *s) {
+  mpc_input_delete(s->input);
+  free(s);
 }
 
-mpc_parser_t *mpc_or(int n, ...) {
+int mpc_stream_parse(mpc_stream_t *s, mpc_parser_t *p, mpc_result_t *r) {
 
-  int i;
-  va_list va;
+  int x;
+  mpc_input_t *i = s->input;
 
-  mpc_parser_t *p = mpc_undefined();
+  /*
+  ** The mark keeps the characters of this result
+  ** buffered, so a failure can be parsed again from
+  ** its start to build the errors.
+  */
+  mpc_input_mark(i);
+  i->lazy = 1;
+  if (s->flags & MPC_PARSE_ARENA) {
+    i->ast_arena = mpc_ast_arena_create();
+  }
 
-  p->type = MPC_TYPE_OR;
-  p->data.or.n = n;
-  p->data.or.xs = malloc(sizeof(mpc_parser_t*) * n);
+  x = mpc_parse_input(i, p, r);
+  mpc_input_unmark(i);
 
-  va_start(va, n);
-  for (i = 0; i < n; i++) {
-    p->data.or.xs[i] = va_arg(va, mpc_parser_t*);
+  /* Nothing of this result is needed by the next */
+  if (i->ast_arena) {
+    mpc_ast_arena_delete(i->ast_arena);
+    i->ast_arena = NULL;
   }
-  va_end(va);
-
-  return p;
+  if (i->memo) { mpc_memo_clear(i); }
+  return x;
 }
 
-mpc_parser_t *mpc_and(int n, mpc_fold_t f, ...) {
+int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r) {
 
-  int i;
-  va_list va;
+  FILE *f = fopen(filename, "rb");
+  int res;
 
-  mpc_parser_t *p = mpc_undefined();
-
-  p->type = MPC_TYPE_AND;
-  p->data.and.n = n;
-  p->data.and.f = f;
-  p->data.and.xs = malloc(sizeof(mpc_parser_t*) * n);
-  p->data.and.dxs = malloc(sizeof(mpc_dtor_t) * (n-1));
-
-  va_start(va, f);
-  for (i = 0; i < n; i++) {
-    p->data.and.xs[i] = va_arg(va, mpc_parser_t*);
-  }
-  for (i = 0; i < (n-1); i++) {
-    p->data.and.dxs[i] = va_arg(va, mpc_dtor_t);
+  if (f == NULL) {
+    r->output = NULL;
+    r->error = mpc_err_file(filename, "Unable to open file!");
+    return 0;
   }
-  va_end(va);
 
-  return p;
+  res = mpc_parse_file(filename, f, p, r);
+  fclose(f);
+  return res;
 }
 
 /*
-** Common Parsers
+** Building a Parser
 */
 
-mpc_parser_t *mpc_soi(void) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_SOI;
-  return mpc_expect(p, "start of input");
-}
+static void mpc_undefine_unretained(mpc_parser_t *p, int force);
 
-mpc_parser_t *mpc_eoi(void) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_EOI;
-  return mpc_expect(p, "end of input");
-}
+static void mpc_undefine_or(mpc_parser_t *p) {
+
+  int i;
+  for (i = 0; i < p->data.or.n; i++) {
+    mpc_undefine_unretained(p->data.or.xs[i], 0);
+  }
+  free(p->data.or.xs);
+  free(p->data.or.first);
+  free(p->data.or.jump);
 
-static int mpc_boundary_anchor(char prev, char next) {
-  const char* word = "abcdefghijklmnopqrstuvwxyz"
-                     "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-                     "0123456789_";
-  if ( strchr(word, next) &&  prev == '\0') { return 1; }
-  if ( strchr(word, prev) &&  next == '\0') { return 1; }
-  if ( strchr(word, next) && !strchr(word, prev)) { return 1; }
-  if (!strchr(word, next) &&  strchr(word, prev)) { return 1; }
-  return 0;
 }
 
-static int mpc_boundary_newline_anchor(char prev, char next) {
-  (void)next;
-  return prev == '\n';
+static void mpc_undefine_and(mpc_parser_t *p) {
+
+  int i;
+  for (i = 0; i < p->data.and.n; i++) {
+    mpc_undefine_unretained(p->data.and.xs[i], 0);
+  }
+  free(p->data.and.xs);
+  free(p->data.and.dxs);
+
 }
 
-mpc_parser_t *mpc_boundary(void) { return mpc_expect(mpc_anchor(mpc_boundary_anchor), "word boundary"); }
-mpc_parser_t *mpc_boundary_newline(void) { return mpc_expect(mpc_anchor(mpc_boundary_newline_anchor), "start of newline"); }
+static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
 
-mpc_parser_t *mpc_whitespace(void) { return mpc_expect(mpc_oneof(" \f\n\r\t\v"), "whitespace"); }
-mpc_parser_t *mpc_whitespaces(void) { return mpc_expect(mpc_many(mpcf_strfold, mpc_whitespace()), "spaces"); }
-mpc_parser_t *mpc_blank(void) { return mpc_expect(mpc_apply(mpc_whitespaces(), mpcf_free), "whitespace"); }
+  if (p->retained && !force) { return; }
 
-mpc_parser_t *mpc_newline(void) { return mpc_expect(mpc_char('\n'), "newline"); }
-mpc_parser_t *mpc_tab(void) { return mpc_expect(mpc_char('\t'), "tab"); }
-mpc_parser_t *mpc_escape(void) { return mpc_and(2, mpcf_strfold, mpc_char('\\'), mpc_any(), free); }
+  switch (p->type) {
 
-mpc_parser_t *mpc_digit(void) { return mpc_expect(mpc_oneof("0123456789"), "digit"); }
-mpc_parser_t *mpc_hexdigit(void) { return mpc_expect(mpc_oneof("0123456789ABCDEFabcdef"), "hex digit"); }
-mpc_parser_t *mpc_octdigit(void) { return mpc_expect(mpc_oneof("01234567"), "oct digit"); }
-mpc_parser_t *mpc_digits(void) { return mpc_expect(mpc_many1(mpcf_strfold, mpc_digit()), "digits"); }
-mpc_parser_t *mpc_hexdigits(void) { return mpc_expect(mpc_many1(mpcf_strfold, mpc_hexdigit()), "hex digits"); }
-mpc_parser_t *mpc_octdigits(void) { return mpc_expect(mpc_many1(mpcf_strfold, mpc_octdigit()), "oct digits"); }
+    case MPC_TYPE_FAIL: free(p->data.fail.m); break;
 
-mpc_parser_t *mpc_lower(void) { return mpc_expect(mpc_oneof("abcdefghijklmnopqrstuvwxyz"), "lowercase letter"); }
-mpc_parser_t *mpc_upper(void) { return mpc_expect(mpc_oneof("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), "uppercase letter"); }
-mpc_parser_t *mpc_alpha(void) { return mpc_expect(mpc_oneof("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"), "letter"); }
-mpc_parser_t *mpc_underscore(void) { return mpc_expect(mpc_char('_'), "underscore"); }
-mpc_parser_t *mpc_alphanum(void) { return mpc_expect(mpc_or(3, mpc_alpha(), mpc_digit(), mpc_underscore()), "alphanumeric"); }
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+    case MPC_TYPE_STRING:
+      free(p->data.string.x);
+      break;
 
-mpc_parser_t *mpc_int(void) { return mpc_expect(mpc_apply(mpc_digits(), mpcf_int), "integer"); }
-mpc_parser_t *mpc_hex(void) { return mpc_expect(mpc_apply(mpc_hexdigits(), mpcf_hex), "hexadecimal"); }
-mpc_parser_t *mpc_oct(void) { return mpc_expect(mpc_apply(mpc_octdigits(), mpcf_oct), "octadecimal"); }
-mpc_parser_t *mpc_number(void) { return mpc_expect(mpc_or(3, mpc_int(), mpc_hex(), mpc_oct()), "number"); }
+    case MPC_TYPE_APPLY:    mpc_undefine_unretained(p->data.apply.x, 0);    break;
+    case MPC_TYPE_APPLY_TO: mpc_undefine_unretained(p->data.apply_to.x, 0); break;
+    case MPC_TYPE_PREDICT:  mpc_undefine_unretained(p->data.predict.x, 0);  break;
 
-mpc_parser_t *mpc_real(void) {
+    case MPC_TYPE_MAYBE:
+    case MPC_TYPE_NOT:
+      mpc_undefine_unretained(p->data.not.x, 0);
+      break;
 
-  /* [+-]?\d+(\.\d+)?([eE][+-]?[0-9]+)? */
+    case MPC_TYPE_EXPECT:
+      mpc_undefine_unretained(p->data.expect.x, 0);
+      free(p->data.expect.m);
+      break;
 
-  mpc_parser_t *p0, *p1, *p2, *p30, *p31, *p32, *p3;
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:
+      mpc_undefine_unretained(p->data.repeat.x, 0);
+      break;
 
-  p0 = mpc_maybe_lift(mpc_oneof("+-"), mpcf_ctor_str);
-  p1 = mpc_digits();
-  p2 = mpc_maybe_lift(mpc_and(2, mpcf_strfold, mpc_char('.'), mpc_digits(), free), mpcf_ctor_str);
-  p30 = mpc_oneof("eE");
-  p31 = mpc_maybe_lift(mpc_oneof("+-"), mpcf_ctor_str);
-  p32 = mpc_digits();
-  p3 = mpc_maybe_lift(mpc_and(3, mpcf_strfold, p30, p31, p32, free, free), mpcf_ctor_str);
+    case MPC_TYPE_SEPBY1:
+      mpc_undefine_unretained(p->data.sepby1.x, 0);
+      mpc_undefine_unretained(p->data.sepby1.sep, 0);
+      break;
 
-  return mpc_expect(mpc_and(4, mpcf_strfold, p0, p1, p2, p3, free, free, free), "real");
+    case MPC_TYPE_OR:  mpc_undefine_or(p);  break;
+    case MPC_TYPE_AND: mpc_undefine_and(p); break;
 
-}
+    case MPC_TYPE_CHECK:
+      mpc_undefine_unretained(p->data.check.x, 0);
+      free(p->data.check.e);
+      break;
+
+    case MPC_TYPE_CHECK_WITH:
+      mpc_undefine_unretained(p->data.check_with.x, 0);
+      free(p->data.check_with.e);
+      break;
+
+    case MPC_TYPE_DFA:
+      mpc_undefine_unretained(p->data.dfa.x, 0);
+      mpc_dfa_delete(p->data.dfa.d);
+      break;
+
+    default: break;
+  }
+
+  if (!force) {
+    free(p->name);
+    free(p);
+  }
 
-mpc_parser_t *mpc_float(void) {
-  return mpc_expect(mpc_apply(mpc_real(), mpcf_float), "float");
 }
 
-mpc_parser_t *mpc_char_lit(void) {
-  return mpc_expect(mpc_between(mpc_or(2, mpc_escape(), mpc_any()), free, "'", "'"), "char");
+void mpc_delete(mpc_parser_t *p) {
+  if (p->retained) {
+
+    if (p->type != MPC_TYPE_UNDEFINED) {
+      mpc_undefine_unretained(p, 0);
+    }
+
+    free(p->name);
+    free(p);
+
+  } else {
+    mpc_undefine_unretained(p, 0);
+  }
 }
 
-mpc_parser_t *mpc_string_lit(void) {
-  mpc_parser_t *strchar = mpc_or(2, mpc_escape(), mpc_noneof("\""));
-  return mpc_expect(mpc_between(mpc_many(mpcf_strfold, strchar), free, "\"", "\""), "string");
+static void mpc_soft_delete(mpc_val_t *x) {
+  mpc_undefine_unretained(x, 0);
 }
 
-mpc_parser_t *mpc_regex_lit(void) {
-  mpc_parser_t *regexchar = mpc_or(2, mpc_escape(), mpc_noneof("/"));
-  return mpc_expect(mpc_between(mpc_many(mpcf_strfold, regexchar), free, "/", "/"), "regex");
+static mpc_parser_t *mpc_undefined(void) {
+  mpc_parser_t *p = calloc(1, sizeof(mpc_parser_t));
+  p->retained = 0;
+  p->type = MPC_TYPE_UNDEFINED;
+  p->name = NULL;
+  return p;
 }
 
-mpc_parser_t *mpc_ident(void) {
-  mpc_parser_t *p0, *p1;
-  p0 = mpc_or(2, mpc_alpha(), mpc_underscore());
-  p1 = mpc_many(mpcf_strfold, mpc_alphanum());
-  return mpc_and(2, mpcf_strfold, p0, p1, free);
+mpc_parser_t *mpc_new(const char *name) {
+  mpc_parser_t *p = mpc_undefined();
+  p->retained = 1;
+  p->name = realloc(p->name, strlen(name) + 1);
+  strcpy(p->name, name);
+  return p;
 }
 
-/*
-** Useful Parsers
-*/
+mpc_parser_t *mpc_copy(mpc_parser_t *a) {
+  int i = 0;
+  mpc_parser_t *p;
 
-mpc_parser_t *mpc_startwith(mpc_parser_t *a) { return mpc_and(2, mpcf_snd, mpc_soi(), a, mpcf_dtor_null); }
-mpc_parser_t *mpc_endwith(mpc_parser_t *a, mpc_dtor_t da) { return mpc_and(2, mpcf_fst, a, mpc_eoi(), da); }
-mpc_parser_t *mpc_whole(mpc_parser_t *a, mpc_dtor_t da) { return mpc_and(3, mpcf_snd, mpc_soi(), a, mpc_eoi(), mpcf_dtor_null, da); }
+  if (a->retained) { return a; }
 
-mpc_parser_t *mpc_stripl(mpc_parser_t *a) { return mpc_and(2, mpcf_snd, mpc_blank(), a, mpcf_dtor_null); }
-mpc_parser_t *mpc_stripr(mpc_parser_t *a) { return mpc_and(2, mpcf_fst, a, mpc_blank(), mpcf_dtor_null); }
-mpc_parser_t *mpc_strip(mpc_parser_t *a) { return mpc_and(3, mpcf_snd, mpc_blank(), a, mpc_blank(), mpcf_dtor_null, mpcf_dtor_null); }
-mpc_parser_t *mpc_tok(mpc_parser_t *a) { return mpc_and(2, mpcf_fst, a, mpc_blank(), mpcf_dtor_null); }
-mpc_parser_t *mpc_sym(const char *s) { return mpc_tok(mpc_string(s)); }
+  p = mpc_undefined();
+  p->retained = a->retained;
+  p->type = a->type;
+  p->data = a->data;
+  p->id = a->id;
 
-mpc_parser_t *mpc_total(mpc_parser_t *a, mpc_dtor_t da) { return mpc_whole(mpc_strip(a), da); }
+  if (a->name) {
+    p->name = malloc(strlen(a->name)+1);
+    strcpy(p->name, a->name);
+  }
 
-mpc_parser_t *mpc_between(mpc_parser_t *a, mpc_dtor_t ad, const char *o, const char *c) {
-  return mpc_and(3, mpcf_snd_free,
-    mpc_string(o), a, mpc_string(c),
-    free, ad);
-}
+  switch (a->type) {
 
-mpc_parser_t *mpc_parens(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_between(a, ad, "(", ")"); }
-mpc_parser_t *mpc_braces(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_between(a, ad, "<", ">"); }
-mpc_parser_t *mpc_brackets(mpc_parser_t *a, mpc_dtor_t ad) { return mpc_between(a, ad, "{", "}"); }
-mpc_parser_t *mpc_squares(mpc_parser_t *a, mpc_dtor_t ad)  { return mpc_between(a, ad, "[", "]"); }
+    case MPC_TYPE_FAIL:
+      p->data.fail.m = malloc(strlen(a->data.fail.m)+1);
+      strcpy(p->data.fail.m, a->data.fail.m);
+    break;
 
-mpc_parser_t *mpc_tok_between(mpc_parser_t *a, mpc_dtor_t ad, const char *o, const char *c) {
-  return mpc_and(3, mpcf_snd_free,
-    mpc_sym(o), mpc_tok(a), mpc_sym(c),
-    free, ad);
-}
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+    case MPC_TYPE_STRING:
+      p->data.string.x = malloc(strlen(a->data.string.x)+1);
+      strcpy(p->data.string.x, a->data.string.x);
+      break;
 
-mpc_parser_t *mpc_tok_parens(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_tok_between(a, ad, "(", ")"); }
-mpc_parser_t *mpc_tok_braces(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_tok_between(a, ad, "<", ">"); }
-mpc_parser_t *mpc_tok_brackets(mpc_parser_t *a, mpc_dtor_t ad) { return mpc_tok_between(a, ad, "{", "}"); }
-mpc_parser_t *mpc_tok_squares(mpc_parser_t *a, mpc_dtor_t ad)  { return mpc_tok_between(a, ad, "[", "]"); }
+    case MPC_TYPE_APPLY:    p->data.apply.x    = mpc_copy(a->data.apply.x);    break;
+    case MPC_TYPE_APPLY_TO: p->data.apply_to.x = mpc_copy(a->data.apply_to.x); break;
+    case MPC_TYPE_PREDICT:  p->data.predict.x  = mpc_copy(a->data.predict.x);  break;
 
-/*
-** Regular Expression Parsers
-*/
+    case MPC_TYPE_MAYBE:
+    case MPC_TYPE_NOT:
+      p->data.not.x = mpc_copy(a->data.not.x);
+      break;
 
-/*
-** So here is a cute bootstrapping.
-**
-** I'm using the previously defined
-** mpc constructs and functions to
-** parse the user regex string and
-** construct a parser from it.
+    case MPC_TYPE_EXPECT:
+      p->data.expect.x = mpc_copy(a->data.expect.x);
+      p->data.expect.m = malloc(strlen(a->data.expect.m)+1);
+      strcpy(p->data.expect.m, a->data.expect.m);
+      break;
+
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:
+      p->data.repeat.x = mpc_copy(a->data.repeat.x);
+      break;
+
+    case MPC_TYPE_SEPBY1:
+      p->data.sepby1.x   = mpc_copy(a->data.sepby1.x);
+      p->data.sepby1.sep = mpc_copy(a->data.sepby1.sep);
+      break;
+
+    case MPC_TYPE_OR:
+      p->data.or.xs = malloc(a->data.or.n * sizeof(mpc_parser_t*));
+      for (i = 0; i < a->data.or.n; i++) {
+        p->data.or.xs[i] = mpc_copy(a->data.or.xs[i]);
+      }
+      if (a->data.or.first) {
+        p->data.or.first = malloc(a->data.or.n * 32);
+        p->data.or.jump = malloc(256);
+        memcpy(p->data.or.first, a->data.or.first, a->data.or.n * 32);
+        memcpy(p->data.or.jump, a->data.or.jump, 256);
+      }
+    break;
+    case MPC_TYPE_AND:
+      p->data.and.xs = malloc(a->data.and.n * sizeof(mpc_parser_t*));
+      for (i = 0; i < a->data.and.n; i++) {
+        p->data.and.xs[i] = mpc_copy(a->data.and.xs[i]);
+      }
+      if (a->data.and.n > 0) {
+          p->data.and.dxs = malloc((a->data.and.n-1) * sizeof(mpc_dtor_t));
+          for (i = 0; i < a->data.and.n-1; i++) {
+            p->data.and.dxs[i] = a->data.and.dxs[i];
+          }
+      }
+    break;
+
+    case MPC_TYPE_CHECK:
+      p->data.check.x      = mpc_copy(a->data.check.x);
+      p->data.check.e      = malloc(strlen(a->data.check.e)+1);
+      strcpy(p->data.check.e, a->data.check.e);
+      break;
+    case MPC_TYPE_CHECK_WITH:
+      p->data.check_with.x = mpc_copy(a->data.check_with.x);
+      p->data.check_with.e = malloc(strlen(a->data.check_with.e)+1);
+      strcpy(p->data.check_with.e, a->data.check_with.e);
+      break;
+
+    case MPC_TYPE_DFA:
+      p->data.dfa.x = mpc_copy(a->data.dfa.x);
+      p->data.dfa.d = mpc_dfa_compile(p->data.dfa.x);
+      break;
+
+    default: break;
+  }
+
+
+  return p;
+}
+
+mpc_parser_t *mpc_undefine(mpc_parser_t *p) {
+  mpc_undefine_unretained(p, 1);
+  p->type = MPC_TYPE_UNDEFINED;
+  return p;
+}
+
+mpc_parser_t *mpc_define(mpc_parser_t *p, mpc_parser_t *a) {
+
+  if (p->retained) {
+    p->type = a->type;
+    p->data = a->data;
+  } else {
+    mpc_parser_t *a2 = mpc_failf("Attempt to assign to Unretained Parser!");
+    p->type = a2->type;
+    p->data = a2->data;
+    free(a2);
+  }
+
+  free(a);
+  return p;
+}
+
+void mpc_cleanup(int n, ...) {
+  int i;
+  mpc_parser_t **list = malloc(sizeof(mpc_parser_t*) * n);
+
+  va_list va;
+  va_start(va, n);
+  for (i = 0; i < n; i++) { list[i] = va_arg(va, mpc_parser_t*); }
+  for (i = 0; i < n; i++) { mpc_undefine(list[i]); }
+  for (i = 0; i < n; i++) { mpc_delete(list[i]); }
+  va_end(va);
+
+  free(list);
+}
+
+mpc_parser_t *mpc_pass(void) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_PASS;
+  return p;
+}
+
+mpc_parser_t *mpc_fail(const char *m) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_FAIL;
+  p->data.fail.m = malloc(strlen(m) + 1);
+  strcpy(p->data.fail.m, m);
+  return p;
+}
+
+/*
+** As `snprintf` is not ANSI standard this
+** function `mpc_failf` should be considered
+** unsafe.
 **
-** As it turns out lots of the standard
-** mpc functions look a lot like `fold`
-** functions and so can be used indirectly
-** by many of the parsing functions to build
-** a parser directly - as we are parsing.
+** You have a few options if this is going to be
+** trouble.
 **
-** This is certainly something that
-** would be less elegant/interesting
-** in a two-phase parser which first
-** builds an AST and then traverses it
-** to generate the object.
+** - Ensure the format string does not exceed
+**   the buffer length using precision specifiers
+**   such as `%.512s`.
 **
-** This whole thing acts as a great
-** case study for how trivial it can be
-** to write a great parser in a few
-** lines of code using mpc.
+** - Patch this function in your code base to
+**   use `snprintf` or whatever variant your
+**   system supports.
+**
+** - Avoid it altogether.
+**
+*/
+
+mpc_parser_t *mpc_failf(const char *fmt, ...) {
+
+  va_list va;
+  char *buffer;
+
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_FAIL;
+
+  va_start(va, fmt);
+  buffer = malloc(2048);
+  if (!buffer) {
+    return NULL;
+  }
+  vsprintf(buffer, fmt, va);
+  va_end(va);
+
+  buffer = realloc(buffer, strlen(buffer) + 1);
+  p->data.fail.m = buffer;
+  return p;
+
+}
+
+mpc_parser_t *mpc_lift_val(mpc_val_t *x) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_LIFT_VAL;
+  p->data.lift.x = x;
+  return p;
+}
+
+mpc_parser_t *mpc_lift(mpc_ctor_t lf) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_LIFT;
+  p->data.lift.lf = lf;
+  return p;
+}
+
+mpc_parser_t *mpc_anchor(int(*f)(char,char)) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_ANCHOR;
+  p->data.anchor.f = f;
+  return mpc_expect(p, "anchor");
+}
+
+mpc_parser_t *mpc_state(void) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_STATE;
+  return p;
+}
+
+mpc_parser_t *mpc_expect(mpc_parser_t *a, const char *expected) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_EXPECT;
+  p->data.expect.x = a;
+  p->data.expect.m = malloc(strlen(expected) + 1);
+  strcpy(p->data.expect.m, expected);
+  return p;
+}
+
+/*
+** As `snprintf` is not ANSI standard this
+** function `mpc_expectf` should be considered
+** unsafe.
+**
+** You have a few options if this is going to be
+** trouble.
+**
+** - Ensure the format string does not exceed
+**   the buffer length using precision specifiers
+**   such as `%.512s`.
+**
+** - Patch this function in your code base to
+**   use `snprintf` or whatever variant your
+**   system supports.
+**
+** - Avoid it altogether.
+**
+*/
+
+mpc_parser_t *mpc_expectf(mpc_parser_t *a, const char *fmt, ...) {
+  va_list va;
+  char *buffer;
+
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_EXPECT;
+
+  va_start(va, fmt);
+  buffer = malloc(2048);
+  if (!buffer) {
+    return NULL;
+  }
+  vsprintf(buffer, fmt, va);
+  va_end(va);
+
+  buffer = realloc(buffer, strlen(buffer) + 1);
+  p->data.expect.x = a;
+  p->data.expect.m = buffer;
+  return p;
+}
+
+/* Wraps x with its transition table when it has one */
+static mpc_parser_t *mpc_dfa(mpc_parser_t *x) {
+  mpc_parser_t *p;
+  mpc_dfa_t *d = mpc_dfa_compile(x);
+  if (d == NULL) { return x; }
+  p = mpc_undefined();
+  p->type = MPC_TYPE_DFA;
+  p->data.dfa.x = x;
+  p->data.dfa.d = d;
+  return p;
+}
+
+/*
+** Basic Parsers
 */
 
-/*
-**
-**  ### Regular Expression Grammar
-**
-**      <regex> : <term> | (<term> "|" <regex>)
-**
-**      <term> : <factor>*
-**
-**      <factor> : <base>
-**               | <base> "*"
-**               | <base> "+"
-**               | <base> "?"
-**               | <base> "{" <digits> "}"
-**
-**      <base> : <char>
-**             | "\" <char>
-**             | "(" <regex> ")"
-**             | "[" <range> "]"
-*/
+mpc_parser_t *mpc_any(void) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_ANY;
+  return mpc_expect(p, "any character");
+}
+
+mpc_parser_t *mpc_char(char c) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_SINGLE;
+  p->data.single.x = c;
+  return mpc_expectf(p, "'%c'", c);
+}
+
+mpc_parser_t *mpc_range(char s, char e) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_RANGE;
+  p->data.range.x = s;
+  p->data.range.y = e;
+  return mpc_expectf(p, "character between '%c' and '%c'", s, e);
+}
+
+mpc_parser_t *mpc_oneof(const char *s) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_ONEOF;
+  p->data.string.x = malloc(strlen(s) + 1);
+  strcpy(p->data.string.x, s);
+  return mpc_expectf(p, "one of '%s'", s);
+}
+
+mpc_parser_t *mpc_noneof(const char *s) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_NONEOF;
+  p->data.string.x = malloc(strlen(s) + 1);
+  strcpy(p->data.string.x, s);
+  return mpc_expectf(p, "none of '%s'", s);
+
+}
+
+mpc_parser_t *mpc_satisfy(int(*f)(char)) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_SATISFY;
+  p->data.satisfy.f = f;
+  return mpc_expectf(p, "character satisfying function %p", f);
+}
+
+mpc_parser_t *mpc_string(const char *s) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_STRING;
+  p->data.string.x = malloc(strlen(s) + 1);
+  strcpy(p->data.string.x, s);
+  return mpc_expectf(p, "\"%s\"", s);
+}
+
+/*
+** Core Parsers
+*/
+
+mpc_parser_t *mpc_apply(mpc_parser_t *a, mpc_apply_t f) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_APPLY;
+  p->data.apply.x = a;
+  p->data.apply.f = f;
+  return p;
+}
+
+mpc_parser_t *mpc_apply_to(mpc_parser_t *a, mpc_apply_to_t f, void *x) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_APPLY_TO;
+  p->data.apply_to.x = a;
+  p->data.apply_to.f = f;
+  p->data.apply_to.d = x;
+  return p;
+}
+
+mpc_parser_t *mpc_check(mpc_parser_t *a, mpc_dtor_t da, mpc_check_t f, const char *e) {
+  mpc_parser_t  *p = mpc_undefined();
+  p->type = MPC_TYPE_CHECK;
+  p->data.check.x = a;
+  p->data.check.dx = da;
+  p->data.check.f = f;
+  p->data.check.e = malloc(strlen(e) + 1);
+  strcpy(p->data.check.e, e);
+  return p;
+}
+
+mpc_parser_t *mpc_check_with(mpc_parser_t *a, mpc_dtor_t da, mpc_check_with_t f, void *x, const char *e) {
+  mpc_parser_t  *p = mpc_undefined();
+  p->type = MPC_TYPE_CHECK_WITH;
+  p->data.check_with.x = a;
+  p->data.check_with.dx = da;
+  p->data.check_with.f = f;
+  p->data.check_with.d = x;
+  p->data.check_with.e = malloc(strlen(e) + 1);
+  strcpy(p->data.check_with.e, e);
+  return p;
+}
+
+mpc_parser_t *mpc_checkf(mpc_parser_t *a, mpc_dtor_t da, mpc_check_t f, const char *fmt, ...) {
+  va_list va;
+  char *buffer;
+  mpc_parser_t *p;
+
+  va_start(va, fmt);
+  buffer = malloc(2048);
+  vsprintf(buffer, fmt, va);
+  va_end(va);
+
+  p = mpc_check(a, da, f, buffer);
+  free(buffer);
+
+  return p;
+}
+
+mpc_parser_t *mpc_check_withf(mpc_parser_t *a, mpc_dtor_t da, mpc_check_with_t f, void *x, const char *fmt, ...) {
+  va_list va;
+  char *buffer;
+  mpc_parser_t *p;
+
+  va_start(va, fmt);
+  buffer = malloc(2048);
+  vsprintf(buffer, fmt, va);
+  va_end(va);
+
+  p = mpc_check_with(a, da, f, x, buffer);
+  free(buffer);
+
+  return p;
+}
+
+mpc_parser_t *mpc_predictive(mpc_parser_t *a) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_PREDICT;
+  p->data.predict.x = a;
+  return p;
+}
+
+mpc_parser_t *mpc_not_lift(mpc_parser_t *a, mpc_dtor_t da, mpc_ctor_t lf) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_NOT;
+  p->data.not.x = a;
+  p->data.not.dx = da;
+  p->data.not.lf = lf;
+  return p;
+}
+
+mpc_parser_t *mpc_not(mpc_parser_t *a, mpc_dtor_t da) {
+  return mpc_not_lift(a, da, mpcf_ctor_null);
+}
+
+mpc_parser_t *mpc_maybe_lift(mpc_parser_t *a, mpc_ctor_t lf) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_MAYBE;
+  p->data.not.x = a;
+  p->data.not.lf = lf;
+  return p;
+}
+
+mpc_parser_t *mpc_maybe(mpc_parser_t *a) {
+  return mpc_maybe_lift(a, mpcf_ctor_null);
+}
+
+mpc_parser_t *mpc_many(mpc_fold_t f, mpc_parser_t *a) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_MANY;
+  p->data.repeat.x = a;
+  p->data.repeat.f = f;
+  return p;
+}
+
+mpc_parser_t *mpc_many1(mpc_fold_t f, mpc_parser_t *a) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_MANY1;
+  p->data.repeat.x = a;
+  p->data.repeat.f = f;
+  return p;
+}
+
+mpc_parser_t *mpc_count(int n, mpc_fold_t f, mpc_parser_t *a, mpc_dtor_t da) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_COUNT;
+  p->data.repeat.n = n;
+  p->data.repeat.f = f;
+  p->data.repeat.x = a;
+  p->data.repeat.dx = da;
+  return p;
+}
+
+mpc_parser_t *mpc_sepby1(mpc_fold_t f, mpc_parser_t *sep, mpc_parser_t *a) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_SEPBY1;
+  p->data.sepby1.x   = a;
+  p->data.sepby1.f   = f;
+  p->data.sepby1.sep = sep;
+  return p;
+}
+
+mpc_parser_t *mpc_or(int n, ...) {
+
+  int i;
+  va_list va;
+
+  mpc_parser_t *p = mpc_undefined();
+
+  p->type = MPC_TYPE_OR;
+  p->data.or.n = n;
+  p->data.or.xs = malloc(sizeof(mpc_parser_t*) * n);
+  p->data.or.first = NULL;
+  p->data.or.jump = NULL;
+
+  va_start(va, n);
+  for (i = 0; i < n; i++) {
+    p->data.or.xs[i] = va_arg(va, mpc_parser_t*);
+  }
+  va_end(va);
+
+  return p;
+}
+
+mpc_parser_t *mpc_and(int n, mpc_fold_t f, ...) {
+
+  int i;
+  va_list va;
+
+  mpc_parser_t *p = mpc_undefined();
+
+  p->type = MPC_TYPE_AND;
+  p->data.and.n = n;
+  p->data.and.f = f;
+  p->data.and.xs = malloc(sizeof(mpc_parser_t*) * n);
+  p->data.and.dxs = malloc(sizeof(mpc_dtor_t) * (n-1));
+
+  va_start(va, f);
+  for (i = 0; i < n; i++) {
+    p->data.and.xs[i] = va_arg(va, mpc_parser_t*);
+  }
+  for (i = 0; i < (n-1); i++) {
+    p->data.and.dxs[i] = va_arg(va, mpc_dtor_t);
+  }
+  va_end(va);
+
+  return p;
+}
+
+/*
+** Common Parsers
+*/
+
+mpc_parser_t *mpc_soi(void) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_SOI;
+  return mpc_expect(p, "start of input");
+}
+
+mpc_parser_t *mpc_eoi(void) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_EOI;
+  return mpc_expect(p, "end of input");
+}
+
+static int mpc_boundary_anchor(char prev, char next) {
+  const char* word = "abcdefghijklmnopqrstuvwxyz"
+                     "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                     "0123456789_";
+  if ( strchr(word, next) &&  prev == '\0') { return 1; }
+  if ( strchr(word, prev) &&  next == '\0') { return 1; }
+  if ( strchr(word, next) && !strchr(word, prev)) { return 1; }
+  if (!strchr(word, next) &&  strchr(word, prev)) { return 1; }
+  return 0;
+}
+
+static int mpc_boundary_newline_anchor(char prev, char next) {
+  (void)next;
+  return prev == '\n';
+}
+
+mpc_parser_t *mpc_boundary(void) { return mpc_expect(mpc_anchor(mpc_boundary_anchor), "word boundary"); }
+mpc_parser_t *mpc_boundary_newline(void) { return mpc_expect(mpc_anchor(mpc_boundary_newline_anchor), "start of newline"); }
+
+mpc_parser_t *mpc_whitespace(void) { return mpc_expect(mpc_oneof(" \f\n\r\t\v"), "whitespace"); }
+mpc_parser_t *mpc_whitespaces(void) { return mpc_expect(mpc_dfa(mpc_many(mpcf_strfold, mpc_whitespace())), "spaces"); }
+mpc_parser_t *mpc_blank(void) { return mpc_expect(mpc_apply(mpc_whitespaces(), mpcf_free), "whitespace"); }
+
+mpc_parser_t *mpc_newline(void) { return mpc_expect(mpc_char('\n'), "newline"); }
+mpc_parser_t *mpc_tab(void) { return mpc_expect(mpc_char('\t'), "tab"); }
+mpc_parser_t *mpc_escape(void) { return mpc_and(2, mpcf_strfold, mpc_char('\\'), mpc_any(), free); }
+
+mpc_parser_t *mpc_digit(void) { return mpc_expect(mpc_oneof("0123456789"), "digit"); }
+mpc_parser_t *mpc_hexdigit(void) { return mpc_expect(mpc_oneof("0123456789ABCDEFabcdef"), "hex digit"); }
+mpc_parser_t *mpc_octdigit(void) { return mpc_expect(mpc_oneof("01234567"), "oct digit"); }
+mpc_parser_t *mpc_digits(void) { return mpc_expect(mpc_many1(mpcf_strfold, mpc_digit()), "digits"); }
+mpc_parser_t *mpc_hexdigits(void) { return mpc_expect(mpc_many1(mpcf_strfold, mpc_hexdigit()), "hex digits"); }
+mpc_parser_t *mpc_octdigits(void) { return mpc_expect(mpc_many1(mpcf_strfold, mpc_octdigit()), "oct digits"); }
+
+mpc_parser_t *mpc_lower(void) { return mpc_expect(mpc_oneof("abcdefghijklmnopqrstuvwxyz"), "lowercase letter"); }
+mpc_parser_t *mpc_upper(void) { return mpc_expect(mpc_oneof("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), "uppercase letter"); }
+mpc_parser_t *mpc_alpha(void) { return mpc_expect(mpc_oneof("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"), "letter"); }
+mpc_parser_t *mpc_underscore(void) { return mpc_expect(mpc_char('_'), "underscore"); }
+mpc_parser_t *mpc_alphanum(void) { return mpc_expect(mpc_or(3, mpc_alpha(), mpc_digit(), mpc_underscore()), "alphanumeric"); }
+
+mpc_parser_t *mpc_int(void) { return mpc_expect(mpc_apply(mpc_digits(), mpcf_int), "integer"); }
+mpc_parser_t *mpc_hex(void) { return mpc_expect(mpc_apply(mpc_hexdigits(), mpcf_hex), "hexadecimal"); }
+mpc_parser_t *mpc_oct(void) { return mpc_expect(mpc_apply(mpc_octdigits(), mpcf_oct), "octadecimal"); }
+mpc_parser_t *mpc_number(void) { return mpc_expect(mpc_or(3, mpc_int(), mpc_hex(), mpc_oct()), "number"); }
+
+mpc_parser_t *mpc_real(void) {
+
+  /* [+-]?\d+(\.\d+)?([eE][+-]?[0-9]+)? */
+
+  mpc_parser_t *p0, *p1, *p2, *p30, *p31, *p32, *p3;
+
+  p0 = mpc_maybe_lift(mpc_oneof("+-"), mpcf_ctor_str);
+  p1 = mpc_digits();
+  p2 = mpc_maybe_lift(mpc_and(2, mpcf_strfold, mpc_char('.'), mpc_digits(), free), mpcf_ctor_str);
+  p30 = mpc_oneof("eE");
+  p31 = mpc_maybe_lift(mpc_oneof("+-"), mpcf_ctor_str);
+  p32 = mpc_digits();
+  p3 = mpc_maybe_lift(mpc_and(3, mpcf_strfold, p30, p31, p32, free, free), mpcf_ctor_str);
+
+  return mpc_expect(mpc_and(4, mpcf_strfold, p0, p1, p2, p3, free, free, free), "real");
+
+}
+
+mpc_parser_t *mpc_float(void) {
+  return mpc_expect(mpc_apply(mpc_real(), mpcf_float), "float");
+}
+
+mpc_parser_t *mpc_char_lit(void) {
+  return mpc_expect(mpc_between(mpc_or(2, mpc_escape(), mpc_any()), free, "'", "'"), "char");
+}
+
+mpc_parser_t *mpc_string_lit(void) {
+  mpc_parser_t *strchar = mpc_or(2, mpc_escape(), mpc_noneof("\""));
+  return mpc_expect(mpc_between(mpc_many(mpcf_strfold, strchar), free, "\"", "\""), "string");
+}
+
+mpc_parser_t *mpc_regex_lit(void) {
+  mpc_parser_t *regexchar = mpc_or(2, mpc_escape(), mpc_noneof("/"));
+  return mpc_expect(mpc_between(mpc_many(mpcf_strfold, regexchar), free, "/", "/"), "regex");
+}
+
+mpc_parser_t *mpc_ident(void) {
+  mpc_parser_t *p0, *p1;
+  p0 = mpc_or(2, mpc_alpha(), mpc_underscore());
+  p1 = mpc_many(mpcf_strfold, mpc_alphanum());
+  return mpc_and(2, mpcf_strfold, p0, p1, free);
+}
+
+/*
+** Useful Parsers
+*/
+
+mpc_parser_t *mpc_startwith(mpc_parser_t *a) { return mpc_and(2, mpcf_snd, mpc_soi(), a, mpcf_dtor_null); }
+mpc_parser_t *mpc_endwith(mpc_parser_t *a, mpc_dtor_t da) { return mpc_and(2, mpcf_fst, a, mpc_eoi(), da); }
+mpc_parser_t *mpc_whole(mpc_parser_t *a, mpc_dtor_t da) { return mpc_and(3, mpcf_snd, mpc_soi(), a, mpc_eoi(), mpcf_dtor_null, da); }
+
+mpc_parser_t *mpc_stripl(mpc_parser_t *a) { return mpc_and(2, mpcf_snd, mpc_blank(), a, mpcf_dtor_null); }
+mpc_parser_t *mpc_stripr(mpc_parser_t *a) { return mpc_and(2, mpcf_fst, a, mpc_blank(), mpcf_dtor_null); }
+mpc_parser_t *mpc_strip(mpc_parser_t *a) { return mpc_and(3, mpcf_snd, mpc_blank(), a, mpc_blank(), mpcf_dtor_null, mpcf_dtor_null); }
+mpc_parser_t *mpc_tok(mpc_parser_t *a) { return mpc_and(2, mpcf_fst, a, mpc_blank(), mpcf_dtor_null); }
+mpc_parser_t *mpc_sym(const char *s) { return mpc_tok(mpc_string(s)); }
+
+mpc_parser_t *mpc_total(mpc_parser_t *a, mpc_dtor_t da) { return mpc_whole(mpc_strip(a), da); }
+
+mpc_parser_t *mpc_between(mpc_parser_t *a, mpc_dtor_t ad, const char *o, const char *c) {
+  return mpc_and(3, mpcf_snd_free,
+    mpc_string(o), a, mpc_string(c),
+    free, ad);
+}
+
+mpc_parser_t *mpc_parens(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_between(a, ad, "(", ")"); }
+mpc_parser_t *mpc_braces(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_between(a, ad, "<", ">"); }
+mpc_parser_t *mpc_brackets(mpc_parser_t *a, mpc_dtor_t ad) { return mpc_between(a, ad, "{", "}"); }
+mpc_parser_t *mpc_squares(mpc_parser_t *a, mpc_dtor_t ad)  { return mpc_between(a, ad, "[", "]"); }
+
+mpc_parser_t *mpc_tok_between(mpc_parser_t *a, mpc_dtor_t ad, const char *o, const char *c) {
+  return mpc_and(3, mpcf_snd_free,
+    mpc_sym(o), mpc_tok(a), mpc_sym(c),
+    free, ad);
+}
+
+mpc_parser_t *mpc_tok_parens(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_tok_between(a, ad, "(", ")"); }
+mpc_parser_t *mpc_tok_braces(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_tok_between(a, ad, "<", ">"); }
+mpc_parser_t *mpc_tok_brackets(mpc_parser_t *a, mpc_dtor_t ad) { return mpc_tok_between(a, ad, "{", "}"); }
+mpc_parser_t *mpc_tok_squares(mpc_parser_t *a, mpc_dtor_t ad)  { return mpc_tok_between(a, ad, "[", "]"); }
+
+/*
+** Regular Expression Parsers
+*/
+
+/*
+** So here is a cute bootstrapping.
+**
+** I'm using the previously defined
+** mpc constructs and functions to
+** parse the user regex string and
+** construct a parser from it.
+**
+** As it turns out lots of the standard
+** mpc functions look a lot like `fold`
+** functions and so can be used indirectly
+** by many of the parsing functions to build
+** a parser directly - as we are parsing.
+**
+** This is certainly something that
+** would be less elegant/interesting
+** in a two-phase parser which first
+** builds an AST and then traverses it
+** to generate the object.
+**
+** This whole thing acts as a great
+** case study for how trivial it can be
+** to write a great parser in a few
+** lines of code using mpc.
+*/
+
+/*
+**
+**  ### Regular Expression Grammar
+**
+**      <regex> : <term> | (<term> "|" <regex>)
+**
+**      <term> : <factor>*
+**
+**      <factor> : <base>
+**               | <base> "*"
+**               | <base> "+"
+**               | <base> "?"
+**               | <base> "{" <digits> "}"
+**
+**      <base> : <char>
+**             | "\" <char>
+**             | "(" <regex> ")"
+**             | "[" <range> "]"
+*/
+
+static mpc_val_t *mpcf_re_or(int n, mpc_val_t **xs) {
+  (void) n;
+  if (xs[1] == NULL) { return xs[0]; }
+  else { return mpc_or(2, xs[0], xs[1]); }
+}
+
+static mpc_val_t *mpcf_re_and(int n, mpc_val_t **xs) {
+  int i;
+  mpc_parser_t *p = mpc_lift(mpcf_ctor_str);
+  for (i = 0; i < n; i++) {
+    p = mpc_and(2, mpcf_strfold, p, xs[i], free);
+  }
+  return p;
+}
+
+static mpc_val_t *mpcf_re_repeat(int n, mpc_val_t **xs) {
+  int num;
+  (void) n;
+  if (xs[1] == NULL) { return xs[0]; }
+  switch(((char*)xs[1])[0])
+  {
+    case '*': { free(xs[1]); return mpc_many(mpcf_strfold, xs[0]); }; break;
+    case '+': { free(xs[1]); return mpc_many1(mpcf_strfold, xs[0]); }; break;
+    case '?': { free(xs[1]); return mpc_maybe_lift(xs[0], mpcf_ctor_str); }; break;
+    default:
+      num = *(int*)xs[1];
+      free(xs[1]);
+  }
+
+  return mpc_count(num, mpcf_strfold, xs[0], free);
+}
+
+static mpc_parser_t *mpc_re_escape_char(char c) {
+  switch (c) {
+    case 'a': return mpc_char('\a');
+    case 'f': return mpc_char('\f');
+    case 'n': return mpc_char('\n');
+    case 'r': return mpc_char('\r');
+    case 't': return mpc_char('\t');
+    case 'v': return mpc_char('\v');
+    case 'b': return mpc_and(2, mpcf_snd, mpc_boundary(), mpc_lift(mpcf_ctor_str), free);
+    case 'B': return mpc_not_lift(mpc_boundary(), free, mpcf_ctor_str);
+    case 'A': return mpc_and(2, mpcf_snd, mpc_soi(), mpc_lift(mpcf_ctor_str), free);
+    case 'Z': return mpc_and(2, mpcf_snd, mpc_eoi(), mpc_lift(mpcf_ctor_str), free);
+    case 'd': return mpc_digit();
+    case 'D': return mpc_not_lift(mpc_digit(), free, mpcf_ctor_str);
+    case 's': return mpc_whitespace();
+    case 'S': return mpc_not_lift(mpc_whitespace(), free, mpcf_ctor_str);
+    case 'w': return mpc_alphanum();
+    case 'W': return mpc_not_lift(mpc_alphanum(), free, mpcf_ctor_str);
+    default: return NULL;
+  }
+}
+
+static mpc_val_t *mpcf_re_escape(mpc_val_t *x, void* data) {
+
+  int mode = *((int*)data);
+  char *s = x;
+  mpc_parser_t *p;
+
+  /* Any Character */
+  if (s[0] == '.') {
+    free(s);
+    if (mode & MPC_RE_DOTALL) {
+      return mpc_any();
+    } else {
+      return mpc_expect(mpc_noneof("\n"), "any character except a newline");
+    }
+  }
+
+  /* Start of Input */
+  if (s[0] == '^') {
+    free(s);
+    if (mode & MPC_RE_MULTILINE) {
+      return mpc_and(2, mpcf_snd, mpc_or(2, mpc_soi(), mpc_boundary_newline()), mpc_lift(mpcf_ctor_str), free);
+    } else {
+      return mpc_and(2, mpcf_snd, mpc_soi(), mpc_lift(mpcf_ctor_str), free);
+    }
+  }
+
+  /* End of Input */
+  if (s[0] == '$') {
+    free(s);
+    if (mode & MPC_RE_MULTILINE) {
+      return mpc_or(2,
+        mpc_newline(),
+        mpc_and(2, mpcf_snd, mpc_eoi(), mpc_lift(mpcf_ctor_str), free));
+    } else {
+      return mpc_or(2,
+        mpc_and(2, mpcf_fst, mpc_newline(), mpc_eoi(), free),
+        mpc_and(2, mpcf_snd, mpc_eoi(), mpc_lift(mpcf_ctor_str), free));
+    }
+  }
+
+  /* Regex Escape */
+  if (s[0] == '\\') {
+    p = mpc_re_escape_char(s[1]);
+    p = (p == NULL) ? mpc_char(s[1]) : p;
+    free(s);
+    return p;
+  }
+
+  /* Regex Standard */
+  p = mpc_char(s[0]);
+  free(s);
+  return p;
+}
+
+static const char *mpc_re_range_escape_char(char c) {
+  switch (c) {
+    case '-': return "-";
+    case 'a': return "\a";
+    case 'f': return "\f";
+    case 'n': return "\n";
+    case 'r': return "\r";
+    case 't': return "\t";
+    case 'v': return "\v";
+    case 'b': return "\b";
+    case 'd': return "0123456789";
+    case 's': return " \f\n\r\t\v";
+    case 'w': return "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+    default: return NULL;
+  }
+}
+
+static mpc_val_t *mpcf_re_range(mpc_val_t *x) {
+
+  mpc_parser_t *out;
+  size_t i, j;
+  size_t start, end;
+  const char *tmp = NULL;
+  const char *s = x;
+  int comp = s[0] == '^' ? 1 : 0;
+  char *range = calloc(1,1);
+
+  if (s[0] == '\0') { free(range); free(x); return mpc_fail("Invalid Regex Range Expression"); }
+  if (s[0] == '^' &&
+      s[1] == '\0') { free(range); free(x); return mpc_fail("Invalid Regex Range Expression"); }
+
+  for (i = comp; i < strlen(s); i++){
+
+    /* Regex Range Escape */
+    if (s[i] == '\\') {
+      tmp = mpc_re_range_escape_char(s[i+1]);
+      if (tmp != NULL) {
+        range = realloc(range, strlen(range) + strlen(tmp) + 1);
+        strcat(range, tmp);
+      } else {
+        range = realloc(range, strlen(range) + 1 + 1);
+        range[strlen(range) + 1] = '\0';
+        range[strlen(range) + 0] = s[i+1];
+      }
+      i++;
+    }
+
+    /* Regex Range...Range */
+    else if (s[i] == '-') {
+      if (s[i+1] == '\0' || i == 0) {
+          range = realloc(range, strlen(range) + strlen("-") + 1);
+          strcat(range, "-");
+      } else {
+        start = s[i-1]+1;
+        end = s[i+1]-1;
+        for (j = start; j <= end; j++) {
+          range = realloc(range, strlen(range) + 1 + 1 + 1);
+          range[strlen(range) + 1] = '\0';
+          range[strlen(range) + 0] = (char)j;
+        }
+      }
+    }
+
+    /* Regex Range Normal */
+    else {
+      range = realloc(range, strlen(range) + 1 + 1);
+      range[strlen(range) + 1] = '\0';
+      range[strlen(range) + 0] = s[i];
+    }
+
+  }
+
+  out = comp == 1 ? mpc_noneof(range) : mpc_oneof(range);
+
+  free(x);
+  free(range);
+
+  return out;
+}
+
+mpc_parser_t *mpc_re(const char *re) {
+  return mpc_re_mode(re, MPC_RE_DEFAULT);
+}
+
+mpc_parser_t *mpc_re_mode(const char *re, int mode) {
+
+  char *err_msg;
+  mpc_parser_t *err_out;
+  mpc_result_t r;
+  mpc_parser_t *Regex, *Term, *Factor, *Base, *Range, *RegexEnclose;
+
+  Regex  = mpc_new("regex");
+  Term   = mpc_new("term");
+  Factor = mpc_new("factor");
+  Base   = mpc_new("base");
+  Range  = mpc_new("range");
+
+  mpc_define(Regex, mpc_and(2, mpcf_re_or,
+    Term,
+    mpc_maybe(mpc_and(2, mpcf_snd_free, mpc_char('|'), Regex, free)),
+    (mpc_dtor_t)mpc_delete
+  ));
+
+  mpc_define(Term, mpc_many(mpcf_re_and, Factor));
+
+  mpc_define(Factor, mpc_and(2, mpcf_re_repeat,
+    Base,
+    mpc_or(5,
+      mpc_char('*'), mpc_char('+'), mpc_char('?'),
+      mpc_brackets(mpc_int(), free),
+      mpc_pass()),
+    (mpc_dtor_t)mpc_delete
+  ));
+
+  mpc_define(Base, mpc_or(4,
+    mpc_parens(Regex, (mpc_dtor_t)mpc_delete),
+    mpc_squares(Range, (mpc_dtor_t)mpc_delete),
+    mpc_apply_to(mpc_escape(), mpcf_re_escape, &mode),
+    mpc_apply_to(mpc_noneof(")|"), mpcf_re_escape, &mode)
+  ));
+
+  mpc_define(Range, mpc_apply(
+    mpc_many(mpcf_strfold, mpc_or(2, mpc_escape(), mpc_noneof("]"))),
+    mpcf_re_range
+  ));
+
+  RegexEnclose = mpc_whole(mpc_predictive(Regex), (mpc_dtor_t)mpc_delete);
+
+  mpc_optimise(RegexEnclose);
+  mpc_optimise(Regex);
+  mpc_optimise(Term);
+  mpc_optimise(Factor);
+  mpc_optimise(Base);
+  mpc_optimise(Range);
+
+  if(!mpc_parse("<mpc_re_compiler>", re, RegexEnclose, &r)) {
+    err_msg = mpc_err_string(r.error);
+    err_out = mpc_failf("Invalid Regex: %s", err_msg);
+    mpc_err_delete(r.error);
+    free(err_msg);
+    r.output = err_out;
+  }
+
+  mpc_cleanup(6, RegexEnclose, Regex, Term, Factor, Base, Range);
+
+  mpc_optimise(r.output);
+
+  return mpc_dfa(r.output);
+
+}
+
+/*
+** Common Fold Functions
+*/
+
+void mpcf_dtor_null(mpc_val_t *x) { (void) x; return; }
+
+mpc_val_t *mpcf_ctor_null(void) { return NULL; }
+mpc_val_t *mpcf_ctor_str(void) { return calloc(1, 1); }
+mpc_val_t *mpcf_free(mpc_val_t *x) { free(x); return NULL; }
+
+mpc_val_t *mpcf_int(mpc_val_t *x) {
+  int *y = malloc(sizeof(int));
+  *y = strtol(x, NULL, 10);
+  free(x);
+  return y;
+}
+
+mpc_val_t *mpcf_hex(mpc_val_t *x) {
+  int *y = malloc(sizeof(int));
+  *y = strtol(x, NULL, 16);
+  free(x);
+  return y;
+}
+
+mpc_val_t *mpcf_oct(mpc_val_t *x) {
+  int *y = malloc(sizeof(int));
+  *y = strtol(x, NULL, 8);
+  free(x);
+  return y;
+}
+
+mpc_val_t *mpcf_float(mpc_val_t *x) {
+  float *y = malloc(sizeof(float));
+  *y = strtod(x, NULL);
+  free(x);
+  return y;
+}
+
+mpc_val_t *mpcf_strtriml(mpc_val_t *x) {
+  char *s = x;
+  while (isspace((unsigned char)*s)) {
+    memmove(s, s+1, strlen(s));
+  }
+  return s;
+}
+
+mpc_val_t *mpcf_strtrimr(mpc_val_t *x) {
+  char *s = x;
+  size_t l = strlen(s);
+  while (l > 0 && isspace((unsigned char)s[l-1])) {
+    s[l-1] = '\0'; l--;
+  }
+  return s;
+}
+
+mpc_val_t *mpcf_strtrim(mpc_val_t *x) {
+  return mpcf_strtriml(mpcf_strtrimr(x));
+}
+
+static const char mpc_escape_input_c[]  = {
+  '\a', '\b', '\f', '\n', '\r',
+  '\t', '\v', '\\', '\'', '\"', '\0'};
+
+static const char *mpc_escape_output_c[] = {
+  "\\a", "\\b", "\\f", "\\n", "\\r", "\\t",
+  "\\v", "\\\\", "\\'", "\\\"", "\\0", NULL};
+
+static const char mpc_escape_input_raw_re[] = { '/' };
+static const char *mpc_escape_output_raw_re[] = { "\\/", NULL };
+
+static const char mpc_escape_input_raw_cstr[] = { '"' };
+static const char *mpc_escape_output_raw_cstr[] = { "\\\"", NULL };
+
+static const char mpc_escape_input_raw_cchar[] = { '\'' };
+static const char *mpc_escape_output_raw_cchar[] = { "\\'", NULL };
+
+static mpc_val_t *mpcf_escape_new(mpc_val_t *x, const char *input, const char **output) {
+
+  int i;
+  int found;
+  char buff[2];
+  char *s = x;
+  char *y = calloc(1, 1);
+
+  while (*s) {
+
+    i = 0;
+    found = 0;
+
+    while (output[i]) {
+      if (*s == input[i]) {
+        y = realloc(y, strlen(y) + strlen(output[i]) + 1);
+        strcat(y, output[i]);
+        found = 1;
+        break;
+      }
+      i++;
+    }
+
+    if (!found) {
+      y = realloc(y, strlen(y) + 2);
+      buff[0] = *s; buff[1] = '\0';
+      strcat(y, buff);
+    }
+
+    s++;
+  }
+
+
+  return y;
+}
+
+static mpc_val_t *mpcf_unescape_new(mpc_val_t *x, const char *input, const char **output) {
+
+  int i;
+  int found = 0;
+  char buff[2];
+  char *s = x;
+  char *y = calloc(1, 1);
+
+  while (*s) {
+
+    i = 0;
+    found = 0;
+
+    while (output[i]) {
+      if ((*(s+0)) == output[i][0] &&
+          (*(s+1)) == output[i][1]) {
+        y = realloc(y, strlen(y) + 1 + 1);
+        buff[0] = input[i]; buff[1] = '\0';
+        strcat(y, buff);
+        found = 1;
+        s++;
+        break;
+      }
+      i++;
+    }
+
+    if (!found) {
+      y = realloc(y, strlen(y) + 1 + 1);
+      buff[0] = *s; buff[1] = '\0';
+      strcat(y, buff);
+    }
+
+    if (*s == '\0') { break; }
+    else { s++; }
+  }
+
+  return y;
+
+}
+
+mpc_val_t *mpcf_escape(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_c, mpc_escape_output_c);
+  free(x);
+  return y;
+}
+
+mpc_val_t *mpcf_unescape(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_c, mpc_escape_output_c);
+  free(x);
+  return y;
+}
+
+mpc_val_t *mpcf_escape_regex(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_raw_re, mpc_escape_output_raw_re);
+  free(x);
+  return y;
+}
+
+mpc_val_t *mpcf_unescape_regex(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_raw_re, mpc_escape_output_raw_re);
+  free(x);
+  return y;
+}
+
+mpc_val_t *mpcf_escape_string_raw(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_raw_cstr, mpc_escape_output_raw_cstr);
+  free(x);
+  return y;
+}
+
+mpc_val_t *mpcf_unescape_string_raw(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_raw_cstr, mpc_escape_output_raw_cstr);
+  free(x);
+  return y;
+}
+
+mpc_val_t *mpcf_escape_char_raw(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_raw_cchar, mpc_escape_output_raw_cchar);
+  free(x);
+  return y;
+}
+
+mpc_val_t *mpcf_unescape_char_raw(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_raw_cchar, mpc_escape_output_raw_cchar);
+  free(x);
+  return y;
+}
+
+mpc_val_t *mpcf_null(int n, mpc_val_t** xs) { (void) n; (void) xs; return NULL; }
+mpc_val_t *mpcf_fst(int n, mpc_val_t **xs) { (void) n; return xs[0]; }
+mpc_val_t *mpcf_snd(int n, mpc_val_t **xs) { (void) n; return xs[1]; }
+mpc_val_t *mpcf_trd(int n, mpc_val_t **xs) { (void) n; return xs[2]; }
+
+static mpc_val_t *mpcf_nth_free(int n, mpc_val_t **xs, int x) {
+  int i;
+  for (i = 0; i < n; i++) {
+    if (i != x) { free(xs[i]); }
+  }
+  return xs[x];
+}
+
+mpc_val_t *mpcf_fst_free(int n, mpc_val_t **xs) { return mpcf_nth_free(n, xs, 0); }
+mpc_val_t *mpcf_snd_free(int n, mpc_val_t **xs) { return mpcf_nth_free(n, xs, 1); }
+mpc_val_t *mpcf_trd_free(int n, mpc_val_t **xs) { return mpcf_nth_free(n, xs, 2); }
+mpc_val_t *mpcf_all_free(int n, mpc_val_t** xs) {
+  int i;
+  for (i = 0; i < n; i++) {
+    free(xs[i]);
+  }
+  return NULL;
+}
+
+mpc_val_t *mpcf_strfold(int n, mpc_val_t **xs) {
+  int i;
+  size_t l = 0;
+
+  if (n == 0) { return calloc(1, 1); }
+
+  for (i = 0; i < n; i++) { l += strlen(xs[i]); }
+
+  xs[0] = realloc(xs[0], l + 1);
+
+  for (i = 1; i < n; i++) {
+    strcat(xs[0], xs[i]); free(xs[i]);
+  }
+
+  return xs[0];
+}
+
+/*
+** Printing
+*/
+
+static void mpc_print_unretained(mpc_parser_t *p, int force) {
+
+  /* TODO: Print Everything Escaped */
+
+  int i;
+  char *s, *e;
+  char buff[2];
+
+  if (p->retained && !force) {;
+    if (p->name) { printf("<%s>", p->name); }
+    else { printf("<anon>"); }
+    return;
+  }
+
+  if (p->type == MPC_TYPE_UNDEFINED) { printf("<?>"); }
+  if (p->type == MPC_TYPE_PASS)   { printf("<:>"); }
+  if (p->type == MPC_TYPE_FAIL)   { printf("<!>"); }
+  if (p->type == MPC_TYPE_LIFT)   { printf("<#>"); }
+  if (p->type == MPC_TYPE_STATE)  { printf("<S>"); }
+  if (p->type == MPC_TYPE_ANCHOR) { printf("<@>"); }
+  if (p->type == MPC_TYPE_EXPECT) {
+    printf("%s", p->data.expect.m);
+    /*mpc_print_unretained(p->data.expect.x, 0);*/
+  }
+
+  if (p->type == MPC_TYPE_ANY) { printf("<.>"); }
+  if (p->type == MPC_TYPE_SATISFY) { printf("<f>"); }
+
+  if (p->type == MPC_TYPE_SINGLE) {
+    buff[0] = p->data.single.x; buff[1] = '\0';
+    s = mpcf_escape_new(
+      buff,
+      mpc_escape_input_c,
+      mpc_escape_output_c);
+    printf("'%s'", s);
+    free(s);
+  }
+
+  if (p->type == MPC_TYPE_RANGE) {
+    buff[0] = p->data.range.x; buff[1] = '\0';
+    s = mpcf_escape_new(
+      buff,
+      mpc_escape_input_c,
+      mpc_escape_output_c);
+    buff[0] = p->data.range.y; buff[1] = '\0';
+    e = mpcf_escape_new(
+      buff,
+      mpc_escape_input_c,
+      mpc_escape_output_c);
+    printf("[%s-%s]", s, e);
+    free(s);
+    free(e);
+  }
+
+  if (p->type == MPC_TYPE_ONEOF) {
+    s = mpcf_escape_new(
+      p->data.string.x,
+      mpc_escape_input_c,
+      mpc_escape_output_c);
+    printf("[%s]", s);
+    free(s);
+  }
+
+  if (p->type == MPC_TYPE_NONEOF) {
+    s = mpcf_escape_new(
+      p->data.string.x,
+      mpc_escape_input_c,
+      mpc_escape_output_c);
+    printf("[^%s]", s);
+    free(s);
+  }
+
+  if (p->type == MPC_TYPE_STRING) {
+    s = mpcf_escape_new(
+      p->data.string.x,
+      mpc_escape_input_c,
+      mpc_escape_output_c);
+    printf("\"%s\"", s);
+    free(s);
+  }
+
+  if (p->type == MPC_TYPE_APPLY)    { mpc_print_unretained(p->data.apply.x, 0); }
+  if (p->type == MPC_TYPE_APPLY_TO) { mpc_print_unretained(p->data.apply_to.x, 0); }
+  if (p->type == MPC_TYPE_PREDICT)  { mpc_print_unretained(p->data.predict.x, 0); }
+
+  if (p->type == MPC_TYPE_NOT)   { mpc_print_unretained(p->data.not.x, 0); printf("!"); }
+  if (p->type == MPC_TYPE_MAYBE) { mpc_print_unretained(p->data.not.x, 0); printf("?"); }
+
+  if (p->type == MPC_TYPE_MANY)  { mpc_print_unretained(p->data.repeat.x, 0); printf("*"); }
+  if (p->type == MPC_TYPE_MANY1) { mpc_print_unretained(p->data.repeat.x, 0); printf("+"); }
+  if (p->type == MPC_TYPE_COUNT) { mpc_print_unretained(p->data.repeat.x, 0); printf("{%i}", p->data.repeat.n); }
+  if (p->type == MPC_TYPE_SEPBY1) {
+    mpc_print_unretained(p->data.sepby1.x, 0);
+    printf(" (");
+    mpc_print_unretained(p->data.sepby1.sep, 0);
+    printf(" ");
+    mpc_print_unretained(p->data.sepby1.x, 0);
+    printf(")");
+    printf("*");
+  }
+
+  if (p->type == MPC_TYPE_OR) {
+    printf("(");
+    for(i = 0; i < p->data.or.n-1; i++) {
+      mpc_print_unretained(p->data.or.xs[i], 0);
+      printf(" | ");
+    }
+    mpc_print_unretained(p->data.or.xs[p->data.or.n-1], 0);
+    printf(")");
+  }
+
+  if (p->type == MPC_TYPE_AND) {
+    printf("(");
+    for(i = 0; i < p->data.and.n-1; i++) {
+      mpc_print_unretained(p->data.and.xs[i], 0);
+      printf(" ");
+    }
+    mpc_print_unretained(p->data.and.xs[p->data.and.n-1], 0);
+    printf(")");
+  }
+
+  if (p->type == MPC_TYPE_CHECK) {
+    mpc_print_unretained(p->data.check.x, 0);
+    printf("->?");
+  }
+  if (p->type == MPC_TYPE_CHECK_WITH) {
+    mpc_print_unretained(p->data.check_with.x, 0);
+    printf("->?");
+  }
+
+  if (p->type == MPC_TYPE_DFA) { mpc_print_unretained(p->data.dfa.x, 0); }
+
+}
+
+void mpc_print(mpc_parser_t *p) {
+  mpc_print_unretained(p, 1);
+  printf("\n");
+}
+
+/*
+** Testing
+*/
+
+/*
+** These functions are slightly unwieldy and
+** also the whole of the testing suite for mpc
+** mpc is pretty shaky.
+**
+** It could do with a lot more tests and more
+** precision. Currently I am only really testing
+** changes off of the examples.
+**
+*/
+
+int mpc_test_fail(mpc_parser_t *p, const char *s, const void *d,
+  int(*tester)(const void*, const void*),
+  mpc_dtor_t destructor,
+  void(*printer)(const void*)) {
+  mpc_result_t r;
+  (void) printer;
+  if (mpc_parse("<test>", s, p, &r)) {
+
+    if (tester(r.output, d)) {
+      destructor(r.output);
+      return 0;
+    } else {
+      destructor(r.output);
+      return 1;
+    }
+
+  } else {
+    mpc_err_delete(r.error);
+    return 1;
+  }
+
+}
+
+int mpc_test_pass(mpc_parser_t *p, const char *s, const void *d,
+  int(*tester)(const void*, const void*),
+  mpc_dtor_t destructor,
+  void(*printer)(const void*)) {
+
+  mpc_result_t r;
+  if (mpc_parse("<test>", s, p, &r)) {
+
+    if (tester(r.output, d)) {
+      destructor(r.output);
+      return 1;
+    } else {
+      printf("Got "); printer(r.output); printf("\n");
+      printf("Expected "); printer(d); printf("\n");
+      destructor(r.output);
+      return 0;
+    }
+
+  } else {
+    mpc_err_print(r.error);
+    mpc_err_delete(r.error);
+    return 0;
+
+  }
+
+}
+
+
+/*
+** AST
+*/
+
+/*
+** Trees parsed with MPC_PARSE_ARENA take their
+** nodes, contents and child arrays from blocks of
+** an arena that the root owns. Tags are interned
+** in the arena so each distinct tag is stored once.
+** Nodes are never freed alone, deleting the root
+** frees the blocks. Nodes made with mpc_ast_new and
+** added under arena nodes are counted as foreign, and
+** are freed when the tree is deleted.
+*/
+
+enum {
+  MPC_AST_ARENA_BLOCK_MIN = 4096,
+  MPC_AST_ARENA_BLOCK_MAX = 65536,
+  MPC_AST_ARENA_ALIGN = 8,
+  MPC_AST_TAGS_MIN = 32
+};
+
+typedef struct mpc_ast_block_t {
+  struct mpc_ast_block_t *next;
+  double data[1];
+} mpc_ast_block_t;
+
+struct mpc_ast_arena_t {
+  mpc_ast_block_t *blocks;
+  char *next;
+  size_t left;
+  size_t block;
+  char **tags;
+  size_t tags_num;
+  size_t tags_slots;
+  mpc_ast_t *root;
+  int foreign;
+};
+
+static mpc_ast_arena_t *mpc_ast_arena_create(void) {
+  mpc_ast_arena_t *r = malloc(sizeof(mpc_ast_arena_t));
+  r->blocks = NULL;
+  r->next = NULL;
+  r->left = 0;
+  r->block = MPC_AST_ARENA_BLOCK_MIN;
+  r->tags = NULL;
+  r->tags_num = 0;
+  r->tags_slots = 0;
+  r->root = NULL;
+  r->foreign = 0;
+  return r;
+}
+
+static void mpc_ast_arena_delete(mpc_ast_arena_t *r) {
+  mpc_ast_block_t *b;
+  while (r->blocks) {
+    b = r->blocks->next;
+    free(r->blocks);
+    r->blocks = b;
+  }
+  free(r->tags);
+  free(r);
+}
+
+/* Hands the arena to the root of the parse result built in it */
+static int mpc_ast_arena_adopt(mpc_ast_arena_t *r, mpc_ast_t *a) {
+  if (a == NULL || a->arena != r) { return 0; }
+  r->root = a;
+  return 1;
+}
+
+static void *mpc_ast_arena_alloc(mpc_ast_arena_t *r, size_t n) {
+
+  mpc_ast_block_t *b;
+  size_t size;
+  void *x;
+
+  n = (n + MPC_AST_ARENA_ALIGN - 1) & ~(size_t)(MPC_AST_ARENA_ALIGN - 1);
+
+  if (n > r->left) {
+    size = n > r->block ? n : r->block;
+    b = malloc(sizeof(mpc_ast_block_t) + size);
+    b->next = r->blocks;
+    r->blocks = b;
+    r->next = (char*)b->data;
+    r->left = size;
+    if (r->block < MPC_AST_ARENA_BLOCK_MAX) { r->block *= 2; }
+  }
+
+  x = r->next;
+  r->next += n;
+  r->left -= n;
+  return x;
+}
+
+static size_t mpc_ast_tag_hash(const char *t, size_t n) {
+  size_t j, h = 2166136261UL;
+  for (j = 0; j < n; j++) { h = (h ^ (unsigned char)t[j]) * 16777619UL; }
+  return h;
+}
+
+/* The arena's copy of the first n characters of t */
+static char *mpc_ast_intern(mpc_ast_arena_t *r, const char *t, size_t n) {
+
+  size_t j, k, mask, slots;
+  char **tags, *x;
+
+  if ((r->tags_num + 1) * 2 > r->tags_slots) {
+    slots = r->tags_slots ? r->tags_slots * 2 : MPC_AST_TAGS_MIN;
+    tags = calloc(slots, sizeof(char*));
+    for (k = 0; k < r->tags_slots; k++) {
+      if (r->tags[k] == NULL) { continue; }
+      for (j = mpc_ast_tag_hash(r->tags[k], strlen(r->tags[k])) & (slots - 1); tags[j]; j = (j + 1) & (slots - 1));
+      tags[j] = r->tags[k];
+    }
+    free(r->tags);
+    r->tags = tags;
+    r->tags_slots = slots;
+  }
+
+  mask = r->tags_slots - 1;
+  for (j = mpc_ast_tag_hash(t, n) & mask; r->tags[j]; j = (j + 1) & mask) {
+    if (strncmp(r->tags[j], t, n) == 0 && r->tags[j][n] == '\0') { return r->tags[j]; }
+  }
+
+  x = mpc_ast_arena_alloc(r, n + 1);
+  memcpy(x, t, n);
+  x[n] = '\0';
+  r->tags[j] = x;
+  r->tags_num++;
+  return x;
+}
 
-static mpc_val_t *mpcf_re_or(int n, mpc_val_t **xs) {
-  (void) n;
-  if (xs[1] == NULL) { return xs[0]; }
-  else { return mpc_or(2, xs[0], xs[1]); }
+static mpc_ast_t *mpc_ast_arena_node(mpc_ast_arena_t *r, const char *tag, const char *contents) {
+
+  size_t n = strlen(contents);
+  mpc_ast_t *a = mpc_ast_arena_alloc(r, sizeof(mpc_ast_t) + n + 1);
+
+  a->tag = mpc_ast_intern(r, tag, strlen(tag));
+  a->contents = (char*)(a + 1);
+  memcpy(a->contents, contents, n + 1);
+  a->state = mpc_state_new();
+  a->children_num = 0;
+  a->children = NULL;
+  a->arena = r;
+  a->id = 0;
+  a->punct = 0;
+  return a;
 }
 
-static mpc_val_t *mpcf_re_and(int n, mpc_val_t **xs) {
+/* Retag an arena node with n characters of t, then sep, then its old tag */
+static mpc_ast_t *mpc_ast_arena_prefix(mpc_ast_t *a, const char *t, size_t n, const char *sep) {
+
+  char buffer[256], *tag;
+  size_t m = strlen(sep), l = strlen(a->tag);
+
+  tag = n + m + l < sizeof(buffer) ? buffer : malloc(n + m + l + 1);
+  memcpy(tag, t, n);
+  memcpy(tag + n, sep, m);
+  memcpy(tag + n + m, a->tag, l + 1);
+  a->tag = mpc_ast_intern(a->arena, tag, n + m + l);
+  if (tag != buffer) { free(tag); }
+  return a;
+}
+
+void mpc_ast_delete(mpc_ast_t *a) {
+
   int i;
-  mpc_parser_t *p = mpc_lift(mpcf_ctor_str);
-  for (i = 0; i < n; i++) {
-    p = mpc_and(2, mpcf_strfold, p, xs[i], free);
+
+  if (a == NULL) { return; }
+
+  if (a->arena) {
+    if (a->arena->foreign) {
+      for (i = 0; i < a->children_num; i++) {
+        mpc_ast_delete(a->children[i]);
+      }
+    }
+    if (a->arena->root == a) { mpc_ast_arena_delete(a->arena); }
+    return;
   }
-  return p;
+
+  for (i = 0; i < a->children_num; i++) {
+    mpc_ast_delete(a->children[i]);
+  }
+
+  free(a->children);
+  free(a->tag);
+  free(a->contents);
+  free(a);
+
 }
 
-static mpc_val_t *mpcf_re_repeat(int n, mpc_val_t **xs) {
-  int num;
-  (void) n;
-  if (xs[1] == NULL) { return xs[0]; }
-  switch(((char*)xs[1])[0])
-  {
-    case '*': { free(xs[1]); return mpc_many(mpcf_strfold, xs[0]); }; break;
-    case '+': { free(xs[1]); return mpc_many1(mpcf_strfold, xs[0]); }; break;
-    case '?': { free(xs[1]); return mpc_maybe_lift(xs[0], mpcf_ctor_str); }; break;
-    default:
-      num = *(int*)xs[1];
-      free(xs[1]);
+static void mpc_ast_delete_no_children(mpc_ast_t *a) {
+  if (a->arena) { return; }
+  free(a->children);
+  free(a->tag);
+  free(a->contents);
+  free(a);
+}
+
+mpc_ast_t *mpc_ast_new(const char *tag, const char *contents) {
+
+  mpc_ast_t *a = malloc(sizeof(mpc_ast_t));
+
+  a->tag = malloc(strlen(tag) + 1);
+  strcpy(a->tag, tag);
+
+  a->contents = malloc(strlen(contents) + 1);
+  strcpy(a->contents, contents);
+
+  a->state = mpc_state_new();
+
+  a->children_num = 0;
+  a->children = NULL;
+  a->arena = NULL;
+  a->id = 0;
+  a->punct = 0;
+  return a;
+
+}
+
+mpc_ast_t *mpc_ast_build(int n, const char *tag, ...) {
+
+  mpc_ast_t *a = mpc_ast_new(tag, "");
+
+  int i;
+  va_list va;
+  va_start(va, tag);
+
+  for (i = 0; i < n; i++) {
+    mpc_ast_add_child(a, va_arg(va, mpc_ast_t*));
   }
 
-  return mpc_count(num, mpcf_strfold, xs[0], free);
+  va_end(va);
+
+  return a;
+
 }
 
-static mpc_parser_t *mpc_re_escape_char(char c) {
-  switch (c) {
-    case 'a': return mpc_char('\a');
-    case 'f': return mpc_char('\f');
-    case 'n': return mpc_char('\n');
-    case 'r': return mpc_char('\r');
-    case 't': return mpc_char('\t');
-    case 'v': return mpc_char('\v');
-    case 'b': return mpc_and(2, mpcf_snd, mpc_boundary(), mpc_lift(mpcf_ctor_str), free);
-    case 'B': return mpc_not_lift(mpc_boundary(), free, mpcf_ctor_str);
-    case 'A': return mpc_and(2, mpcf_snd, mpc_soi(), mpc_lift(mpcf_ctor_str), free);
-    case 'Z': return mpc_and(2, mpcf_snd, mpc_eoi(), mpc_lift(mpcf_ctor_str), free);
-    case 'd': return mpc_digit();
-    case 'D': return mpc_not_lift(mpc_digit(), free, mpcf_ctor_str);
-    case 's': return mpc_whitespace();
-    case 'S': return mpc_not_lift(mpc_whitespace(), free, mpcf_ctor_str);
-    case 'w': return mpc_alphanum();
-    case 'W': return mpc_not_lift(mpc_alphanum(), free, mpcf_ctor_str);
-    default: return NULL;
+mpc_ast_t *mpc_ast_add_root(mpc_ast_t *a) {
+
+  mpc_ast_t *r;
+
+  if (a == NULL) { return a; }
+  if (a->children_num == 0) { return a; }
+  if (a->children_num == 1) { return a; }
+
+  r = a->arena ? mpc_ast_arena_node(a->arena, ">", "") : mpc_ast_new(">", "");
+  mpc_ast_add_child(r, a);
+  return r;
+}
+
+int mpc_ast_eq(mpc_ast_t *a, mpc_ast_t *b) {
+
+  int i;
+
+  if (a->tag != b->tag && strcmp(a->tag, b->tag) != 0) { return 0; }
+  if (strcmp(a->contents, b->contents) != 0) { return 0; }
+  if (a->children_num != b->children_num) { return 0; }
+
+  for (i = 0; i < a->children_num; i++) {
+    if (!mpc_ast_eq(a->children[i], b->children[i])) { return 0; }
   }
+
+  return 1;
 }
 
-static mpc_val_t *mpcf_re_escape(mpc_val_t *x, void* data) {
+mpc_ast_t *mpc_ast_add_child(mpc_ast_t *r, mpc_ast_t *a) {
 
-  int mode = *((int*)data);
-  char *s = x;
-  mpc_parser_t *p;
+  mpc_ast_t **children;
+  int n = r->children_num;
 
-  /* Any Character */
-  if (s[0] == '.') {
-    free(s);
-    if (mode & MPC_RE_DOTALL) {
-      return mpc_any();
-    } else {
-      return mpc_expect(mpc_noneof("\n"), "any character except a newline");
+  /* Arena child arrays double in place of realloc */
+  if (r->arena) {
+    if (n == 0 || (n >= 2 && (n & (n - 1)) == 0)) {
+      children = mpc_ast_arena_alloc(r->arena, sizeof(mpc_ast_t*) * (n ? n * 2 : 2));
+      if (n) { memcpy(children, r->children, sizeof(mpc_ast_t*) * n); }
+      r->children = children;
     }
+    if (a && !a->arena) { r->arena->foreign++; }
+    r->children[r->children_num++] = a;
+    return r;
   }
 
-  /* Start of Input */
-  if (s[0] == '^') {
-    free(s);
-    if (mode & MPC_RE_MULTILINE) {
-      return mpc_and(2, mpcf_snd, mpc_or(2, mpc_soi(), mpc_boundary_newline()), mpc_lift(mpcf_ctor_str), free);
-    } else {
-      return mpc_and(2, mpcf_snd, mpc_soi(), mpc_lift(mpcf_ctor_str), free);
-    }
+  r->children_num++;
+  r->children = realloc(r->children, sizeof(mpc_ast_t*) * r->children_num);
+  r->children[r->children_num-1] = a;
+  return r;
+}
+
+mpc_ast_t *mpc_ast_add_tag(mpc_ast_t *a, const char *t) {
+  if (a == NULL) { return a; }
+  if (a->arena) { return mpc_ast_arena_prefix(a, t, strlen(t), "|"); }
+  a->tag = realloc(a->tag, strlen(t) + 1 + strlen(a->tag) + 1);
+  memmove(a->tag + strlen(t) + 1, a->tag, strlen(a->tag)+1);
+  memmove(a->tag, t, strlen(t));
+  memmove(a->tag + strlen(t), "|", 1);
+  return a;
+}
+
+mpc_ast_t *mpc_ast_add_root_tag(mpc_ast_t *a, const char *t) {
+  if (a == NULL) { return a; }
+  if (a->arena) { return mpc_ast_arena_prefix(a, t, strlen(t)-1, ""); }
+  a->tag = realloc(a->tag, (strlen(t)-1) + strlen(a->tag) + 1);
+  memmove(a->tag + (strlen(t)-1), a->tag, strlen(a->tag)+1);
+  memmove(a->tag, t, (strlen(t)-1));
+  return a;
+}
+
+mpc_ast_t *mpc_ast_tag(mpc_ast_t *a, const char *t) {
+  if (a->arena) {
+    a->tag = mpc_ast_intern(a->arena, t, strlen(t));
+    return a;
   }
+  a->tag = realloc(a->tag, strlen(t) + 1);
+  strcpy(a->tag, t);
+  return a;
+}
 
-  /* End of Input */
-  if (s[0] == '$') {
-    free(s);
-    if (mode & MPC_RE_MULTILINE) {
-      return mpc_or(2,
-        mpc_newline(),
-        mpc_and(2, mpcf_snd, mpc_eoi(), mpc_lift(mpcf_ctor_str), free));
-    } else {
-      return mpc_or(2,
-        mpc_and(2, mpcf_fst, mpc_newline(), mpc_eoi(), free),
-        mpc_and(2, mpcf_snd, mpc_eoi(), mpc_lift(mpcf_ctor_str), free));
+mpc_ast_t *mpc_ast_state(mpc_ast_t *a, mpc_state_t s) {
+  if (a == NULL) { return a; }
+  a->state = s;
+  return a;
+}
+
+static void mpc_ast_print_depth(mpc_ast_t *a, int d, FILE *fp) {
+
+  int i;
+
+  if (a == NULL) {
+    fprintf(fp, "NULL\n");
+    return;
+  }
+
+  for (i = 0; i < d; i++) { fprintf(fp, "  "); }
+
+  if (strlen(a->contents)) {
+    fprintf(fp, "%s:%lu:%lu '%s'\n", a->tag,
+      (long unsigned int)(a->state.row+1),
+      (long unsigned int)(a->state.col+1),
+      a->contents);
+  } else {
+    fprintf(fp, "%s \n", a->tag);
+  }
+
+  for (i = 0; i < a->children_num; i++) {
+    mpc_ast_print_depth(a->children[i], d+1, fp);
+  }
+
+}
+
+void mpc_ast_print(mpc_ast_t *a) {
+  mpc_ast_print_depth(a, 0, stdout);
+}
+
+void mpc_ast_print_to(mpc_ast_t *a, FILE *fp) {
+  mpc_ast_print_depth(a, 0, fp);
+}
+
+int mpc_ast_get_index(mpc_ast_t *ast, const char *tag) {
+  return mpc_ast_get_index_lb(ast, tag, 0);
+}
+
+int mpc_ast_get_index_lb(mpc_ast_t *ast, const char *tag, int lb) {
+  int i;
+
+  for(i=lb; i<ast->children_num; i++) {
+    if(strcmp(ast->children[i]->tag, tag) == 0) {
+      return i;
     }
   }
 
-  /* Regex Escape */
-  if (s[0] == '\\') {
-    p = mpc_re_escape_char(s[1]);
-    p = (p == NULL) ? mpc_char(s[1]) : p;
-    free(s);
-    return p;
-  }
+  return -1;
+}
 
-  /* Regex Standard */
-  p = mpc_char(s[0]);
-  free(s);
-  return p;
+mpc_ast_t *mpc_ast_get_child(mpc_ast_t *ast, const char *tag) {
+  return mpc_ast_get_child_lb(ast, tag, 0);
 }
 
-static const char *mpc_re_range_escape_char(char c) {
-  switch (c) {
-    case '-': return "-";
-    case 'a': return "\a";
-    case 'f': return "\f";
-    case 'n': return "\n";
-    case 'r': return "\r";
-    case 't': return "\t";
-    case 'v': return "\v";
-    case 'b': return "\b";
-    case 'd': return "0123456789";
-    case 's': return " \f\n\r\t\v";
-    case 'w': return "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
-    default: return NULL;
+mpc_ast_t *mpc_ast_get_child_lb(mpc_ast_t *ast, const char *tag, int lb) {
+  int i;
+
+  for(i=lb; i<ast->children_num; i++) {
+    if(strcmp(ast->children[i]->tag, tag) == 0) {
+      return ast->children[i];
+    }
   }
+
+  return NULL;
 }
 
-static mpc_val_t *mpcf_re_range(mpc_val_t *x) {
+mpc_ast_trav_t *mpc_ast_traverse_start(mpc_ast_t *ast,
+                                       mpc_ast_trav_order_t order)
+{
+  mpc_ast_trav_t *trav, *n_trav;
+  mpc_ast_t *cnode = ast;
 
-  mpc_parser_t *out;
-  size_t i, j;
-  size_t start, end;
-  const char *tmp = NULL;
-  const char *s = x;
-  int comp = s[0] == '^' ? 1 : 0;
-  char *range = calloc(1,1);
+  /* Create the traversal structure */
+  trav = malloc(sizeof(mpc_ast_trav_t));
+  trav->curr_node = cnode;
+  trav->parent = NULL;
+  trav->curr_child = 0;
+  trav->order = order;
 
-  if (s[0] == '\0') { free(range); free(x); return mpc_fail("Invalid Regex Range Expression"); }
-  if (s[0] == '^' &&
-      s[1] == '\0') { free(range); free(x); return mpc_fail("Invalid Regex Range Expression"); }
+  /* Get start node */
+  switch(order) {
+    case mpc_ast_trav_order_pre:
+      /* Nothing else is needed for pre order start */
+      break;
 
-  for (i = comp; i < strlen(s); i++){
+    case mpc_ast_trav_order_post:
+      while(cnode->children_num > 0) {
+        cnode = cnode->children[0];
 
-    /* Regex Range Escape */
-    if (s[i] == '\\') {
-      tmp = mpc_re_range_escape_char(s[i+1]);
-      if (tmp != NULL) {
-        range = realloc(range, strlen(range) + strlen(tmp) + 1);
-        strcat(range, tmp);
-      } else {
-        range = realloc(range, strlen(range) + 1 + 1);
-        range[strlen(range) + 1] = '\0';
-        range[strlen(range) + 0] = s[i+1];
-      }
-      i++;
-    }
+        n_trav = malloc(sizeof(mpc_ast_trav_t));
+        n_trav->curr_node = cnode;
+        n_trav->parent = trav;
+        n_trav->curr_child = 0;
+        n_trav->order = order;
 
-    /* Regex Range...Range */
-    else if (s[i] == '-') {
-      if (s[i+1] == '\0' || i == 0) {
-          range = realloc(range, strlen(range) + strlen("-") + 1);
-          strcat(range, "-");
-      } else {
-        start = s[i-1]+1;
-        end = s[i+1]-1;
-        for (j = start; j <= end; j++) {
-          range = realloc(range, strlen(range) + 1 + 1 + 1);
-          range[strlen(range) + 1] = '\0';
-          range[strlen(range) + 0] = (char)j;
-        }
+        trav = n_trav;
       }
-    }
 
-    /* Regex Range Normal */
-    else {
-      range = realloc(range, strlen(range) + 1 + 1);
-      range[strlen(range) + 1] = '\0';
-      range[strlen(range) + 0] = s[i];
-    }
+      break;
 
+    default:
+      /* Unreachable, but compiler complaints */
+      break;
   }
 
-  out = comp == 1 ? mpc_noneof(range) : mpc_oneof(range);
+  return trav;
+}
 
-  free(x);
-  free(range);
+mpc_ast_t *mpc_ast_traverse_next(mpc_ast_trav_t **trav) {
+  mpc_ast_trav_t *n_trav, *to_free;
+  mpc_ast_t *ret = NULL;
+  int cchild;
 
-  return out;
-}
+  /* The end of traversal was reached */
+  if(*trav == NULL) return NULL;
 
-mpc_parser_t *mpc_re(const char *re) {
-  return mpc_re_mode(re, MPC_RE_DEFAULT);
-}
+  switch((*trav)->order) {
+    case mpc_ast_trav_order_pre:
+      ret = (*trav)->curr_node;
 
-mpc_parser_t *mpc_re_mode(const char *re, int mode) {
+      /* If there aren't any more children, go up */
+      while(*trav != NULL &&
+        (*trav)->curr_child >= (*trav)->curr_node->children_num)
+      {
+        to_free = *trav;
+        *trav = (*trav)->parent;
+        free(to_free);
+      }
 
-  char *err_msg;
-  mpc_parser_t *err_out;
-  mpc_result_t r;
-  mpc_parser_t *Regex, *Term, *Factor, *Base, *Range, *RegexEnclose;
+      /* If trav is NULL, the end was reached */
+      if(*trav == NULL) {
+        break;
+      }
 
-  Regex  = mpc_new("regex");
-  Term   = mpc_new("term");
-  Factor = mpc_new("factor");
-  Base   = mpc_new("base");
-  Range  = mpc_new("range");
+      /* Go to next child */
+      n_trav = malloc(sizeof(mpc_ast_trav_t));
 
-  mpc_define(Regex, mpc_and(2, mpcf_re_or,
-    Term,
-    mpc_maybe(mpc_and(2, mpcf_snd_free, mpc_char('|'), Regex, free)),
-    (mpc_dtor_t)mpc_delete
-  ));
+      cchild = (*trav)->curr_child;
+      n_trav->curr_node = (*trav)->curr_node->children[cchild];
+      n_trav->parent = *trav;
+      n_trav->curr_child = 0;
+      n_trav->order = (*trav)->order;
 
-  mpc_define(Term, mpc_many(mpcf_re_and, Factor));
+      (*trav)->curr_child++;
+      *trav = n_trav;
 
-  mpc_define(Factor, mpc_and(2, mpcf_re_repeat,
-    Base,
-    mpc_or(5,
-      mpc_char('*'), mpc_char('+'), mpc_char('?'),
-      mpc_brackets(mpc_int(), free),
-      mpc_pass()),
-    (mpc_dtor_t)mpc_delete
-  ));
+      break;
 
-  mpc_define(Base, mpc_or(4,
-    mpc_parens(Regex, (mpc_dtor_t)mpc_delete),
-    mpc_squares(Range, (mpc_dtor_t)mpc_delete),
-    mpc_apply_to(mpc_escape(), mpcf_re_escape, &mode),
-    mpc_apply_to(mpc_noneof(")|"), mpcf_re_escape, &mode)
-  ));
+    case mpc_ast_trav_order_post:
+      ret = (*trav)->curr_node;
 
-  mpc_define(Range, mpc_apply(
-    mpc_many(mpcf_strfold, mpc_or(2, mpc_escape(), mpc_noneof("]"))),
-    mpcf_re_range
-  ));
+      /* Move up tree to the parent If the parent doesn't have any more nodes,
+       * then this is the current node. If it does, move down to its left most
+       * child. Also, free the previous traversal node */
+      to_free = *trav;
+      *trav = (*trav)->parent;
+      free(to_free);
 
-  RegexEnclose = mpc_whole(mpc_predictive(Regex), (mpc_dtor_t)mpc_delete);
+      if(*trav == NULL)
+        break;
 
-  mpc_optimise(RegexEnclose);
-  mpc_optimise(Regex);
-  mpc_optimise(Term);
-  mpc_optimise(Factor);
-  mpc_optimise(Base);
-  mpc_optimise(Range);
+      /* Next child */
+      (*trav)->curr_child++;
 
-  if(!mpc_parse("<mpc_re_compiler>", re, RegexEnclose, &r)) {
-    err_msg = mpc_err_string(r.error);
-    err_out = mpc_failf("Invalid Regex: %s", err_msg);
-    mpc_err_delete(r.error);
-    free(err_msg);
-    r.output = err_out;
+      /* If there aren't any more children, this is the next node */
+      if((*trav)->curr_child >= (*trav)->curr_node->children_num) {
+        break;
+      }
+
+      /* If there are still more children, find the leftmost child from this
+       * node */
+      while((*trav)->curr_node->children_num > 0) {
+        n_trav = malloc(sizeof(mpc_ast_trav_t));
+
+        cchild = (*trav)->curr_child;
+        n_trav->curr_node = (*trav)->curr_node->children[cchild];
+        n_trav->parent = *trav;
+        n_trav->curr_child = 0;
+        n_trav->order = (*trav)->order;
+
+        *trav = n_trav;
+      }
+
+    default:
+      /* Unreachable, but compiler complaints */
+      break;
+  }
+
+  return ret;
+}
+
+void mpc_ast_traverse_free(mpc_ast_trav_t **trav) {
+  mpc_ast_trav_t *n_trav;
+
+  /* Go through parents until all are free */
+  while(*trav != NULL) {
+      n_trav = (*trav)->parent;
+      free(*trav);
+      *trav = n_trav;
   }
+}
+
+mpc_val_t *mpcf_fold_ast(int n, mpc_val_t **xs) {
 
-  mpc_cleanup(6, RegexEnclose, Regex, Term, Factor, Base, Range);
+  int i, j;
+  mpc_ast_t** as = (mpc_ast_t**)xs;
+  mpc_ast_t *r, *c;
 
-  mpc_optimise(r.output);
+  if (n == 0) { return NULL; }
+  if (n == 1) { return xs[0]; }
+  if (n == 2 && xs[1] == NULL) { return xs[0]; }
+  if (n == 2 && xs[0] == NULL) { return xs[1]; }
 
-  return r.output;
+  for (i = 0; i < n && !(as[i] && as[i]->arena); i++);
+  r = i < n ? mpc_ast_arena_node(as[i]->arena, ">", "") : mpc_ast_new(">", "");
 
-}
+  for (i = 0; i < n; i++) {
 
-/*
-** Common Fold Functions
-*/
+    if (as[i] == NULL) { continue; }
 
-void mpcf_dtor_null(mpc_val_t *x) { (void) x; return; }
+    if        (as[i] && as[i]->children_num == 0) {
+      mpc_ast_add_child(r, as[i]);
+    } else if (as[i] && as[i]->children_num == 1) {
+      c = mpc_ast_add_root_tag(as[i]->children[0], as[i]->tag);
+      if (as[i]->id) {
+        c->id = c->id ? c->id : as[i]->id;
+        c->punct = 0;
+      }
+      mpc_ast_add_child(r, c);
+      mpc_ast_delete_no_children(as[i]);
+    } else if (as[i] && as[i]->children_num >= 2) {
+      for (j = 0; j < as[i]->children_num; j++) {
+        mpc_ast_add_child(r, as[i]->children[j]);
+      }
+      mpc_ast_delete_no_children(as[i]);
+    }
 
-mpc_val_t *mpcf_ctor_null(void) { return NULL; }
-mpc_val_t *mpcf_ctor_str(void) { return calloc(1, 1); }
-mpc_val_t *mpcf_free(mpc_val_t *x) { free(x); return NULL; }
+  }
 
-mpc_val_t *mpcf_int(mpc_val_t *x) {
-  int *y = malloc(sizeof(int));
-  *y = strtol(x, NULL, 10);
-  free(x);
-  return y;
-}
+  if (r->children_num) {
+    r->state = r->children[0]->state;
+  }
 
-mpc_val_t *mpcf_hex(mpc_val_t *x) {
-  int *y = malloc(sizeof(int));
-  *y = strtol(x, NULL, 16);
-  free(x);
-  return y;
+  return r;
 }
 
-mpc_val_t *mpcf_oct(mpc_val_t *x) {
-  int *y = malloc(sizeof(int));
-  *y = strtol(x, NULL, 8);
-  free(x);
-  return y;
+mpc_val_t *mpcf_str_ast(mpc_val_t *c) {
+  mpc_ast_t *a = mpc_ast_new("", c);
+  free(c);
+  return a;
 }
 
-mpc_val_t *mpcf_float(mpc_val_t *x) {
-  float *y = malloc(sizeof(float));
-  *y = strtod(x, NULL);
-  free(x);
-  return y;
+mpc_val_t *mpcf_state_ast(int n, mpc_val_t **xs) {
+  mpc_state_t *s = ((mpc_state_t**)xs)[0];
+  mpc_ast_t *a = ((mpc_ast_t**)xs)[1];
+  (void)n;
+  a = mpc_ast_state(a, *s);
+  free(s);
+  return a;
 }
 
-mpc_val_t *mpcf_strtriml(mpc_val_t *x) {
-  char *s = x;
-  while (isspace((unsigned char)*s)) {
-    memmove(s, s+1, strlen(s));
-  }
-  return s;
+mpc_parser_t *mpca_state(mpc_parser_t *a) {
+  return mpc_and(2, mpcf_state_ast, mpc_state(), a, free);
 }
 
-mpc_val_t *mpcf_strtrimr(mpc_val_t *x) {
-  char *s = x;
-  size_t l = strlen(s);
-  while (l > 0 && isspace((unsigned char)s[l-1])) {
-    s[l-1] = '\0'; l--;
-  }
-  return s;
+mpc_parser_t *mpca_tag(mpc_parser_t *a, const char *t) {
+  return mpc_apply_to(a, (mpc_apply_to_t)mpc_ast_tag, (void*)t);
 }
 
-mpc_val_t *mpcf_strtrim(mpc_val_t *x) {
-  return mpcf_strtriml(mpcf_strtrimr(x));
+mpc_parser_t *mpca_add_tag(mpc_parser_t *a, const char *t) {
+  return mpc_apply_to(a, (mpc_apply_to_t)mpc_ast_add_tag, (void*)t);
 }
 
-static const char mpc_escape_input_c[]  = {
-  '\a', '\b', '\f', '\n', '\r',
-  '\t', '\v', '\\', '\'', '\"', '\0'};
-
-static const char *mpc_escape_output_c[] = {
-  "\\a", "\\b", "\\f", "\\n", "\\r", "\\t",
-  "\\v", "\\\\", "\\'", "\\\"", "\\0", NULL};
-
-static const char mpc_escape_input_raw_re[] = { '/' };
-static const char *mpc_escape_output_raw_re[] = { "\\/", NULL };
-
-static const char mpc_escape_input_raw_cstr[] = { '"' };
-static const char *mpc_escape_output_raw_cstr[] = { "\\\"", NULL };
+mpc_parser_t *mpca_root(mpc_parser_t *a) {
+  return mpc_apply(a, (mpc_apply_t)mpc_ast_add_root);
+}
 
-static const char mpc_escape_input_raw_cchar[] = { '\'' };
-static const char *mpc_escape_output_raw_cchar[] = { "\\'", NULL };
+mpc_parser_t *mpca_not(mpc_parser_t *a) { return mpc_not(a, (mpc_dtor_t)mpc_ast_delete); }
+mpc_parser_t *mpca_maybe(mpc_parser_t *a) { return mpc_maybe(a); }
+mpc_parser_t *mpca_many(mpc_parser_t *a) { return mpc_many(mpcf_fold_ast, a); }
+mpc_parser_t *mpca_many1(mpc_parser_t *a) { return mpc_many1(mpcf_fold_ast, a); }
+mpc_parser_t *mpca_count(int n, mpc_parser_t *a) { return mpc_count(n, mpcf_fold_ast, a, (mpc_dtor_t)mpc_ast_delete); }
 
-static mpc_val_t *mpcf_escape_new(mpc_val_t *x, const char *input, const char **output) {
+mpc_parser_t *mpca_or(int n, ...) {
 
   int i;
-  int found;
-  char buff[2];
-  char *s = x;
-  char *y = calloc(1, 1);
-
-  while (*s) {
-
-    i = 0;
-    found = 0;
+  va_list va;
 
-    while (output[i]) {
-      if (*s == input[i]) {
-        y = realloc(y, strlen(y) + strlen(output[i]) + 1);
-        strcat(y, output[i]);
-        found = 1;
-        break;
-      }
-      i++;
-    }
+  mpc_parser_t *p = mpc_undefined();
 
-    if (!found) {
-      y = realloc(y, strlen(y) + 2);
-      buff[0] = *s; buff[1] = '\0';
-      strcat(y, buff);
-    }
+  p->type = MPC_TYPE_OR;
+  p->data.or.n = n;
+  p->data.or.xs = malloc(sizeof(mpc_parser_t*) * n);
+  p->data.or.first = NULL;
+  p->data.or.jump = NULL;
 
-    s++;
+  va_start(va, n);
+  for (i = 0; i < n; i++) {
+    p->data.or.xs[i] = va_arg(va, mpc_parser_t*);
   }
+  va_end(va);
 
+  return p;
 
-  return y;
 }
 
-static mpc_val_t *mpcf_unescape_new(mpc_val_t *x, const char *input, const char **output) {
+mpc_parser_t *mpca_and(int n, ...) {
 
   int i;
-  int found = 0;
-  char buff[2];
-  char *s = x;
-  char *y = calloc(1, 1);
+  va_list va;
 
-  while (*s) {
+  mpc_parser_t *p = mpc_undefined();
 
-    i = 0;
-    found = 0;
+  p->type = MPC_TYPE_AND;
+  p->data.and.n = n;
+  p->data.and.f = mpcf_fold_ast;
+  p->data.and.xs = malloc(sizeof(mpc_parser_t*) * n);
+  p->data.and.dxs = malloc(sizeof(mpc_dtor_t) * (n-1));
 
-    while (output[i]) {
-      if ((*(s+0)) == output[i][0] &&
-          (*(s+1)) == output[i][1]) {
-        y = realloc(y, strlen(y) + 1 + 1);
-        buff[0] = input[i]; buff[1] = '\0';
-        strcat(y, buff);
-        found = 1;
-        s++;
-        break;
-      }
-      i++;
-    }
+  va_start(va, n);
+  for (i = 0; i < n; i++) {
+    p->data.and.xs[i] = va_arg(va, mpc_parser_t*);
+  }
+  for (i = 0; i < (n-1); i++) {
+    p->data.and.dxs[i] = (mpc_dtor_t)mpc_ast_delete;
+  }
+  va_end(va);
 
-    if (!found) {
-      y = realloc(y, strlen(y) + 1 + 1);
-      buff[0] = *s; buff[1] = '\0';
-      strcat(y, buff);
-    }
+  return p;
+}
 
-    if (*s == '\0') { break; }
-    else { s++; }
-  }
+mpc_parser_t *mpca_total(mpc_parser_t *a) { return mpc_total(a, (mpc_dtor_t)mpc_ast_delete); }
 
-  return y;
+/*
+** Grammar Parser
+*/
 
-}
+/*
+** This is another interesting bootstrapping.
+**
+** Having a general purpose AST type allows
+** users to specify the grammar alone and
+** let all fold rules be automatically taken
+** care of by existing functions.
+**
+** You don't get to control the type spat
+** out but this means you can make a nice
+** parser to take in some grammar in nice
+** syntax and spit out a parser that works.
+**
+** The grammar for this looks surprisingly
+** like regex but the main difference is that
+** it is now whitespace insensitive and the
+** base type takes literals of some form.
+*/
 
-mpc_val_t *mpcf_escape(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_c, mpc_escape_output_c);
-  free(x);
-  return y;
-}
+/*
+**
+**  ### Grammar Grammar
+**
+**      <grammar> : (<term> "|" <grammar>) | <term>
+**
+**      <term> : <factor>*
+**
+**      <factor> : <base>
+**               | <base> "*"
+**               | <base> "+"
+**               | <base> "?"
+**               | <base> "{" <digits> "}"
+**
+**      <base> : "<" (<digits> | <ident>) ">"
+**             | <string_lit>
+**             | <char_lit>
+**             | <regex_lit> <regex_mode>
+**             | "(" <grammar> ")"
+*/
+
+/*
+** Parsers are taken from the argument list as the
+** grammar refers to them, and found again by name
+** through an open addressing index of their
+** positions, so each reference costs the same
+** however many rules there are.
+*/
+
+enum {
+  MPCA_GRAMMAR_PARSERS_MIN = 16
+};
+
+typedef struct {
+  va_list *va;
+  int parsers_num;
+  int parsers_slots;
+  mpc_parser_t **parsers;
+  int *index;
+  int index_slots;
+  int flags;
+} mpca_grammar_st_t;
 
-mpc_val_t *mpcf_unescape(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_c, mpc_escape_output_c);
-  free(x);
-  return y;
-}
+static clock_t mpca_grammar_clock = 0;
+static unsigned long mpca_grammar_builds = 0;
 
-mpc_val_t *mpcf_escape_regex(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_raw_re, mpc_escape_output_raw_re);
-  free(x);
-  return y;
+static void mpca_grammar_st_init(mpca_grammar_st_t *st, va_list *va, int flags) {
+  st->va = va;
+  st->parsers_num = 0;
+  st->parsers_slots = 0;
+  st->parsers = NULL;
+  st->index = NULL;
+  st->index_slots = 0;
+  st->flags = flags;
 }
 
-mpc_val_t *mpcf_unescape_regex(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_raw_re, mpc_escape_output_raw_re);
-  free(x);
-  return y;
+static void mpca_grammar_st_delete(mpca_grammar_st_t *st) {
+  free(st->parsers);
+  free(st->index);
 }
 
-mpc_val_t *mpcf_escape_string_raw(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_raw_cstr, mpc_escape_output_raw_cstr);
-  free(x);
-  return y;
+/* Slot of the index holding the parser called x, or the empty one where it would go */
+static int mpca_grammar_index_slot(mpca_grammar_st_t *st, const char *x) {
+  int j, mask = st->index_slots - 1;
+  for (j = (int)(mpc_ast_tag_hash(x, strlen(x)) & mask); st->index[j]; j = (j + 1) & mask) {
+    if (strcmp(st->parsers[st->index[j]-1]->name, x) == 0) { return j; }
+  }
+  return j;
 }
 
-mpc_val_t *mpcf_unescape_string_raw(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_raw_cstr, mpc_escape_output_raw_cstr);
-  free(x);
-  return y;
-}
+static void mpca_grammar_index_add(mpca_grammar_st_t *st, int k) {
 
-mpc_val_t *mpcf_escape_char_raw(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_raw_cchar, mpc_escape_output_raw_cchar);
-  free(x);
-  return y;
-}
+  int j, slots, *index;
 
-mpc_val_t *mpcf_unescape_char_raw(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_raw_cchar, mpc_escape_output_raw_cchar);
-  free(x);
-  return y;
+  if ((st->parsers_num + 1) * 2 > st->index_slots) {
+    slots = st->index_slots;
+    index = st->index;
+    st->index_slots = slots ? slots * 2 : MPCA_GRAMMAR_PARSERS_MIN * 2;
+    st->index = calloc(st->index_slots, sizeof(int));
+    for (j = 0; j < slots; j++) {
+      if (index[j]) { st->index[mpca_grammar_index_slot(st, st->parsers[index[j]-1]->name)] = index[j]; }
+    }
+    free(index);
+  }
+
+  /* The first parser of a name is the one found */
+  j = mpca_grammar_index_slot(st, st->parsers[k]->name);
+  if (st->index[j] == 0) { st->index[j] = k + 1; }
 }
 
-mpc_val_t *mpcf_null(int n, mpc_val_t** xs) { (void) n; (void) xs; return NULL; }
-mpc_val_t *mpcf_fst(int n, mpc_val_t **xs) { (void) n; return xs[0]; }
-mpc_val_t *mpcf_snd(int n, mpc_val_t **xs) { (void) n; return xs[1]; }
-mpc_val_t *mpcf_trd(int n, mpc_val_t **xs) { (void) n; return xs[2]; }
+/* Takes the next parser from the argument list, NULL at its end */
+static mpc_parser_t *mpca_grammar_next(mpca_grammar_st_t *st) {
 
-static mpc_val_t *mpcf_nth_free(int n, mpc_val_t **xs, int x) {
-  int i;
-  for (i = 0; i < n; i++) {
-    if (i != x) { free(xs[i]); }
+  mpc_parser_t *p = va_arg(*st->va, mpc_parser_t*);
+
+  if (st->parsers_num == st->parsers_slots) {
+    st->parsers_slots = st->parsers_slots ? st->parsers_slots * 2 : MPCA_GRAMMAR_PARSERS_MIN;
+    st->parsers = realloc(st->parsers, sizeof(mpc_parser_t*) * st->parsers_slots);
   }
-  return xs[x];
+  st->parsers[st->parsers_num++] = p;
+
+  if (p == NULL) { return p; }
+  p->id = st->parsers_num;
+  if (p->name) { mpca_grammar_index_add(st, st->parsers_num-1); }
+  return p;
 }
 
-mpc_val_t *mpcf_fst_free(int n, mpc_val_t **xs) { return mpcf_nth_free(n, xs, 0); }
-mpc_val_t *mpcf_snd_free(int n, mpc_val_t **xs) { return mpcf_nth_free(n, xs, 1); }
-mpc_val_t *mpcf_trd_free(int n, mpc_val_t **xs) { return mpcf_nth_free(n, xs, 2); }
-mpc_val_t *mpcf_all_free(int n, mpc_val_t** xs) {
+static mpc_val_t *mpcaf_grammar_or(int n, mpc_val_t **xs) {
+  (void) n;
+  if (xs[1] == NULL) { return xs[0]; }
+  else { return mpca_or(2, xs[0], xs[1]); }
+}
+
+static mpc_val_t *mpcaf_grammar_and(int n, mpc_val_t **xs) {
   int i;
+  mpc_parser_t *p = mpc_pass();
   for (i = 0; i < n; i++) {
-    free(xs[i]);
+    if (xs[i] != NULL) { p = mpca_and(2, p, xs[i]); }
   }
-  return NULL;
+  return p;
 }
 
-mpc_val_t *mpcf_strfold(int n, mpc_val_t **xs) {
-  int i;
-  size_t l = 0;
-
-  if (n == 0) { return calloc(1, 1); }
-
-  for (i = 0; i < n; i++) { l += strlen(xs[i]); }
-
-  xs[0] = realloc(xs[0], l + 1);
-
-  for (i = 1; i < n; i++) {
-    strcat(xs[0], xs[i]); free(xs[i]);
+static mpc_val_t *mpcaf_grammar_repeat(int n, mpc_val_t **xs) {
+  int num;
+  (void) n;
+  if (xs[1] == NULL) { return xs[0]; }
+  switch(((char*)xs[1])[0])
+  {
+    case '*': { free(xs[1]); return mpca_many(xs[0]); }; break;
+    case '+': { free(xs[1]); return mpca_many1(xs[0]); }; break;
+    case '?': { free(xs[1]); return mpca_maybe(xs[0]); }; break;
+    case '!': { free(xs[1]); return mpca_not(xs[0]); }; break;
+    default:
+      num = *((int*)xs[1]);
+      free(xs[1]);
   }
-
-  return xs[0];
+  return mpca_count(num, xs[0]);
 }
 
-/*
-** Printing
-*/
-
-static void mpc_print_unretained(mpc_parser_t *p, int force) {
-
-  /* TODO: Print Everything Escaped */
-
-  int i;
-  char *s, *e;
-  char buff[2];
+/* Tags the node of a literal, which stays punctuation unless a rule names it */
+static mpc_val_t *mpcaf_grammar_punct(mpc_val_t *x, void *t) {
+  mpc_ast_t *a = mpc_ast_tag(x, t);
+  a->punct = 1;
+  return a;
+}
 
-  if (p->retained && !force) {;
-    if (p->name) { printf("<%s>", p->name); }
-    else { printf("<anon>"); }
-    return;
-  }
+/* Tags the result of a named rule, which takes its ID if no inner rule gave one */
+static mpc_val_t *mpcaf_grammar_rule(mpc_val_t *x, void *p) {
+  mpc_parser_t *q = p;
+  mpc_ast_t *a = mpc_ast_add_tag(x, q->name);
+  if (a == NULL) { return a; }
+  if (a->id == 0) { a->id = q->id; }
+  a->punct = 0;
+  return a;
+}
 
-  if (p->type == MPC_TYPE_UNDEFINED) { printf("<?>"); }
-  if (p->type == MPC_TYPE_PASS)   { printf("<:>"); }
-  if (p->type == MPC_TYPE_FAIL)   { printf("<!>"); }
-  if (p->type == MPC_TYPE_LIFT)   { printf("<#>"); }
-  if (p->type == MPC_TYPE_STATE)  { printf("<S>"); }
-  if (p->type == MPC_TYPE_ANCHOR) { printf("<@>"); }
-  if (p->type == MPC_TYPE_EXPECT) {
-    printf("%s", p->data.expect.m);
-    /*mpc_print_unretained(p->data.expect.x, 0);*/
-  }
+static mpc_val_t *mpcaf_grammar_string(mpc_val_t *x, void *s) {
+  mpca_grammar_st_t *st = s;
+  char *y = mpcf_unescape(x);
+  mpc_parser_t *p = (st->flags & MPCA_LANG_WHITESPACE_SENSITIVE) ? mpc_string(y) : mpc_tok(mpc_string(y));
+  free(y);
+  return mpca_state(mpc_apply_to(mpc_apply(p, mpcf_str_ast), mpcaf_grammar_punct, "string"));
+}
 
-  if (p->type == MPC_TYPE_ANY) { printf("<.>"); }
-  if (p->type == MPC_TYPE_SATISFY) { printf("<f>"); }
+static mpc_val_t *mpcaf_grammar_char(mpc_val_t *x, void *s) {
+  mpca_grammar_st_t *st = s;
+  char *y = mpcf_unescape(x);
+  mpc_parser_t *p = (st->flags & MPCA_LANG_WHITESPACE_SENSITIVE) ? mpc_char(y[0]) : mpc_tok(mpc_char(y[0]));
+  free(y);
+  return mpca_state(mpc_apply_to(mpc_apply(p, mpcf_str_ast), mpcaf_grammar_punct, "char"));
+}
 
-  if (p->type == MPC_TYPE_SINGLE) {
-    buff[0] = p->data.single.x; buff[1] = '\0';
-    s = mpcf_escape_new(
-      buff,
-      mpc_escape_input_c,
-      mpc_escape_output_c);
-    printf("'%s'", s);
-    free(s);
-  }
+static mpc_val_t *mpcaf_fold_regex(int n, mpc_val_t **xs) {
+  char *y = xs[0];
+  char *m = xs[1];
+  mpca_grammar_st_t *st = xs[2];
+  mpc_parser_t *p;
+  int mode = MPC_RE_DEFAULT;
 
-  if (p->type == MPC_TYPE_RANGE) {
-    buff[0] = p->data.range.x; buff[1] = '\0';
-    s = mpcf_escape_new(
-      buff,
-      mpc_escape_input_c,
-      mpc_escape_output_c);
-    buff[0] = p->data.range.y; buff[1] = '\0';
-    e = mpcf_escape_new(
-      buff,
-      mpc_escape_input_c,
-      mpc_escape_output_c);
-    printf("[%s-%s]", s, e);
-    free(s);
-    free(e);
-  }
+  (void)n;
+  if (strchr(m, 'm')) { mode |= MPC_RE_MULTILINE; }
+  if (strchr(m, 's')) { mode |= MPC_RE_DOTALL; }
+  y = mpcf_unescape_regex(y);
+  p = (st->flags & MPCA_LANG_WHITESPACE_SENSITIVE) ? mpc_re_mode(y, mode) : mpc_tok(mpc_re_mode(y, mode));
+  free(y);
+  free(m);
 
-  if (p->type == MPC_TYPE_ONEOF) {
-    s = mpcf_escape_new(
-      p->data.string.x,
-      mpc_escape_input_c,
-      mpc_escape_output_c);
-    printf("[%s]", s);
-    free(s);
-  }
+  return mpca_state(mpc_apply_to(mpc_apply(p, mpcf_str_ast), mpcaf_grammar_punct, "regex"));
+}
 
-  if (p->type == MPC_TYPE_NONEOF) {
-    s = mpcf_escape_new(
-      p->data.string.x,
-      mpc_escape_input_c,
-      mpc_escape_output_c);
-    printf("[^%s]", s);
-    free(s);
-  }
+/* Should this just use `isdigit` instead? */
+static int is_number(const char* s) {
+  size_t i;
+  for (i = 0; i < strlen(s); i++) { if (!strchr("0123456789", s[i])) { return 0; } }
+  return 1;
+}
 
-  if (p->type == MPC_TYPE_STRING) {
-    s = mpcf_escape_new(
-      p->data.string.x,
-      mpc_escape_input_c,
-      mpc_escape_output_c);
-    printf("\"%s\"", s);
-    free(s);
-  }
+static mpc_parser_t *mpca_grammar_find_parser(char *x, mpca_grammar_st_t *st) {
 
-  if (p->type == MPC_TYPE_APPLY)    { mpc_print_unretained(p->data.apply.x, 0); }
-  if (p->type == MPC_TYPE_APPLY_TO) { mpc_print_unretained(p->data.apply_to.x, 0); }
-  if (p->type == MPC_TYPE_PREDICT)  { mpc_print_unretained(p->data.predict.x, 0); }
+  int i;
+  mpc_parser_t *p;
 
-  if (p->type == MPC_TYPE_NOT)   { mpc_print_unretained(p->data.not.x, 0); printf("!"); }
-  if (p->type == MPC_TYPE_MAYBE) { mpc_print_unretained(p->data.not.x, 0); printf("?"); }
+  /* Case of Number */
+  if (is_number(x)) {
 
-  if (p->type == MPC_TYPE_MANY)  { mpc_print_unretained(p->data.repeat.x, 0); printf("*"); }
-  if (p->type == MPC_TYPE_MANY1) { mpc_print_unretained(p->data.repeat.x, 0); printf("+"); }
-  if (p->type == MPC_TYPE_COUNT) { mpc_print_unretained(p->data.repeat.x, 0); printf("{%i}", p->data.repeat.n); }
-  if (p->type == MPC_TYPE_SEPBY1) {
-    mpc_print_unretained(p->data.sepby1.x, 0);
-    printf(" (");
-    mpc_print_unretained(p->data.sepby1.sep, 0);
-    printf(" ");
-    mpc_print_unretained(p->data.sepby1.x, 0);
-    printf(")");
-    printf("*");
-  }
+    i = strtol(x, NULL, 10);
 
-  if (p->type == MPC_TYPE_OR) {
-    printf("(");
-    for(i = 0; i < p->data.or.n-1; i++) {
-      mpc_print_unretained(p->data.or.xs[i], 0);
-      printf(" | ");
+    while (st->parsers_num <= i) {
+      if (mpca_grammar_next(st) == NULL) {
+        return mpc_failf("No Parser in position %i! Only supplied %i Parsers!", i, st->parsers_num);
+      }
     }
-    mpc_print_unretained(p->data.or.xs[p->data.or.n-1], 0);
-    printf(")");
-  }
 
-  if (p->type == MPC_TYPE_AND) {
-    printf("(");
-    for(i = 0; i < p->data.and.n-1; i++) {
-      mpc_print_unretained(p->data.and.xs[i], 0);
-      printf(" ");
-    }
-    mpc_print_unretained(p->data.and.xs[p->data.and.n-1], 0);
-    printf(")");
-  }
+    return st->parsers[st->parsers_num-1];
 
-  if (p->type == MPC_TYPE_CHECK) {
-    mpc_print_unretained(p->data.check.x, 0);
-    printf("->?");
-  }
-  if (p->type == MPC_TYPE_CHECK_WITH) {
-    mpc_print_unretained(p->data.check_with.x, 0);
-    printf("->?");
-  }
+  /* Case of Identifier */
+  } else {
 
-}
+    /* Search Existing Parsers */
+    if (st->index_slots) {
+      i = st->index[mpca_grammar_index_slot(st, x)];
+      if (i) { return st->parsers[i-1]; }
+    }
 
-void mpc_print(mpc_parser_t *p) {
-  mpc_print_unretained(p, 1);
-  printf("\n");
-}
+    if (st->parsers_num && st->parsers[st->parsers_num-1] == NULL) {
+      return mpc_failf("Unknown Parser '%s'!", x);
+    }
 
-/*
-** Testing
-*/
+    /* Search New Parsers */
+    while (1) {
 
-/*
-** These functions are slightly unwieldy and
-** also the whole of the testing suite for mpc
-** mpc is pretty shaky.
-**
-** It could do with a lot more tests and more
-** precision. Currently I am only really testing
-** changes off of the examples.
-**
-*/
+      p = mpca_grammar_next(st);
 
-int mpc_test_fail(mpc_parser_t *p, const char *s, const void *d,
-  int(*tester)(const void*, const void*),
-  mpc_dtor_t destructor,
-  void(*printer)(const void*)) {
-  mpc_result_t r;
-  (void) printer;
-  if (mpc_parse("<test>", s, p, &r)) {
+      if (p == NULL || p->name == NULL) { return mpc_failf("Unknown Parser '%s'!", x); }
+      if (p->name && strcmp(p->name, x) == 0) { return p; }
 
-    if (tester(r.output, d)) {
-      destructor(r.output);
-      return 0;
-    } else {
-      destructor(r.output);
-      return 1;
     }
 
-  } else {
-    mpc_err_delete(r.error);
-    return 1;
   }
 
 }
 
-int mpc_test_pass(mpc_parser_t *p, const char *s, const void *d,
-  int(*tester)(const void*, const void*),
-  mpc_dtor_t destructor,
-  void(*printer)(const void*)) {
-
-  mpc_result_t r;
-  if (mpc_parse("<test>", s, p, &r)) {
+static mpc_val_t *mpcaf_grammar_id(mpc_val_t *x, void *s) {
 
-    if (tester(r.output, d)) {
-      destructor(r.output);
-      return 1;
-    } else {
-      printf("Got "); printer(r.output); printf("\n");
-      printf("Expected "); printer(d); printf("\n");
-      destructor(r.output);
-      return 0;
-    }
+  mpca_grammar_st_t *st = s;
+  mpc_parser_t *p = mpca_grammar_find_parser(x, st);
+  free(x);
 
+  if (p->name) {
+    return mpca_state(mpca_root(mpc_apply_to(p, mpcaf_grammar_rule, p)));
   } else {
-    mpc_err_print(r.error);
-    mpc_err_delete(r.error);
-    return 0;
-
+    return mpca_state(mpca_root(p));
   }
-
 }
 
+mpc_parser_t *mpca_grammar_st(const char *grammar, mpca_grammar_st_t *st) {
 
-/*
-** AST
-*/
-
-void mpc_ast_delete(mpc_ast_t *a) {
-
-  int i;
+  char *err_msg;
+  mpc_parser_t *err_out;
+  mpc_result_t r;
+  mpc_parser_t *GrammarTotal, *Grammar, *Term, *Factor, *Base;
+  clock_t start = clock();
 
-  if (a == NULL) { return; }
+  GrammarTotal = mpc_new("grammar_total");
+  Grammar = mpc_new("grammar");
+  Term = mpc_new("term");
+  Factor = mpc_new("factor");
+  Base = mpc_new("base");
 
-  for (i = 0; i < a->children_num; i++) {
-    mpc_ast_delete(a->children[i]);
-  }
+  mpc_define(GrammarTotal,
+    mpc_predictive(mpc_total(Grammar, mpc_soft_delete))
+  );
 
-  free(a->children);
-  free(a->tag);
-  free(a->contents);
-  free(a);
+  mpc_define(Grammar, mpc_and(2, mpcaf_grammar_or,
+    Term,
+    mpc_maybe(mpc_and(2, mpcf_snd_free, mpc_sym("|"), Grammar, free)),
+    mpc_soft_delete
+  ));
 
-}
+  mpc_define(Term, mpc_many1(mpcaf_grammar_and, Factor));
 
-static void mpc_ast_delete_no_children(mpc_ast_t *a) {
-  free(a->children);
-  free(a->tag);
-  free(a->contents);
-  free(a);
-}
+  mpc_define(Factor, mpc_and(2, mpcaf_grammar_repeat,
+    Base,
+      mpc_or(6,
+        mpc_sym("*"),
+        mpc_sym("+"),
+        mpc_sym("?"),
+        mpc_sym("!"),
+        mpc_tok_brackets(mpc_int(), free),
+        mpc_pass()),
+    mpc_soft_delete
+  ));
 
-mpc_ast_t *mpc_ast_new(const char *tag, const char *contents) {
+  mpc_define(Base, mpc_or(5,
+    mpc_apply_to(mpc_tok(mpc_string_lit()), mpcaf_grammar_string, st),
+    mpc_apply_to(mpc_tok(mpc_char_lit()),   mpcaf_grammar_char, st),
+    mpc_tok(mpc_and(3, mpcaf_fold_regex, mpc_regex_lit(), mpc_many(mpcf_strfold, mpc_oneof("ms")), mpc_lift_val(st), free, free)),
+    mpc_apply_to(mpc_tok_braces(mpc_or(2, mpc_digits(), mpc_ident()), free), mpcaf_grammar_id, st),
+    mpc_tok_parens(Grammar, mpc_soft_delete)
+  ));
 
-  mpc_ast_t *a = malloc(sizeof(mpc_ast_t));
+  mpc_optimise(GrammarTotal);
+  mpc_optimise(Grammar);
+  mpc_optimise(Factor);
+  mpc_optimise(Term);
+  mpc_optimise(Base);
 
-  a->tag = malloc(strlen(tag) + 1);
-  strcpy(a->tag, tag);
+  if(!mpc_parse("<mpc_grammar_compiler>", grammar, GrammarTotal, &r)) {
+    err_msg = mpc_err_string(r.error);
+    err_out = mpc_failf("Invalid Grammar: %s", err_msg);
+    mpc_err_delete(r.error);
+    free(err_msg);
+    r.output = err_out;
+  }
 
-  a->contents = malloc(strlen(contents) + 1);
-  strcpy(a->contents, contents);
+  mpc_cleanup(5, GrammarTotal, Grammar, Term, Factor, Base);
 
-  a->state = mpc_state_new();
+  mpc_optimise(r.output);
 
-  a->children_num = 0;
-  a->children = NULL;
-  return a;
+  mpca_grammar_clock += clock() - start;
+  mpca_grammar_builds++;
+  return (st->flags & MPCA_LANG_PREDICTIVE) ? mpc_predictive(r.output) : r.output;
 
 }
 
-mpc_ast_t *mpc_ast_build(int n, const char *tag, ...) {
-
-  mpc_ast_t *a = mpc_ast_new(tag, "");
-
-  int i;
+mpc_parser_t *mpca_grammar(int flags, const char *grammar, ...) {
+  mpca_grammar_st_t st;
+  mpc_parser_t *res;
   va_list va;
-  va_start(va, tag);
+  va_start(va, grammar);
 
-  for (i = 0; i < n; i++) {
-    mpc_ast_add_child(a, va_arg(va, mpc_ast_t*));
-  }
+  mpca_grammar_st_init(&st, &va, flags);
 
+  res = mpca_grammar_st(grammar, &st);
+  mpca_grammar_st_delete(&st);
   va_end(va);
+  return res;
+}
 
-  return a;
+typedef struct {
+  char *ident;
+  char *name;
+  mpc_parser_t *grammar;
+} mpca_stmt_t;
 
+static mpc_val_t *mpca_stmt_afold(int n, mpc_val_t **xs) {
+  mpca_stmt_t *stmt = malloc(sizeof(mpca_stmt_t));
+  stmt->ident = ((char**)xs)[0];
+  stmt->name = ((char**)xs)[1];
+  stmt->grammar = ((mpc_parser_t**)xs)[3];
+  (void) n;
+  free(((char**)xs)[2]);
+  free(((char**)xs)[4]);
+
+  return stmt;
 }
 
-mpc_ast_t *mpc_ast_add_root(mpc_ast_t *a) {
+static mpc_val_t *mpca_stmt_fold(int n, mpc_val_t **xs) {
 
-  mpc_ast_t *r;
+  int i;
+  mpca_stmt_t **stmts = malloc(sizeof(mpca_stmt_t*) * (n+1));
 
-  if (a == NULL) { return a; }
-  if (a->children_num == 0) { return a; }
-  if (a->children_num == 1) { return a; }
+  for (i = 0; i < n; i++) {
+    stmts[i] = xs[i];
+  }
+  stmts[n] = NULL;
 
-  r = mpc_ast_new(">", "");
-  mpc_ast_add_child(r, a);
-  return r;
+  return stmts;
 }
 
-int mpc_ast_eq(mpc_ast_t *a, mpc_ast_t *b) {
-
-  int i;
+static void mpca_stmt_list_delete(mpc_val_t *x) {
 
-  if (strcmp(a->tag, b->tag) != 0) { return 0; }
-  if (strcmp(a->contents, b->contents) != 0) { return 0; }
-  if (a->children_num != b->children_num) { return 0; }
+  mpca_stmt_t **stmts = x;
 
-  for (i = 0; i < a->children_num; i++) {
-    if (!mpc_ast_eq(a->children[i], b->children[i])) { return 0; }
+  while(*stmts) {
+    mpca_stmt_t *stmt = *stmts;
+    free(stmt->ident);
+    free(stmt->name);
+    mpc_soft_delete(stmt->grammar);
+    free(stmt);
+    stmts++;
   }
+  free(x);
 
-  return 1;
 }
 
-mpc_ast_t *mpc_ast_add_child(mpc_ast_t *r, mpc_ast_t *a) {
-  r->children_num++;
-  r->children = realloc(r->children, sizeof(mpc_ast_t*) * r->children_num);
-  r->children[r->children_num-1] = a;
-  return r;
-}
+static mpc_val_t *mpca_stmt_list_apply_to(mpc_val_t *x, void *s) {
 
-mpc_ast_t *mpc_ast_add_tag(mpc_ast_t *a, const char *t) {
-  if (a == NULL) { return a; }
-  a->tag = realloc(a->tag, strlen(t) + 1 + strlen(a->tag) + 1);
-  memmove(a->tag + strlen(t) + 1, a->tag, strlen(a->tag)+1);
-  memmove(a->tag, t, strlen(t));
-  memmove(a->tag + strlen(t), "|", 1);
-  return a;
-}
+  mpca_grammar_st_t *st = s;
+  mpca_stmt_t *stmt;
+  mpca_stmt_t **stmts = x;
+  mpc_parser_t *left;
 
-mpc_ast_t *mpc_ast_add_root_tag(mpc_ast_t *a, const char *t) {
-  if (a == NULL) { return a; }
-  a->tag = realloc(a->tag, (strlen(t)-1) + strlen(a->tag) + 1);
-  memmove(a->tag + (strlen(t)-1), a->tag, strlen(a->tag)+1);
-  memmove(a->tag, t, (strlen(t)-1));
-  return a;
-}
+  while(*stmts) {
+    stmt = *stmts;
+    left = mpca_grammar_find_parser(stmt->ident, st);
+    if (st->flags & MPCA_LANG_PREDICTIVE) { stmt->grammar = mpc_predictive(stmt->grammar); }
+    if (stmt->name) { stmt->grammar = mpc_expect(stmt->grammar, stmt->name); }
+    mpc_optimise(stmt->grammar);
+    mpc_define(left, stmt->grammar);
+    free(stmt->ident);
+    free(stmt->name);
+    free(stmt);
+    stmts++;
+  }
 
-mpc_ast_t *mpc_ast_tag(mpc_ast_t *a, const char *t) {
-  a->tag = realloc(a->tag, strlen(t) + 1);
-  strcpy(a->tag, t);
-  return a;
-}
+  free(x);
 
-mpc_ast_t *mpc_ast_state(mpc_ast_t *a, mpc_state_t s) {
-  if (a == NULL) { return a; }
-  a->state = s;
-  return a;
+  return NULL;
 }
 
-static void mpc_ast_print_depth(mpc_ast_t *a, int d, FILE *fp) {
+static mpc_err_t *mpca_lang_st(mpc_input_t *i, mpca_grammar_st_t *st) {
 
-  int i;
+  mpc_result_t r;
+  mpc_err_t *e;
+  mpc_parser_t *Lang, *Stmt, *Grammar, *Term, *Factor, *Base;
+  clock_t start = clock();
 
-  if (a == NULL) {
-    fprintf(fp, "NULL\n");
-    return;
-  }
+  Lang    = mpc_new("lang");
+  Stmt    = mpc_new("stmt");
+  Grammar = mpc_new("grammar");
+  Term    = mpc_new("term");
+  Factor  = mpc_new("factor");
+  Base    = mpc_new("base");
 
-  for (i = 0; i < d; i++) { fprintf(fp, "  "); }
+  mpc_define(Lang, mpc_apply_to(
+    mpc_total(mpc_predictive(mpc_many(mpca_stmt_fold, Stmt)), mpca_stmt_list_delete),
+    mpca_stmt_list_apply_to, st
+  ));
 
-  if (strlen(a->contents)) {
-    fprintf(fp, "%s:%lu:%lu '%s'\n", a->tag,
-      (long unsigned int)(a->state.row+1),
-      (long unsigned int)(a->state.col+1),
-      a->contents);
-  } else {
-    fprintf(fp, "%s \n", a->tag);
-  }
+  mpc_define(Stmt, mpc_and(5, mpca_stmt_afold,
+    mpc_tok(mpc_ident()), mpc_maybe(mpc_tok(mpc_string_lit())), mpc_sym(":"), Grammar, mpc_sym(";"),
+    free, free, free, mpc_soft_delete
+  ));
 
-  for (i = 0; i < a->children_num; i++) {
-    mpc_ast_print_depth(a->children[i], d+1, fp);
+  mpc_define(Grammar, mpc_and(2, mpcaf_grammar_or,
+      Term,
+      mpc_maybe(mpc_and(2, mpcf_snd_free, mpc_sym("|"), Grammar, free)),
+      mpc_soft_delete
+  ));
+
+  mpc_define(Term, mpc_many1(mpcaf_grammar_and, Factor));
+
+  mpc_define(Factor, mpc_and(2, mpcaf_grammar_repeat,
+    Base,
+      mpc_or(6,
+        mpc_sym("*"),
+        mpc_sym("+"),
+        mpc_sym("?"),
+        mpc_sym("!"),
+        mpc_tok_brackets(mpc_int(), free),
+        mpc_pass()),
+    mpc_soft_delete
+  ));
+
+  mpc_define(Base, mpc_or(5,
+    mpc_apply_to(mpc_tok(mpc_string_lit()), mpcaf_grammar_string, st),
+    mpc_apply_to(mpc_tok(mpc_char_lit()),   mpcaf_grammar_char, st),
+    mpc_tok(mpc_and(3, mpcaf_fold_regex, mpc_regex_lit(), mpc_many(mpcf_strfold, mpc_oneof("ms")), mpc_lift_val(st), free, free)),
+    mpc_apply_to(mpc_tok_braces(mpc_or(2, mpc_digits(), mpc_ident()), free), mpcaf_grammar_id, st),
+    mpc_tok_parens(Grammar, mpc_soft_delete)
+  ));
+
+  mpc_optimise(Lang);
+  mpc_optimise(Stmt);
+  mpc_optimise(Grammar);
+  mpc_optimise(Term);
+  mpc_optimise(Factor);
+  mpc_optimise(Base);
+
+  if (!mpc_parse_input(i, Lang, &r)) {
+    e = r.error;
+  } else {
+    e = NULL;
   }
 
-}
+  mpc_cleanup(6, Lang, Stmt, Grammar, Term, Factor, Base);
 
-void mpc_ast_print(mpc_ast_t *a) {
-  mpc_ast_print_depth(a, 0, stdout);
+  mpca_grammar_clock += clock() - start;
+  mpca_grammar_builds++;
+  return e;
 }
 
-void mpc_ast_print_to(mpc_ast_t *a, FILE *fp) {
-  mpc_ast_print_depth(a, 0, fp);
-}
+mpc_err_t *mpca_lang_file(int flags, FILE *f, ...) {
+  mpca_grammar_st_t st;
+  mpc_input_t *i;
+  mpc_err_t *err;
 
-int mpc_ast_get_index(mpc_ast_t *ast, const char *tag) {
-  return mpc_ast_get_index_lb(ast, tag, 0);
-}
+  va_list va;
+  va_start(va, f);
 
-int mpc_ast_get_index_lb(mpc_ast_t *ast, const char *tag, int lb) {
-  int i;
+  mpca_grammar_st_init(&st, &va, flags);
 
-  for(i=lb; i<ast->children_num; i++) {
-    if(strcmp(ast->children[i]->tag, tag) == 0) {
-      return i;
-    }
-  }
+  i = mpc_input_new_file("<mpca_lang_file>", f);
+  err = mpca_lang_st(i, &st);
+  mpc_input_delete(i);
 
-  return -1;
+  mpca_grammar_st_delete(&st);
+  va_end(va);
+  return err;
 }
 
-mpc_ast_t *mpc_ast_get_child(mpc_ast_t *ast, const char *tag) {
-  return mpc_ast_get_child_lb(ast, tag, 0);
-}
+mpc_err_t *mpca_lang_pipe(int flags, FILE *p, ...) {
+  mpca_grammar_st_t st;
+  mpc_input_t *i;
+  mpc_err_t *err;
 
-mpc_ast_t *mpc_ast_get_child_lb(mpc_ast_t *ast, const char *tag, int lb) {
-  int i;
+  va_list va;
+  va_start(va, p);
 
-  for(i=lb; i<ast->children_num; i++) {
-    if(strcmp(ast->children[i]->tag, tag) == 0) {
-      return ast->children[i];
-    }
-  }
+  mpca_grammar_st_init(&st, &va, flags);
 
-  return NULL;
+  i = mpc_input_new_pipe("<mpca_lang_pipe>", p);
+  err = mpca_lang_st(i, &st);
+  mpc_input_delete(i);
+
+  mpca_grammar_st_delete(&st);
+  va_end(va);
+  return err;
 }
 
-mpc_ast_trav_t *mpc_ast_traverse_start(mpc_ast_t *ast,
-                                       mpc_ast_trav_order_t order)
-{
-  mpc_ast_trav_t *trav, *n_trav;
-  mpc_ast_t *cnode = ast;
+mpc_err_t *mpca_lang(int flags, const char *language, ...) {
 
-  /* Create the traversal structure */
-  trav = malloc(sizeof(mpc_ast_trav_t));
-  trav->curr_node = cnode;
-  trav->parent = NULL;
-  trav->curr_child = 0;
-  trav->order = order;
+  mpca_grammar_st_t st;
+  mpc_input_t *i;
+  mpc_err_t *err;
 
-  /* Get start node */
-  switch(order) {
-    case mpc_ast_trav_order_pre:
-      /* Nothing else is needed for pre order start */
-      break;
+  va_list va;
+  va_start(va, language);
 
-    case mpc_ast_trav_order_post:
-      while(cnode->children_num > 0) {
-        cnode = cnode->children[0];
+  mpca_grammar_st_init(&st, &va, flags);
 
-        n_trav = malloc(sizeof(mpc_ast_trav_t));
-        n_trav->curr_node = cnode;
-        n_trav->parent = trav;
-        n_trav->curr_child = 0;
-        n_trav->order = order;
+  i = mpc_input_new_string("<mpca_lang>", language);
+  err = mpca_lang_st(i, &st);
+  mpc_input_delete(i);
 
-        trav = n_trav;
-      }
+  mpca_grammar_st_delete(&st);
+  va_end(va);
+  return err;
+}
 
-      break;
+mpc_err_t *mpca_lang_contents(int flags, const char *filename, ...) {
 
-    default:
-      /* Unreachable, but compiler complaints */
-      break;
-  }
+  mpca_grammar_st_t st;
+  mpc_input_t *i;
+  mpc_err_t *err;
 
-  return trav;
-}
+  va_list va;
 
-mpc_ast_t *mpc_ast_traverse_next(mpc_ast_trav_t **trav) {
-  mpc_ast_trav_t *n_trav, *to_free;
-  mpc_ast_t *ret = NULL;
-  int cchild;
+  FILE *f = fopen(filename, "rb");
 
-  /* The end of traversal was reached */
-  if(*trav == NULL) return NULL;
+  if (f == NULL) {
+    err = mpc_err_file(filename, "Unable to open file!");
+    return err;
+  }
 
-  switch((*trav)->order) {
-    case mpc_ast_trav_order_pre:
-      ret = (*trav)->curr_node;
+  va_start(va, filename);
 
-      /* If there aren't any more children, go up */
-      while(*trav != NULL &&
-        (*trav)->curr_child >= (*trav)->curr_node->children_num)
-      {
-        to_free = *trav;
-        *trav = (*trav)->parent;
-        free(to_free);
-      }
+  mpca_grammar_st_init(&st, &va, flags);
 
-      /* If trav is NULL, the end was reached */
-      if(*trav == NULL) {
-        break;
-      }
+  i = mpc_input_new_file(filename, f);
+  err = mpca_lang_st(i, &st);
+  mpc_input_delete(i);
 
-      /* Go to next child */
-      n_trav = malloc(sizeof(mpc_ast_trav_t));
+  mpca_grammar_st_delete(&st);
+  va_end(va);
 
-      cchild = (*trav)->curr_child;
-      n_trav->curr_node = (*trav)->curr_node->children[cchild];
-      n_trav->parent = *trav;
-      n_trav->curr_child = 0;
-      n_trav->order = (*trav)->order;
+  fclose(f);
 
-      (*trav)->curr_child++;
-      *trav = n_trav;
+  return err;
+}
 
-      break;
+static int mpc_nodecount_unretained(mpc_parser_t* p, int force) {
 
-    case mpc_ast_trav_order_post:
-      ret = (*trav)->curr_node;
+  int i, total;
 
-      /* Move up tree to the parent If the parent doesn't have any more nodes,
-       * then this is the current node. If it does, move down to its left most
-       * child. Also, free the previous traversal node */
-      to_free = *trav;
-      *trav = (*trav)->parent;
-      free(to_free);
+  if (p->retained && !force) { return 0; }
 
-      if(*trav == NULL)
-        break;
+  if (p->type == MPC_TYPE_EXPECT) { return 1 + mpc_nodecount_unretained(p->data.expect.x, 0); }
 
-      /* Next child */
-      (*trav)->curr_child++;
+  if (p->type == MPC_TYPE_APPLY)    { return 1 + mpc_nodecount_unretained(p->data.apply.x, 0); }
+  if (p->type == MPC_TYPE_APPLY_TO) { return 1 + mpc_nodecount_unretained(p->data.apply_to.x, 0); }
+  if (p->type == MPC_TYPE_PREDICT)  { return 1 + mpc_nodecount_unretained(p->data.predict.x, 0); }
 
-      /* If there aren't any more children, this is the next node */
-      if((*trav)->curr_child >= (*trav)->curr_node->children_num) {
-        break;
-      }
+  if (p->type == MPC_TYPE_CHECK)    { return 1 + mpc_nodecount_unretained(p->data.check.x, 0); }
+  if (p->type == MPC_TYPE_CHECK_WITH) { return 1 + mpc_nodecount_unretained(p->data.check_with.x, 0); }
 
-      /* If there are still more children, find the leftmost child from this
-       * node */
-      while((*trav)->curr_node->children_num > 0) {
-        n_trav = malloc(sizeof(mpc_ast_trav_t));
+  if (p->type == MPC_TYPE_DFA) { return 1 + mpc_nodecount_unretained(p->data.dfa.x, 0); }
 
-        cchild = (*trav)->curr_child;
-        n_trav->curr_node = (*trav)->curr_node->children[cchild];
-        n_trav->parent = *trav;
-        n_trav->curr_child = 0;
-        n_trav->order = (*trav)->order;
+  if (p->type == MPC_TYPE_NOT)   { return 1 + mpc_nodecount_unretained(p->data.not.x, 0); }
+  if (p->type == MPC_TYPE_MAYBE) { return 1 + mpc_nodecount_unretained(p->data.not.x, 0); }
 
-        *trav = n_trav;
-      }
+  if (p->type == MPC_TYPE_MANY)  { return 1 + mpc_nodecount_unretained(p->data.repeat.x, 0); }
+  if (p->type == MPC_TYPE_MANY1) { return 1 + mpc_nodecount_unretained(p->data.repeat.x, 0); }
+  if (p->type == MPC_TYPE_COUNT) { return 1 + mpc_nodecount_unretained(p->data.repeat.x, 0); }
+  if (p->type == MPC_TYPE_SEPBY1) {
+    total = 1;
+    total += mpc_nodecount_unretained(p->data.sepby1.x, 0);
+    total += mpc_nodecount_unretained(p->data.sepby1.sep, 0);
+    total += mpc_nodecount_unretained(p->data.sepby1.x, 0);
+    return total;
+  }
 
-    default:
-      /* Unreachable, but compiler complaints */
-      break;
+  if (p->type == MPC_TYPE_OR) {
+    total = 1;
+    for(i = 0; i < p->data.or.n; i++) {
+      total += mpc_nodecount_unretained(p->data.or.xs[i], 0);
+    }
+    return total;
   }
 
-  return ret;
-}
+  if (p->type == MPC_TYPE_AND) {
+    total = 1;
+    for(i = 0; i < p->data.and.n; i++) {
+      total += mpc_nodecount_unretained(p->data.and.xs[i], 0);
+    }
+    return total;
+  }
 
-void mpc_ast_traverse_free(mpc_ast_trav_t **trav) {
-  mpc_ast_trav_t *n_trav;
+  return 1;
 
-  /* Go through parents until all are free */
-  while(*trav != NULL) {
-      n_trav = (*trav)->parent;
-      free(*trav);
-      *trav = n_trav;
-  }
 }
 
-mpc_val_t *mpcf_fold_ast(int n, mpc_val_t **xs) {
+void mpc_stats(mpc_parser_t* p) {
+  printf("Stats\n");
+  printf("=====\n");
+  printf("Node Count: %i\n", mpc_nodecount_unretained(p, 1));
+  printf("Pool Hits: %lu\n", mpc_mem_hits);
+  printf("Pool Fallbacks: %lu\n", mpc_mem_fallbacks);
+  printf("Memo Hits: %lu\n", mpc_memo_hits);
+  printf("Grammar Builds: %lu\n", mpca_grammar_builds);
+  printf("Grammar Build Time: %.3f ms\n", 1000.0 * mpca_grammar_clock / CLOCKS_PER_SEC);
+}
 
-  int i, j;
-  mpc_ast_t** as = (mpc_ast_t**)xs;
-  mpc_ast_t *r;
+static void mpc_optimise_unretained(mpc_parser_t *p, int force) {
 
-  if (n == 0) { return NULL; }
-  if (n == 1) { return xs[0]; }
-  if (n == 2 && xs[1] == NULL) { return xs[0]; }
-  if (n == 2 && xs[0] == NULL) { return xs[1]; }
+  int i, n, m;
+  mpc_parser_t *t;
 
-  r = mpc_ast_new(">", "");
+  if (p->retained && !force) { return; }
 
-  for (i = 0; i < n; i++) {
+  /* Optimise Subexpressions */
 
-    if (as[i] == NULL) { continue; }
+  if (p->type == MPC_TYPE_EXPECT)     { mpc_optimise_unretained(p->data.expect.x, 0); }
+  if (p->type == MPC_TYPE_APPLY)      { mpc_optimise_unretained(p->data.apply.x, 0); }
+  if (p->type == MPC_TYPE_APPLY_TO)   { mpc_optimise_unretained(p->data.apply_to.x, 0); }
+  if (p->type == MPC_TYPE_CHECK)      { mpc_optimise_unretained(p->data.check.x, 0); }
+  if (p->type == MPC_TYPE_CHECK_WITH) { mpc_optimise_unretained(p->data.check_with.x, 0); }
+  if (p->type == MPC_TYPE_PREDICT)    { mpc_optimise_unretained(p->data.predict.x, 0); }
+  if (p->type == MPC_TYPE_NOT)        { mpc_optimise_unretained(p->data.not.x, 0); }
+  if (p->type == MPC_TYPE_MAYBE)      { mpc_optimise_unretained(p->data.not.x, 0); }
+  if (p->type == MPC_TYPE_MANY)       { mpc_optimise_unretained(p->data.repeat.x, 0); }
+  if (p->type == MPC_TYPE_MANY1)      { mpc_optimise_unretained(p->data.repeat.x, 0); }
+  if (p->type == MPC_TYPE_COUNT)      { mpc_optimise_unretained(p->data.repeat.x, 0); }
+  if (p->type == MPC_TYPE_SEPBY1)     {
+    mpc_optimise_unretained(p->data.sepby1.x, 0);
+    mpc_optimise_unretained(p->data.sepby1.sep, 0);
+  }
 
-    if        (as[i] && as[i]->children_num == 0) {
-      mpc_ast_add_child(r, as[i]);
-    } else if (as[i] && as[i]->children_num == 1) {
-      mpc_ast_add_child(r, mpc_ast_add_root_tag(as[i]->children[0], as[i]->tag));
-      mpc_ast_delete_no_children(as[i]);
-    } else if (as[i] && as[i]->children_num >= 2) {
-      for (j = 0; j < as[i]->children_num; j++) {
-        mpc_ast_add_child(r, as[i]->children[j]);
-      }
-      mpc_ast_delete_no_children(as[i]);
+  if (p->type == MPC_TYPE_OR) {
+    for(i = 0; i < p->data.or.n; i++) {
+      mpc_optimise_unretained(p->data.or.xs[i], 0);
     }
-
   }
 
-  if (r->children_num) {
-    r->state = r->children[0]->state;
+  if (p->type == MPC_TYPE_AND) {
+    for(i = 0; i < p->data.and.n; i++) {
+      mpc_optimise_unretained(p->data.and.xs[i], 0);
+    }
   }
 
-  return r;
-}
+  /* Perform optimisations */
 
-mpc_val_t *mpcf_str_ast(mpc_val_t *c) {
-  mpc_ast_t *a = mpc_ast_new("", c);
-  free(c);
-  return a;
-}
+  while (1) {
 
-mpc_val_t *mpcf_state_ast(int n, mpc_val_t **xs) {
-  mpc_state_t *s = ((mpc_state_t**)xs)[0];
-  mpc_ast_t *a = ((mpc_ast_t**)xs)[1];
-  (void)n;
-  a = mpc_ast_state(a, *s);
-  free(s);
-  return a;
-}
+    /* Merge rhs `or` */
+    if (p->type == MPC_TYPE_OR
+    &&  p->data.or.xs[p->data.or.n-1]->type == MPC_TYPE_OR
+    && !p->data.or.xs[p->data.or.n-1]->retained) {
+      t = p->data.or.xs[p->data.or.n-1];
+      n = p->data.or.n; m = t->data.or.n;
+      p->data.or.n = n + m - 1;
+      p->data.or.xs = realloc(p->data.or.xs, sizeof(mpc_parser_t*) * (n + m -1));
+      memmove(p->data.or.xs + n - 1, t->data.or.xs, m * sizeof(mpc_parser_t*));
+      free(t->data.or.xs); free(t->data.or.first); free(t->data.or.jump);
+      free(t->name); free(t);
+      continue;
+    }
 
-mpc_parser_t *mpca_state(mpc_parser_t *a) {
-  return mpc_and(2, mpcf_state_ast, mpc_state(), a, free);
-}
+    /* Merge lhs `or` */
+    if (p->type == MPC_TYPE_OR
+    &&  p->data.or.xs[0]->type == MPC_TYPE_OR
+    && !p->data.or.xs[0]->retained) {
+      t = p->data.or.xs[0];
+      n = p->data.or.n; m = t->data.or.n;
+      p->data.or.n = n + m - 1;
+      p->data.or.xs = realloc(p->data.or.xs, sizeof(mpc_parser_t*) * (n + m -1));
+      memmove(p->data.or.xs + m, p->data.or.xs + 1, (n - 1) * sizeof(mpc_parser_t*));
+      memmove(p->data.or.xs, t->data.or.xs, m * sizeof(mpc_parser_t*));
+      free(t->data.or.xs); free(t->data.or.first); free(t->data.or.jump);
+      free(t->name); free(t);
+      continue;
+    }
 
-mpc_parser_t *mpca_tag(mpc_parser_t *a, const char *t) {
-  return mpc_apply_to(a, (mpc_apply_to_t)mpc_ast_tag, (void*)t);
-}
+    /* Remove ast `pass` */
+    if (p->type == MPC_TYPE_AND
+    &&  p->data.and.n == 2
+    &&  p->data.and.xs[0]->type == MPC_TYPE_PASS
+    && !p->data.and.xs[0]->retained
+    &&  p->data.and.f == mpcf_fold_ast) {
+      t = p->data.and.xs[1];
+      mpc_delete(p->data.and.xs[0]);
+      free(p->data.and.xs); free(p->data.and.dxs); free(p->name);
+      memcpy(p, t, sizeof(mpc_parser_t));
+      free(t);
+      continue;
+    }
 
-mpc_parser_t *mpca_add_tag(mpc_parser_t *a, const char *t) {
-  return mpc_apply_to(a, (mpc_apply_to_t)mpc_ast_add_tag, (void*)t);
-}
+    /* Merge ast lhs `and` */
+    if (p->type == MPC_TYPE_AND
+    &&  p->data.and.f == mpcf_fold_ast
+    &&  p->data.and.xs[0]->type == MPC_TYPE_AND
+    && !p->data.and.xs[0]->retained
+    &&  p->data.and.xs[0]->data.and.f == mpcf_fold_ast) {
+      t = p->data.and.xs[0];
+      n = p->data.and.n; m = t->data.and.n;
+      p->data.and.n = n + m - 1;
+      p->data.and.xs = realloc(p->data.and.xs, sizeof(mpc_parser_t*) * (n + m - 1));
+      p->data.and.dxs = realloc(p->data.and.dxs, sizeof(mpc_dtor_t) * (n + m - 1 - 1));
+      memmove(p->data.and.xs + m, p->data.and.xs + 1, (n - 1) * sizeof(mpc_parser_t*));
+      memmove(p->data.and.xs, t->data.and.xs, m * sizeof(mpc_parser_t*));
+      for (i = 0; i < p->data.and.n-1; i++) { p->data.and.dxs[i] = (mpc_dtor_t)mpc_ast_delete; }
+      free(t->data.and.xs); free(t->data.and.dxs); free(t->name); free(t);
+      continue;
+    }
 
-mpc_parser_t *mpca_root(mpc_parser_t *a) {
-  return mpc_apply(a, (mpc_apply_t)mpc_ast_add_root);
-}
+    /* Merge ast rhs `and` */
+    if (p->type == MPC_TYPE_AND
+    &&  p->data.and.f == mpcf_fold_ast
+    &&  p->data.and.xs[p->data.and.n-1]->type == MPC_TYPE_AND
+    && !p->data.and.xs[p->data.and.n-1]->retained
+    &&  p->data.and.xs[p->data.and.n-1]->data.and.f == mpcf_fold_ast) {
+      t = p->data.and.xs[p->data.and.n-1];
+      n = p->data.and.n; m = t->data.and.n;
+      p->data.and.n = n + m - 1;
+      p->data.and.xs = realloc(p->data.and.xs, sizeof(mpc_parser_t*) * (n + m -1));
+      p->data.and.dxs = realloc(p->data.and.dxs, sizeof(mpc_dtor_t) * (n + m - 1 - 1));
+      memmove(p->data.and.xs + n - 1, t->data.and.xs, m * sizeof(mpc_parser_t*));
+      for (i = 0; i < p->data.and.n-1; i++) { p->data.and.dxs[i] = (mpc_dtor_t)mpc_ast_delete; }
+      free(t->data.and.xs); free(t->data.and.dxs); free(t->name); free(t);
+      continue;
+    }
 
-mpc_parser_t *mpca_not(mpc_parser_t *a) { return mpc_not(a, (mpc_dtor_t)mpc_ast_delete); }
-mpc_parser_t *mpca_maybe(mpc_parser_t *a) { return mpc_maybe(a); }
-mpc_parser_t *mpca_many(mpc_parser_t *a) { return mpc_many(mpcf_fold_ast, a); }
-mpc_parser_t *mpca_many1(mpc_parser_t *a) { return mpc_many1(mpcf_fold_ast, a); }
-mpc_parser_t *mpca_count(int n, mpc_parser_t *a) { return mpc_count(n, mpcf_fold_ast, a, (mpc_dtor_t)mpc_ast_delete); }
+    /* Remove re `lift` */
+    if (p->type == MPC_TYPE_AND
+    &&  p->data.and.n == 2
+    &&  p->data.and.xs[0]->type == MPC_TYPE_LIFT
+    &&  p->data.and.xs[0]->data.lift.lf == mpcf_ctor_str
+    && !p->data.and.xs[0]->retained
+    &&  p->data.and.f == mpcf_strfold) {
+      t = p->data.and.xs[1];
+      mpc_delete(p->data.and.xs[0]);
+      free(p->data.and.xs); free(p->data.and.dxs); free(p->name);
+      memcpy(p, t, sizeof(mpc_parser_t));
+      free(t);
+      continue;
+    }
 
-mpc_parser_t *mpca_or(int n, ...) {
+    /* Merge re lhs `and` */
+    if (p->type == MPC_TYPE_AND
+    &&  p->data.and.f == mpcf_strfold
+    &&  p->data.and.xs[0]->type == MPC_TYPE_AND
+    && !p->data.and.xs[0]->retained
+    &&  p->data.and.xs[0]->data.and.f == mpcf_strfold) {
+      t = p->data.and.xs[0];
+      n = p->data.and.n; m = t->data.and.n;
+      p->data.and.n = n + m - 1;
+      p->data.and.xs = realloc(p->data.and.xs, sizeof(mpc_parser_t*) * (n + m - 1));
+      p->data.and.dxs = realloc(p->data.and.dxs, sizeof(mpc_dtor_t) * (n + m - 1 - 1));
+      memmove(p->data.and.xs + m, p->data.and.xs + 1, (n - 1) * sizeof(mpc_parser_t*));
+      memmove(p->data.and.xs, t->data.and.xs, m * sizeof(mpc_parser_t*));
+      for (i = 0; i < p->data.and.n-1; i++) { p->data.and.dxs[i] = free; }
+      free(t->data.and.xs); free(t->data.and.dxs); free(t->name); free(t);
+      continue;
+    }
 
-  int i;
-  va_list va;
+    /* Merge re rhs `and` */
+    if (p->type == MPC_TYPE_AND
+    &&  p->data.and.f == mpcf_strfold
+    &&  p->data.and.xs[p->data.and.n-1]->type == MPC_TYPE_AND
+    && !p->data.and.xs[p->data.and.n-1]->retained
+    &&  p->data.and.xs[p->data.and.n-1]->data.and.f == mpcf_strfold) {
+      t = p->data.and.xs[p->data.and.n-1];
+      n = p->data.and.n; m = t->data.and.n;
+      p->data.and.n = n + m - 1;
+      p->data.and.xs = realloc(p->data.and.xs, sizeof(mpc_parser_t*) * (n + m -1));
+      p->data.and.dxs = realloc(p->data.and.dxs, sizeof(mpc_dtor_t) * (n + m - 1 - 1));
+      memmove(p->data.and.xs + n - 1, t->data.and.xs, m * sizeof(mpc_parser_t*));
+      for (i = 0; i < p->data.and.n-1; i++) { p->data.and.dxs[i] = free; }
+      free(t->data.and.xs); free(t->data.and.dxs); free(t->name); free(t);
+      continue;
+    }
 
-  mpc_parser_t *p = mpc_undefined();
+    if (p->type == MPC_TYPE_OR) { mpc_first_compile(p); }
 
-  p->type = MPC_TYPE_OR;
-  p->data.or.n = n;
-  p->data.or.xs = malloc(sizeof(mpc_parser_t*) * n);
+    return;
 
-  va_start(va, n);
-  for (i = 0; i < n; i++) {
-    p->data.or.xs[i] = va_arg(va, mpc_parser_t*);
   }
-  va_end(va);
 
-  return p;
+}
 
+void mpc_optimise(mpc_parser_t *p) {
+  mpc_optimise_unretained(p, 1);
 }
 
-mpc_parser_t *mpca_and(int n, ...) {
+/*
+** Images
+**
+** An image starts with the magic bytes, the format
+** version, the size of the function table below, a
+** hash of the grammar it was saved from, the number
+** of nodes and the number of roots. The nodes
+** follow, roots first, each as its type, name, ID and
+** fields. Other nodes are written as their index and
+** functions as their place in the table. Every node
+** but a root is referred to only by its owner, which
+** comes before it, so loading can check an image in
+** full before it allocates anything.
+*/
 
-  int i;
-  va_list va;
+#define MPC_IMAGE_MAGIC "MPCI"
 
-  mpc_parser_t *p = mpc_undefined();
+enum {
+  MPC_IMAGE_VERSION = 3,
+  MPC_IMAGE_HEADER = 24,
+  MPC_IMAGE_NODES_MIN = 64,
+  MPC_IMAGE_LINE = 12
+};
 
-  p->type = MPC_TYPE_AND;
-  p->data.and.n = n;
-  p->data.and.f = mpcf_fold_ast;
-  p->data.and.xs = malloc(sizeof(mpc_parser_t*) * n);
-  p->data.and.dxs = malloc(sizeof(mpc_dtor_t) * (n-1));
+enum {
+  MPC_IMAGE_FN_NONE,
+  MPC_IMAGE_FN_DTOR,
+  MPC_IMAGE_FN_CTOR,
+  MPC_IMAGE_FN_APPLY,
+  MPC_IMAGE_FN_APPLY_TAG,
+  MPC_IMAGE_FN_APPLY_RULE,
+  MPC_IMAGE_FN_FOLD,
+  MPC_IMAGE_FN_ANCHOR
+};
 
-  va_start(va, n);
-  for (i = 0; i < n; i++) {
-    p->data.and.xs[i] = va_arg(va, mpc_parser_t*);
-  }
-  for (i = 0; i < (n-1); i++) {
-    p->data.and.dxs[i] = (mpc_dtor_t)mpc_ast_delete;
-  }
-  va_end(va);
+typedef void (*mpc_image_fn_t)(void);
 
-  return p;
-}
+typedef struct {
+  mpc_image_fn_t f;
+  int kind;
+} mpc_image_entry_t;
+
+/* Appending to this table changes the format, so images saved before no longer load */
+static const mpc_image_entry_t mpc_image_fns[] = {
+  { NULL, MPC_IMAGE_FN_NONE },
+  { (mpc_image_fn_t)free, MPC_IMAGE_FN_DTOR },
+  { (mpc_image_fn_t)mpcf_dtor_null, MPC_IMAGE_FN_DTOR },
+  { (mpc_image_fn_t)mpc_ast_delete, MPC_IMAGE_FN_DTOR },
+  { (mpc_image_fn_t)mpc_soft_delete, MPC_IMAGE_FN_DTOR },
+  { (mpc_image_fn_t)mpcf_ctor_null, MPC_IMAGE_FN_CTOR },
+  { (mpc_image_fn_t)mpcf_ctor_str, MPC_IMAGE_FN_CTOR },
+  { (mpc_image_fn_t)mpcf_free, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_int, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_hex, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_oct, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_float, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_strtriml, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_strtrimr, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_strtrim, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_escape, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_escape_regex, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_escape_string_raw, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_escape_char_raw, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_unescape, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_unescape_regex, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_unescape_string_raw, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_unescape_char_raw, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpcf_str_ast, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpc_ast_add_root, MPC_IMAGE_FN_APPLY },
+  { (mpc_image_fn_t)mpc_ast_tag, MPC_IMAGE_FN_APPLY_TAG },
+  { (mpc_image_fn_t)mpc_ast_add_tag, MPC_IMAGE_FN_APPLY_TAG },
+  { (mpc_image_fn_t)mpcaf_grammar_punct, MPC_IMAGE_FN_APPLY_TAG },
+  { (mpc_image_fn_t)mpcaf_grammar_rule, MPC_IMAGE_FN_APPLY_RULE },
+  { (mpc_image_fn_t)mpcf_null, MPC_IMAGE_FN_FOLD },
+  { (mpc_image_fn_t)mpcf_fst, MPC_IMAGE_FN_FOLD },
+  { (mpc_image_fn_t)mpcf_snd, MPC_IMAGE_FN_FOLD },
+  { (mpc_image_fn_t)mpcf_trd, MPC_IMAGE_FN_FOLD },
+  { (mpc_image_fn_t)mpcf_fst_free, MPC_IMAGE_FN_FOLD },
+  { (mpc_image_fn_t)mpcf_snd_free, MPC_IMAGE_FN_FOLD },
+  { (mpc_image_fn_t)mpcf_trd_free, MPC_IMAGE_FN_FOLD },
+  { (mpc_image_fn_t)mpcf_all_free, MPC_IMAGE_FN_FOLD },
+  { (mpc_image_fn_t)mpcf_strfold, MPC_IMAGE_FN_FOLD },
+  { (mpc_image_fn_t)mpcf_fold_ast, MPC_IMAGE_FN_FOLD },
+  { (mpc_image_fn_t)mpcf_state_ast, MPC_IMAGE_FN_FOLD },
+  { (mpc_image_fn_t)mpc_boundary_anchor, MPC_IMAGE_FN_ANCHOR },
+  { (mpc_image_fn_t)mpc_boundary_newline_anchor, MPC_IMAGE_FN_ANCHOR }
+};
 
-mpc_parser_t *mpca_total(mpc_parser_t *a) { return mpc_total(a, (mpc_dtor_t)mpc_ast_delete); }
+#define MPC_IMAGE_FNS_NUM ((int)(sizeof(mpc_image_fns) / sizeof(mpc_image_entry_t)))
 
-/*
-** Grammar Parser
-*/
+/* Tags the AST functions of the table may be given, which are never freed */
+static const char *mpc_image_tags[] = { "string", "char", "regex" };
 
-/*
-** This is another interesting bootstrapping.
-**
-** Having a general purpose AST type allows
-** users to specify the grammar alone and
-** let all fold rules be automatically taken
-** care of by existing functions.
-**
-** You don't get to control the type spat
-** out but this means you can make a nice
-** parser to take in some grammar in nice
-** syntax and spit out a parser that works.
-**
-** The grammar for this looks surprisingly
-** like regex but the main difference is that
-** it is now whitespace insensitive and the
-** base type takes literals of some form.
-*/
+#define MPC_IMAGE_TAGS_NUM ((int)(sizeof(mpc_image_tags) / sizeof(char*)))
+
+/* FNV-1a kept to 32 bits, so images hash the same on every platform */
+static unsigned long mpc_image_hash(const char *s) {
+  unsigned long h = 2166136261UL;
+  if (s == NULL) { return h; }
+  for (; *s; s++) { h = ((h ^ (unsigned char)*s) * 16777619UL) & 0xFFFFFFFFUL; }
+  return h;
+}
+
+static mpc_err_t *mpc_image_err(const char *failure, const char *name) {
+  mpc_err_t *e;
+  char *buffer = malloc(strlen(failure) + (name ? strlen(name) : 0) + 1);
+  sprintf(buffer, failure, name ? name : "");
+  e = mpc_err_file("<mpc_image>", buffer);
+  free(buffer);
+  return e;
+}
 
 /*
-**
-**  ### Grammar Grammar
-**
-**      <grammar> : (<term> "|" <grammar>) | <term>
-**
-**      <term> : <factor>*
-**
-**      <factor> : <base>
-**               | <base> "*"
-**               | <base> "+"
-**               | <base> "?"
-**               | <base> "{" <digits> "}"
-**
-**      <base> : "<" (<digits> | <ident>) ">"
-**             | <string_lit>
-**             | <char_lit>
-**             | <regex_lit> <regex_mode>
-**             | "(" <grammar> ")"
+** Saving
 */
 
 typedef struct {
-  va_list *va;
-  int parsers_num;
-  mpc_parser_t **parsers;
-  int flags;
-} mpca_grammar_st_t;
-
-static mpc_val_t *mpcaf_grammar_or(int n, mpc_val_t **xs) {
-  (void) n;
-  if (xs[1] == NULL) { return xs[0]; }
-  else { return mpca_or(2, xs[0], xs[1]); }
-}
-
-static mpc_val_t *mpcaf_grammar_and(int n, mpc_val_t **xs) {
-  int i;
-  mpc_parser_t *p = mpc_pass();
-  for (i = 0; i < n; i++) {
-    if (xs[i] != NULL) { p = mpca_and(2, p, xs[i]); }
+  unsigned char *data;
+  size_t len;
+  size_t slots;
+  mpc_parser_t **nodes;
+  int nodes_num;
+  int nodes_slots;
+  int roots;
+  int *index;
+  int index_slots;
+  mpc_err_t *error;
+} mpc_image_writer_t;
+
+static void mpc_image_put(mpc_image_writer_t *w, const void *x, size_t n) {
+  while (w->len + n > w->slots) {
+    w->slots = w->slots ? w->slots * 2 : 4096;
+    w->data = realloc(w->data, w->slots);
   }
-  return p;
+  memcpy(w->data + w->len, x, n);
+  w->len += n;
 }
 
-static mpc_val_t *mpcaf_grammar_repeat(int n, mpc_val_t **xs) {
-  int num;
-  (void) n;
-  if (xs[1] == NULL) { return xs[0]; }
-  switch(((char*)xs[1])[0])
-  {
-    case '*': { free(xs[1]); return mpca_many(xs[0]); }; break;
-    case '+': { free(xs[1]); return mpca_many1(xs[0]); }; break;
-    case '?': { free(xs[1]); return mpca_maybe(xs[0]); }; break;
-    case '!': { free(xs[1]); return mpca_not(xs[0]); }; break;
-    default:
-      num = *((int*)xs[1]);
-      free(xs[1]);
-  }
-  return mpca_count(num, xs[0]);
+static void mpc_image_put_byte(mpc_image_writer_t *w, int x) {
+  unsigned char c = (unsigned char)x;
+  mpc_image_put(w, &c, 1);
 }
 
-static mpc_val_t *mpcaf_grammar_string(mpc_val_t *x, void *s) {
-  mpca_grammar_st_t *st = s;
-  char *y = mpcf_unescape(x);
-  mpc_parser_t *p = (st->flags & MPCA_LANG_WHITESPACE_SENSITIVE) ? mpc_string(y) : mpc_tok(mpc_string(y));
-  free(y);
-  return mpca_state(mpca_tag(mpc_apply(p, mpcf_str_ast), "string"));
+static void mpc_image_put_int(mpc_image_writer_t *w, unsigned long x) {
+  unsigned char b[4];
+  b[0] = (unsigned char)(x & 0xFF);
+  b[1] = (unsigned char)((x >> 8) & 0xFF);
+  b[2] = (unsigned char)((x >> 16) & 0xFF);
+  b[3] = (unsigned char)((x >> 24) & 0xFF);
+  mpc_image_put(w, b, 4);
 }
 
-static mpc_val_t *mpcaf_grammar_char(mpc_val_t *x, void *s) {
-  mpca_grammar_st_t *st = s;
-  char *y = mpcf_unescape(x);
-  mpc_parser_t *p = (st->flags & MPCA_LANG_WHITESPACE_SENSITIVE) ? mpc_char(y[0]) : mpc_tok(mpc_char(y[0]));
-  free(y);
-  return mpca_state(mpca_tag(mpc_apply(p, mpcf_str_ast), "char"));
+/* Strings are written with their length plus one, zero for none */
+static void mpc_image_put_str(mpc_image_writer_t *w, const char *s) {
+  if (s == NULL) { mpc_image_put_int(w, 0); return; }
+  mpc_image_put_int(w, strlen(s) + 1);
+  mpc_image_put(w, s, strlen(s));
 }
 
-static mpc_val_t *mpcaf_fold_regex(int n, mpc_val_t **xs) {
-  char *y = xs[0];
-  char *m = xs[1];
-  mpca_grammar_st_t *st = xs[2];
-  mpc_parser_t *p;
-  int mode = MPC_RE_DEFAULT;
-
-  (void)n;
-  if (strchr(m, 'm')) { mode |= MPC_RE_MULTILINE; }
-  if (strchr(m, 's')) { mode |= MPC_RE_DOTALL; }
-  y = mpcf_unescape_regex(y);
-  p = (st->flags & MPCA_LANG_WHITESPACE_SENSITIVE) ? mpc_re_mode(y, mode) : mpc_tok(mpc_re_mode(y, mode));
-  free(y);
-  free(m);
-
-  return mpca_state(mpca_tag(mpc_apply(p, mpcf_str_ast), "regex"));
+static void mpc_image_put_fn(mpc_image_writer_t *w, mpc_image_fn_t f, const char *name) {
+  int j;
+  for (j = 0; j < MPC_IMAGE_FNS_NUM; j++) {
+    if (mpc_image_fns[j].f == f) { mpc_image_put_int(w, j); return; }
+  }
+  if (w->error == NULL) {
+    w->error = mpc_image_err("Parser '%s' uses a function images can not save!", name);
+  }
 }
 
-/* Should this just use `isdigit` instead? */
-static int is_number(const char* s) {
-  size_t i;
-  for (i = 0; i < strlen(s); i++) { if (!strchr("0123456789", s[i])) { return 0; } }
-  return 1;
+static int mpc_image_slot(mpc_image_writer_t *w, mpc_parser_t *p) {
+  int j, mask = w->index_slots - 1;
+  for (j = (int)(((size_t)p >> 4) * 2654435761UL & mask); w->index[j]; j = (j + 1) & mask) {
+    if (w->nodes[w->index[j]-1] == p) { return j; }
+  }
+  return j;
 }
 
-static mpc_parser_t *mpca_grammar_find_parser(char *x, mpca_grammar_st_t *st) {
-
-  int i;
-  mpc_parser_t *p;
-
-  /* Case of Number */
-  if (is_number(x)) {
-
-    i = strtol(x, NULL, 10);
-
-    while (st->parsers_num <= i) {
-      st->parsers_num++;
-      st->parsers = realloc(st->parsers, sizeof(mpc_parser_t*) * st->parsers_num);
-      st->parsers[st->parsers_num-1] = va_arg(*st->va, mpc_parser_t*);
-      if (st->parsers[st->parsers_num-1] == NULL) {
-        return mpc_failf("No Parser in position %i! Only supplied %i Parsers!", i, st->parsers_num);
-      }
-    }
-
-    return st->parsers[st->parsers_num-1];
-
-  /* Case of Identifier */
-  } else {
-
-    /* Search Existing Parsers */
-    for (i = 0; i < st->parsers_num; i++) {
-      mpc_parser_t *q = st->parsers[i];
-      if (q == NULL) { return mpc_failf("Unknown Parser '%s'!", x); }
-      if (q->name && strcmp(q->name, x) == 0) { return q; }
-    }
-
-    /* Search New Parsers */
-    while (1) {
-
-      p = va_arg(*st->va, mpc_parser_t*);
+static int mpc_image_add(mpc_image_writer_t *w, mpc_parser_t *p) {
 
-      st->parsers_num++;
-      st->parsers = realloc(st->parsers, sizeof(mpc_parser_t*) * st->parsers_num);
-      st->parsers[st->parsers_num-1] = p;
-
-      if (p == NULL || p->name == NULL) { return mpc_failf("Unknown Parser '%s'!", x); }
-      if (p->name && strcmp(p->name, x) == 0) { return p; }
+  int j, slots, *index;
 
+  if (w->nodes_num == w->nodes_slots) {
+    w->nodes_slots = w->nodes_slots ? w->nodes_slots * 2 : MPC_IMAGE_NODES_MIN;
+    w->nodes = realloc(w->nodes, sizeof(mpc_parser_t*) * w->nodes_slots);
+  }
+  w->nodes[w->nodes_num++] = p;
+
+  if (w->nodes_num * 2 > w->index_slots) {
+    slots = w->index_slots;
+    index = w->index;
+    w->index_slots = slots ? slots * 2 : MPC_IMAGE_NODES_MIN * 2;
+    w->index = calloc(w->index_slots, sizeof(int));
+    for (j = 0; j < slots; j++) {
+      if (index[j]) { w->index[mpc_image_slot(w, w->nodes[index[j]-1])] = index[j]; }
     }
-
+    free(index);
   }
 
+  w->index[mpc_image_slot(w, p)] = w->nodes_num;
+  return w->nodes_num - 1;
 }
 
-static mpc_val_t *mpcaf_grammar_id(mpc_val_t *x, void *s) {
-
-  mpca_grammar_st_t *st = s;
-  mpc_parser_t *p = mpca_grammar_find_parser(x, st);
-  free(x);
-
-  if (p->name) {
-    return mpca_state(mpca_root(mpca_add_tag(p, p->name)));
-  } else {
-    return mpca_state(mpca_root(p));
-  }
-}
-
-mpc_parser_t *mpca_grammar_st(const char *grammar, mpca_grammar_st_t *st) {
-
-  char *err_msg;
-  mpc_parser_t *err_out;
-  mpc_result_t r;
-  mpc_parser_t *GrammarTotal, *Grammar, *Term, *Factor, *Base;
-
-  GrammarTotal = mpc_new("grammar_total");
-  Grammar = mpc_new("grammar");
-  Term = mpc_new("term");
-  Factor = mpc_new("factor");
-  Base = mpc_new("base");
-
-  mpc_define(GrammarTotal,
-    mpc_predictive(mpc_total(Grammar, mpc_soft_delete))
-  );
-
-  mpc_define(Grammar, mpc_and(2, mpcaf_grammar_or,
-    Term,
-    mpc_maybe(mpc_and(2, mpcf_snd_free, mpc_sym("|"), Grammar, free)),
-    mpc_soft_delete
-  ));
-
-  mpc_define(Term, mpc_many1(mpcaf_grammar_and, Factor));
-
-  mpc_define(Factor, mpc_and(2, mpcaf_grammar_repeat,
-    Base,
-      mpc_or(6,
-        mpc_sym("*"),
-        mpc_sym("+"),
-        mpc_sym("?"),
-        mpc_sym("!"),
-        mpc_tok_brackets(mpc_int(), free),
-        mpc_pass()),
-    mpc_soft_delete
-  ));
-
-  mpc_define(Base, mpc_or(5,
-    mpc_apply_to(mpc_tok(mpc_string_lit()), mpcaf_grammar_string, st),
-    mpc_apply_to(mpc_tok(mpc_char_lit()),   mpcaf_grammar_char, st),
-    mpc_tok(mpc_and(3, mpcaf_fold_regex, mpc_regex_lit(), mpc_many(mpcf_strfold, mpc_oneof("ms")), mpc_lift_val(st), free, free)),
-    mpc_apply_to(mpc_tok_braces(mpc_or(2, mpc_digits(), mpc_ident()), free), mpcaf_grammar_id, st),
-    mpc_tok_parens(Grammar, mpc_soft_delete)
-  ));
+/* Roots are found again, anything else is new and owned by the node being written */
+static void mpc_image_put_ref(mpc_image_writer_t *w, mpc_parser_t *p) {
 
-  mpc_optimise(GrammarTotal);
-  mpc_optimise(Grammar);
-  mpc_optimise(Factor);
-  mpc_optimise(Term);
-  mpc_optimise(Base);
+  int j = w->index[mpc_image_slot(w, p)];
 
-  if(!mpc_parse("<mpc_grammar_compiler>", grammar, GrammarTotal, &r)) {
-    err_msg = mpc_err_string(r.error);
-    err_out = mpc_failf("Invalid Grammar: %s", err_msg);
-    mpc_err_delete(r.error);
-    free(err_msg);
-    r.output = err_out;
+  if (j && j <= w->roots) { mpc_image_put_int(w, j - 1); return; }
+
+  if (w->error) { return; }
+  if (p->retained) {
+    w->error = mpc_image_err("Parser '%s' is not one of the parsers given!", p->name);
+    return;
+  }
+  if (j) {
+    w->error = mpc_image_err("Parser graph shares an unretained parser!", NULL);
+    return;
   }
 
-  mpc_cleanup(5, GrammarTotal, Grammar, Term, Factor, Base);
+  mpc_image_put_int(w, mpc_image_add(w, p));
+}
 
-  mpc_optimise(r.output);
+static void mpc_image_put_node(mpc_image_writer_t *w, mpc_parser_t *p) {
 
-  return (st->flags & MPCA_LANG_PREDICTIVE) ? mpc_predictive(r.output) : r.output;
+  int j, k;
+  mpc_dfa_t *d;
+  mpc_dfa_class_t *c;
+  const char *name = p->name ? p->name : "<unnamed>";
 
-}
+  mpc_image_put_byte(w, p->type);
+  mpc_image_put_str(w, p->name);
+  mpc_image_put_int(w, (unsigned long)p->id);
 
-mpc_parser_t *mpca_grammar(int flags, const char *grammar, ...) {
-  mpca_grammar_st_t st;
-  mpc_parser_t *res;
-  va_list va;
-  va_start(va, grammar);
+  switch (p->type) {
 
-  st.va = &va;
-  st.parsers_num = 0;
-  st.parsers = NULL;
-  st.flags = flags;
+    case MPC_TYPE_UNDEFINED:
+    case MPC_TYPE_PASS:
+    case MPC_TYPE_STATE:
+    case MPC_TYPE_ANY:
+    case MPC_TYPE_SOI:
+    case MPC_TYPE_EOI:
+      break;
 
-  res = mpca_grammar_st(grammar, &st);
-  free(st.parsers);
-  va_end(va);
-  return res;
-}
+    case MPC_TYPE_FAIL: mpc_image_put_str(w, p->data.fail.m); break;
+    case MPC_TYPE_LIFT: mpc_image_put_fn(w, (mpc_image_fn_t)p->data.lift.lf, name); break;
 
-typedef struct {
-  char *ident;
-  char *name;
-  mpc_parser_t *grammar;
-} mpca_stmt_t;
+    case MPC_TYPE_LIFT_VAL:
+      if (p->data.lift.x && w->error == NULL) {
+        w->error = mpc_image_err("Parser '%s' lifts a value images can not save!", name);
+      }
+      break;
 
-static mpc_val_t *mpca_stmt_afold(int n, mpc_val_t **xs) {
-  mpca_stmt_t *stmt = malloc(sizeof(mpca_stmt_t));
-  stmt->ident = ((char**)xs)[0];
-  stmt->name = ((char**)xs)[1];
-  stmt->grammar = ((mpc_parser_t**)xs)[3];
-  (void) n;
-  free(((char**)xs)[2]);
-  free(((char**)xs)[4]);
+    case MPC_TYPE_EXPECT:
+      mpc_image_put_ref(w, p->data.expect.x);
+      mpc_image_put_str(w, p->data.expect.m);
+      break;
 
-  return stmt;
-}
+    case MPC_TYPE_ANCHOR: mpc_image_put_fn(w, (mpc_image_fn_t)p->data.anchor.f, name); break;
+    case MPC_TYPE_SINGLE: mpc_image_put_byte(w, p->data.single.x); break;
 
-static mpc_val_t *mpca_stmt_fold(int n, mpc_val_t **xs) {
+    case MPC_TYPE_RANGE:
+      mpc_image_put_byte(w, p->data.range.x);
+      mpc_image_put_byte(w, p->data.range.y);
+      break;
 
-  int i;
-  mpca_stmt_t **stmts = malloc(sizeof(mpca_stmt_t*) * (n+1));
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+    case MPC_TYPE_STRING:
+      mpc_image_put_str(w, p->data.string.x);
+      break;
 
-  for (i = 0; i < n; i++) {
-    stmts[i] = xs[i];
-  }
-  stmts[n] = NULL;
+    case MPC_TYPE_APPLY:
+      mpc_image_put_ref(w, p->data.apply.x);
+      mpc_image_put_fn(w, (mpc_image_fn_t)p->data.apply.f, name);
+      break;
 
-  return stmts;
-}
+    case MPC_TYPE_APPLY_TO:
+      mpc_image_put_ref(w, p->data.apply_to.x);
+      mpc_image_put_fn(w, (mpc_image_fn_t)p->data.apply_to.f, name);
+      if (p->data.apply_to.f == mpcaf_grammar_rule) {
+        mpc_image_put_ref(w, p->data.apply_to.d);
+        break;
+      }
+      for (j = 0; j < MPC_IMAGE_TAGS_NUM; j++) {
+        if (strcmp(p->data.apply_to.d, mpc_image_tags[j]) == 0) { break; }
+      }
+      if (j == MPC_IMAGE_TAGS_NUM && w->error == NULL) {
+        w->error = mpc_image_err("Parser '%s' applies to data images can not save!", name);
+      }
+      mpc_image_put_int(w, j);
+      break;
 
-static void mpca_stmt_list_delete(mpc_val_t *x) {
+    case MPC_TYPE_PREDICT: mpc_image_put_ref(w, p->data.predict.x); break;
 
-  mpca_stmt_t **stmts = x;
+    case MPC_TYPE_NOT:
+    case MPC_TYPE_MAYBE:
+      mpc_image_put_ref(w, p->data.not.x);
+      mpc_image_put_fn(w, (mpc_image_fn_t)p->data.not.dx, name);
+      mpc_image_put_fn(w, (mpc_image_fn_t)p->data.not.lf, name);
+      break;
 
-  while(*stmts) {
-    mpca_stmt_t *stmt = *stmts;
-    free(stmt->ident);
-    free(stmt->name);
-    mpc_soft_delete(stmt->grammar);
-    free(stmt);
-    stmts++;
-  }
-  free(x);
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:
+      mpc_image_put_int(w, p->data.repeat.n);
+      mpc_image_put_fn(w, (mpc_image_fn_t)p->data.repeat.f, name);
+      mpc_image_put_ref(w, p->data.repeat.x);
+      mpc_image_put_fn(w, (mpc_image_fn_t)p->data.repeat.dx, name);
+      break;
 
-}
+    case MPC_TYPE_OR:
+      mpc_image_put_int(w, p->data.or.n);
+      for (j = 0; j < p->data.or.n; j++) { mpc_image_put_ref(w, p->data.or.xs[j]); }
+      mpc_image_put_byte(w, p->data.or.first != NULL);
+      if (p->data.or.first) {
+        mpc_image_put(w, p->data.or.first, p->data.or.n * 32);
+        mpc_image_put(w, p->data.or.jump, 256);
+      }
+      break;
 
-static mpc_val_t *mpca_stmt_list_apply_to(mpc_val_t *x, void *s) {
+    case MPC_TYPE_AND:
+      mpc_image_put_int(w, p->data.and.n);
+      mpc_image_put_fn(w, (mpc_image_fn_t)p->data.and.f, name);
+      for (j = 0; j < p->data.and.n; j++) { mpc_image_put_ref(w, p->data.and.xs[j]); }
+      for (j = 0; j < p->data.and.n - 1; j++) { mpc_image_put_fn(w, (mpc_image_fn_t)p->data.and.dxs[j], name); }
+      break;
 
-  mpca_grammar_st_t *st = s;
-  mpca_stmt_t *stmt;
-  mpca_stmt_t **stmts = x;
-  mpc_parser_t *left;
+    case MPC_TYPE_SEPBY1:
+      mpc_image_put_int(w, p->data.sepby1.n);
+      mpc_image_put_fn(w, (mpc_image_fn_t)p->data.sepby1.f, name);
+      mpc_image_put_ref(w, p->data.sepby1.x);
+      mpc_image_put_ref(w, p->data.sepby1.sep);
+      break;
 
-  while(*stmts) {
-    stmt = *stmts;
-    left = mpca_grammar_find_parser(stmt->ident, st);
-    if (st->flags & MPCA_LANG_PREDICTIVE) { stmt->grammar = mpc_predictive(stmt->grammar); }
-    if (stmt->name) { stmt->grammar = mpc_expect(stmt->grammar, stmt->name); }
-    mpc_optimise(stmt->grammar);
-    mpc_define(left, stmt->grammar);
-    free(stmt->ident);
-    free(stmt->name);
-    free(stmt);
-    stmts++;
-  }
+    case MPC_TYPE_DFA:
+      d = p->data.dfa.d;
+      mpc_image_put_ref(w, p->data.dfa.x);
+      mpc_image_put_int(w, d->n);
+      mpc_image_put(w, d->kind, d->n);
+      for (j = 0; j < d->n; j++) {
+        c = &d->classes[j];
+        mpc_image_put_str(w, d->expect[j]);
+        mpc_image_put_int(w, c->ranges);
+        /* Only the ranges in use are set */
+        mpc_image_put(w, c->lo, c->ranges);
+        mpc_image_put(w, c->span, c->ranges);
+        mpc_image_put(w, c->nibbles, 32);
+        mpc_image_put_byte(w, c->newline);
+      }
+      for (k = 0; k < d->n * 2 * 256; k++) {
+        mpc_image_put_byte(w, (unsigned short)d->next[k] & 0xFF);
+        mpc_image_put_byte(w, (unsigned short)d->next[k] >> 8);
+      }
+      break;
 
-  free(x);
+    default:
+      if (w->error == NULL) {
+        w->error = mpc_image_err("Parser '%s' is of a kind images can not save!", name);
+      }
+      break;
+  }
 
-  return NULL;
 }
 
-static mpc_err_t *mpca_lang_st(mpc_input_t *i, mpca_grammar_st_t *st) {
-
-  mpc_result_t r;
-  mpc_err_t *e;
-  mpc_parser_t *Lang, *Stmt, *Grammar, *Term, *Factor, *Base;
+static mpc_err_t *mpc_image_write(mpc_image_writer_t *w, const char *grammar, int n, va_list va) {
 
-  Lang    = mpc_new("lang");
-  Stmt    = mpc_new("stmt");
-  Grammar = mpc_new("grammar");
-  Term    = mpc_new("term");
-  Factor  = mpc_new("factor");
-  Base    = mpc_new("base");
+  int j;
+  mpc_parser_t *p;
 
-  mpc_define(Lang, mpc_apply_to(
-    mpc_total(mpc_predictive(mpc_many(mpca_stmt_fold, Stmt)), mpca_stmt_list_delete),
-    mpca_stmt_list_apply_to, st
-  ));
+  w->data = NULL;
+  w->len = 0;
+  w->slots = 0;
+  w->nodes = NULL;
+  w->nodes_num = 0;
+  w->nodes_slots = 0;
+  w->index = NULL;
+  w->index_slots = 0;
+  w->error = NULL;
+  w->roots = 0;
 
-  mpc_define(Stmt, mpc_and(5, mpca_stmt_afold,
-    mpc_tok(mpc_ident()), mpc_maybe(mpc_tok(mpc_string_lit())), mpc_sym(":"), Grammar, mpc_sym(";"),
-    free, free, free, mpc_soft_delete
-  ));
+  for (j = 0; j < n; j++) {
+    p = va_arg(va, mpc_parser_t*);
+    if (!p->retained) {
+      w->error = mpc_image_err("Parsers saved to an image must be made with mpc_new!", NULL);
+      break;
+    }
+    mpc_image_add(w, p);
+  }
+  w->roots = w->nodes_num;
+
+  mpc_image_put(w, MPC_IMAGE_MAGIC, 4);
+  mpc_image_put_int(w, MPC_IMAGE_VERSION);
+  mpc_image_put_int(w, MPC_IMAGE_FNS_NUM);
+  mpc_image_put_int(w, mpc_image_hash(grammar));
+  mpc_image_put_int(w, 0);
+  mpc_image_put_int(w, w->roots);
+
+  /* Nodes are numbered as they are first referred to */
+  for (j = 0; j < w->nodes_num && w->error == NULL; j++) {
+    mpc_image_put_node(w, w->nodes[j]);
+  }
 
-  mpc_define(Grammar, mpc_and(2, mpcaf_grammar_or,
-      Term,
-      mpc_maybe(mpc_and(2, mpcf_snd_free, mpc_sym("|"), Grammar, free)),
-      mpc_soft_delete
-  ));
+  w->data[16] = (unsigned char)(w->nodes_num & 0xFF);
+  w->data[17] = (unsigned char)((w->nodes_num >> 8) & 0xFF);
+  w->data[18] = (unsigned char)((w->nodes_num >> 16) & 0xFF);
+  w->data[19] = (unsigned char)((w->nodes_num >> 24) & 0xFF);
 
-  mpc_define(Term, mpc_many1(mpcaf_grammar_and, Factor));
+  free(w->nodes);
+  free(w->index);
+  return w->error;
+}
 
-  mpc_define(Factor, mpc_and(2, mpcaf_grammar_repeat,
-    Base,
-      mpc_or(6,
-        mpc_sym("*"),
-        mpc_sym("+"),
-        mpc_sym("?"),
-        mpc_sym("!"),
-        mpc_tok_brackets(mpc_int(), free),
-        mpc_pass()),
-    mpc_soft_delete
-  ));
+mpc_err_t *mpc_image_save(FILE *f, const char *grammar, int n, ...) {
 
-  mpc_define(Base, mpc_or(5,
-    mpc_apply_to(mpc_tok(mpc_string_lit()), mpcaf_grammar_string, st),
-    mpc_apply_to(mpc_tok(mpc_char_lit()),   mpcaf_grammar_char, st),
-    mpc_tok(mpc_and(3, mpcaf_fold_regex, mpc_regex_lit(), mpc_many(mpcf_strfold, mpc_oneof("ms")), mpc_lift_val(st), free, free)),
-    mpc_apply_to(mpc_tok_braces(mpc_or(2, mpc_digits(), mpc_ident()), free), mpcaf_grammar_id, st),
-    mpc_tok_parens(Grammar, mpc_soft_delete)
-  ));
+  mpc_image_writer_t w;
+  mpc_err_t *e;
+  va_list va;
 
-  mpc_optimise(Lang);
-  mpc_optimise(Stmt);
-  mpc_optimise(Grammar);
-  mpc_optimise(Term);
-  mpc_optimise(Factor);
-  mpc_optimise(Base);
+  va_start(va, n);
+  e = mpc_image_write(&w, grammar, n, va);
+  va_end(va);
 
-  if (!mpc_parse_input(i, Lang, &r)) {
-    e = r.error;
-  } else {
-    e = NULL;
+  if (e == NULL && fwrite(w.data, 1, w.len, f) != w.len) {
+    e = mpc_image_err("Unable to write image!", NULL);
   }
 
-  mpc_cleanup(6, Lang, Stmt, Grammar, Term, Factor, Base);
-
+  free(w.data);
   return e;
 }
 
-mpc_err_t *mpca_lang_file(int flags, FILE *f, ...) {
-  mpca_grammar_st_t st;
-  mpc_input_t *i;
-  mpc_err_t *err;
+mpc_err_t *mpc_image_save_c(FILE *f, const char *name, const char *grammar, int n, ...) {
 
+  mpc_image_writer_t w;
+  mpc_err_t *e;
   va_list va;
-  va_start(va, f);
+  size_t j;
 
-  st.va = &va;
-  st.parsers_num = 0;
-  st.parsers = NULL;
-  st.flags = flags;
+  va_start(va, n);
+  e = mpc_image_write(&w, grammar, n, va);
+  va_end(va);
 
-  i = mpc_input_new_file("<mpca_lang_file>", f);
-  err = mpca_lang_st(i, &st);
-  mpc_input_delete(i);
+  if (e == NULL) {
+    fprintf(f, "static const unsigned char %s[%lu] = {", name, (unsigned long)w.len);
+    for (j = 0; j < w.len; j++) {
+      fprintf(f, "%s0x%02x%s", j % MPC_IMAGE_LINE ? " " : "\n  ", w.data[j], j + 1 < w.len ? "," : "");
+    }
+    fprintf(f, "\n};\n");
+    if (ferror(f)) { e = mpc_image_err("Unable to write image!", NULL); }
+  }
 
-  free(st.parsers);
-  va_end(va);
-  return err;
+  free(w.data);
+  return e;
 }
 
-mpc_err_t *mpca_lang_pipe(int flags, FILE *p, ...) {
-  mpca_grammar_st_t st;
-  mpc_input_t *i;
-  mpc_err_t *err;
+/*
+** Loading
+*/
 
-  va_list va;
-  va_start(va, p);
+typedef struct {
+  const unsigned char *data;
+  size_t pos;
+  size_t size;
+  int build;
+  int roots;
+  int nodes_num;
+  int node;
+  mpc_parser_t **nodes;
+  char *owned;
+  const char *error;
+} mpc_image_reader_t;
+
+static const unsigned char *mpc_image_get(mpc_image_reader_t *r, size_t n) {
+  const unsigned char *x;
+  if (r->error) { return NULL; }
+  if (r->size - r->pos < n) { r->error = "Image is truncated!"; return NULL; }
+  x = r->data + r->pos;
+  r->pos += n;
+  return x;
+}
 
-  st.va = &va;
-  st.parsers_num = 0;
-  st.parsers = NULL;
-  st.flags = flags;
+static int mpc_image_get_byte(mpc_image_reader_t *r) {
+  const unsigned char *x = mpc_image_get(r, 1);
+  return x ? x[0] : 0;
+}
 
-  i = mpc_input_new_pipe("<mpca_lang_pipe>", p);
-  err = mpca_lang_st(i, &st);
-  mpc_input_delete(i);
+static unsigned long mpc_image_get_int(mpc_image_reader_t *r) {
+  const unsigned char *x = mpc_image_get(r, 4);
+  if (x == NULL) { return 0; }
+  return (unsigned long)x[0]
+    | ((unsigned long)x[1] << 8)
+    | ((unsigned long)x[2] << 16)
+    | ((unsigned long)x[3] << 24);
+}
 
-  free(st.parsers);
-  va_end(va);
-  return err;
+/* Counts are checked against what is left so a bad one fails before anything is allocated */
+static int mpc_image_get_count(mpc_image_reader_t *r, size_t each) {
+  unsigned long n = mpc_image_get_int(r);
+  if (r->error == NULL && n > (r->size - r->pos) / each) {
+    r->error = "Image has an invalid count!";
+  }
+  return r->error ? 0 : (int)n;
 }
 
-mpc_err_t *mpca_lang(int flags, const char *language, ...) {
+static void mpc_image_get_bytes(mpc_image_reader_t *r, void *x, size_t n) {
+  const unsigned char *y = mpc_image_get(r, n);
+  if (y && x) { memcpy(x, y, n); }
+}
 
-  mpca_grammar_st_t st;
-  mpc_input_t *i;
-  mpc_err_t *err;
+/* A copy of the string when building, NULL when checking */
+static char *mpc_image_get_str(mpc_image_reader_t *r, int required, const char *match) {
 
-  va_list va;
-  va_start(va, language);
+  const unsigned char *x;
+  char *s;
+  unsigned long n = mpc_image_get_int(r);
 
-  st.va = &va;
-  st.parsers_num = 0;
-  st.parsers = NULL;
-  st.flags = flags;
+  if (r->error) { return NULL; }
+  if (n == 0) {
+    if (required) { r->error = "Image is missing a string!"; }
+    if (match) { r->error = "Image does not hold the parsers given!"; }
+    return NULL;
+  }
 
-  i = mpc_input_new_string("<mpca_lang>", language);
-  err = mpca_lang_st(i, &st);
-  mpc_input_delete(i);
+  x = mpc_image_get(r, n - 1);
+  if (x == NULL) { return NULL; }
 
-  free(st.parsers);
-  va_end(va);
-  return err;
+  if (match && (strlen(match) != n - 1 || memcmp(x, match, n - 1) != 0)) {
+    r->error = "Image does not hold the parsers given!";
+    return NULL;
+  }
+
+  if (!r->build) { return NULL; }
+  s = malloc(n);
+  memcpy(s, x, n - 1);
+  s[n - 1] = '\0';
+  return s;
 }
 
-mpc_err_t *mpca_lang_contents(int flags, const char *filename, ...) {
+static mpc_image_fn_t mpc_image_get_fn(mpc_image_reader_t *r, int kind, int required) {
+  unsigned long j = mpc_image_get_int(r);
+  if (r->error) { return NULL; }
+  if (j >= (unsigned long)MPC_IMAGE_FNS_NUM
+  || (j == 0 && required)
+  || (j != 0 && mpc_image_fns[j].kind != kind)) {
+    r->error = "Image has an invalid function!";
+    return NULL;
+  }
+  return mpc_image_fns[j].f;
+}
 
-  mpca_grammar_st_t st;
-  mpc_input_t *i;
-  mpc_err_t *err;
+/* Any root, or a later node not yet owned which the node being read now owns */
+static mpc_parser_t *mpc_image_get_ref(mpc_image_reader_t *r) {
 
-  va_list va;
+  unsigned long j = mpc_image_get_int(r);
 
-  FILE *f = fopen(filename, "rb");
+  if (r->error) { return NULL; }
+  if (j >= (unsigned long)r->nodes_num) { r->error = "Image has an invalid node!"; return NULL; }
 
-  if (f == NULL) {
-    err = mpc_err_file(filename, "Unable to open file!");
-    return err;
+  if ((int)j >= r->roots && !r->build) {
+    if ((int)j <= r->node || r->owned[j]) { r->error = "Image has an invalid node!"; return NULL; }
+    r->owned[j] = 1;
   }
 
-  va_start(va, filename);
+  return r->build ? r->nodes[j] : NULL;
+}
+
+static mpc_parser_t *mpc_image_get_root(mpc_image_reader_t *r) {
+  unsigned long j = mpc_image_get_int(r);
+  if (r->error) { return NULL; }
+  if (j >= (unsigned long)r->roots) { r->error = "Image has an invalid node!"; return NULL; }
+  return r->build ? r->nodes[j] : NULL;
+}
+
+/* Reads the next node into p when building, or only checks it */
+static void mpc_image_get_node(mpc_image_reader_t *r, mpc_parser_t *p) {
+
+  int j, n, type;
+  long t;
+  char *name;
+  unsigned long id;
+  mpc_pdata_t x;
+  mpc_dfa_t *d = NULL;
+  mpc_dfa_class_t c;
+  char kind[MPC_DFA_ITEMS_MAX];
+  const unsigned char *b;
+  mpc_parser_t *y;
+  mpc_image_fn_t f;
+
+  memset(&x, 0, sizeof(x));
+  type = mpc_image_get_byte(r);
+  name = mpc_image_get_str(r, 0, r->node < r->roots ? r->nodes[r->node]->name : NULL);
+  id = mpc_image_get_int(r);
+
+  switch (type) {
+
+    case MPC_TYPE_UNDEFINED:
+    case MPC_TYPE_PASS:
+    case MPC_TYPE_STATE:
+    case MPC_TYPE_ANY:
+    case MPC_TYPE_SOI:
+    case MPC_TYPE_EOI:
+    case MPC_TYPE_LIFT_VAL:
+      break;
+
+    case MPC_TYPE_FAIL: x.fail.m = mpc_image_get_str(r, 1, NULL); break;
+    case MPC_TYPE_LIFT: x.lift.lf = (mpc_ctor_t)mpc_image_get_fn(r, MPC_IMAGE_FN_CTOR, 1); break;
 
-  st.va = &va;
-  st.parsers_num = 0;
-  st.parsers = NULL;
-  st.flags = flags;
+    case MPC_TYPE_EXPECT:
+      x.expect.x = mpc_image_get_ref(r);
+      x.expect.m = mpc_image_get_str(r, 1, NULL);
+      break;
 
-  i = mpc_input_new_file(filename, f);
-  err = mpca_lang_st(i, &st);
-  mpc_input_delete(i);
+    case MPC_TYPE_ANCHOR:
+      x.anchor.f = (int(*)(char,char))mpc_image_get_fn(r, MPC_IMAGE_FN_ANCHOR, 1);
+      break;
 
-  free(st.parsers);
-  va_end(va);
+    case MPC_TYPE_SINGLE: x.single.x = (char)mpc_image_get_byte(r); break;
 
-  fclose(f);
+    case MPC_TYPE_RANGE:
+      x.range.x = (char)mpc_image_get_byte(r);
+      x.range.y = (char)mpc_image_get_byte(r);
+      break;
 
-  return err;
-}
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+    case MPC_TYPE_STRING:
+      x.string.x = mpc_image_get_str(r, 1, NULL);
+      break;
 
-static int mpc_nodecount_unretained(mpc_parser_t* p, int force) {
+    case MPC_TYPE_APPLY:
+      x.apply.x = mpc_image_get_ref(r);
+      x.apply.f = (mpc_apply_t)mpc_image_get_fn(r, MPC_IMAGE_FN_APPLY, 1);
+      break;
 
-  int i, total;
+    case MPC_TYPE_APPLY_TO:
+      x.apply_to.x = mpc_image_get_ref(r);
+      j = (int)mpc_image_get_int(r);
+      if (r->error) { break; }
+      if (j <= 0 || j >= MPC_IMAGE_FNS_NUM
+      || (mpc_image_fns[j].kind != MPC_IMAGE_FN_APPLY_TAG
+      &&  mpc_image_fns[j].kind != MPC_IMAGE_FN_APPLY_RULE)) {
+        r->error = "Image has an invalid function!";
+        break;
+      }
+      x.apply_to.f = (mpc_apply_to_t)mpc_image_fns[j].f;
+      if (mpc_image_fns[j].kind == MPC_IMAGE_FN_APPLY_RULE) {
+        x.apply_to.d = mpc_image_get_root(r);
+        break;
+      }
+      n = (int)mpc_image_get_int(r);
+      if (r->error) { break; }
+      if (n < 0 || n >= MPC_IMAGE_TAGS_NUM) { r->error = "Image has an invalid tag!"; break; }
+      x.apply_to.d = (void*)mpc_image_tags[n];
+      break;
 
-  if (p->retained && !force) { return 0; }
+    case MPC_TYPE_PREDICT: x.predict.x = mpc_image_get_ref(r); break;
 
-  if (p->type == MPC_TYPE_EXPECT) { return 1 + mpc_nodecount_unretained(p->data.expect.x, 0); }
+    case MPC_TYPE_NOT:
+    case MPC_TYPE_MAYBE:
+      x.not.x = mpc_image_get_ref(r);
+      x.not.dx = (mpc_dtor_t)mpc_image_get_fn(r, MPC_IMAGE_FN_DTOR, 0);
+      x.not.lf = (mpc_ctor_t)mpc_image_get_fn(r, MPC_IMAGE_FN_CTOR, 1);
+      break;
 
-  if (p->type == MPC_TYPE_APPLY)    { return 1 + mpc_nodecount_unretained(p->data.apply.x, 0); }
-  if (p->type == MPC_TYPE_APPLY_TO) { return 1 + mpc_nodecount_unretained(p->data.apply_to.x, 0); }
-  if (p->type == MPC_TYPE_PREDICT)  { return 1 + mpc_nodecount_unretained(p->data.predict.x, 0); }
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:
+      x.repeat.n = (int)mpc_image_get_int(r);
+      x.repeat.f = (mpc_fold_t)mpc_image_get_fn(r, MPC_IMAGE_FN_FOLD, 1);
+      x.repeat.x = mpc_image_get_ref(r);
+      x.repeat.dx = (mpc_dtor_t)mpc_image_get_fn(r, MPC_IMAGE_FN_DTOR, 0);
+      break;
 
-  if (p->type == MPC_TYPE_CHECK)    { return 1 + mpc_nodecount_unretained(p->data.check.x, 0); }
-  if (p->type == MPC_TYPE_CHECK_WITH) { return 1 + mpc_nodecount_unretained(p->data.check_with.x, 0); }
+    case MPC_TYPE_OR:
+      n = mpc_image_get_count(r, 4);
+      x.or.n = n;
+      if (r->build) { x.or.xs = malloc(sizeof(mpc_parser_t*) * n); }
+      for (j = 0; j < n; j++) {
+        y = mpc_image_get_ref(r);
+        if (r->build) { x.or.xs[j] = y; }
+      }
+      if (!mpc_image_get_byte(r) || r->error) { break; }
+      if (n < 2 || n > MPC_FIRST_ALTS_MAX) { r->error = "Image has an invalid table!"; break; }
+      if (r->build) {
+        x.or.first = malloc(n * 32);
+        x.or.jump = malloc(256);
+      }
+      mpc_image_get_bytes(r, x.or.first, n * 32);
+      b = mpc_image_get(r, 256);
+      for (j = 0; b && j < 256; j++) {
+        if (b[j] > n) { r->error = "Image has an invalid table!"; break; }
+      }
+      if (b && x.or.jump) { memcpy(x.or.jump, b, 256); }
+      break;
 
-  if (p->type == MPC_TYPE_NOT)   { return 1 + mpc_nodecount_unretained(p->data.not.x, 0); }
-  if (p->type == MPC_TYPE_MAYBE) { return 1 + mpc_nodecount_unretained(p->data.not.x, 0); }
+    case MPC_TYPE_AND:
+      n = mpc_image_get_count(r, 4);
+      x.and.n = n;
+      x.and.f = (mpc_fold_t)mpc_image_get_fn(r, MPC_IMAGE_FN_FOLD, 1);
+      if (r->build) {
+        x.and.xs = malloc(sizeof(mpc_parser_t*) * n);
+        x.and.dxs = malloc(sizeof(mpc_dtor_t) * (n > 1 ? n-1 : 1));
+      }
+      for (j = 0; j < n; j++) {
+        y = mpc_image_get_ref(r);
+        if (r->build) { x.and.xs[j] = y; }
+      }
+      for (j = 0; j < n-1; j++) {
+        f = mpc_image_get_fn(r, MPC_IMAGE_FN_DTOR, 0);
+        if (r->build) { x.and.dxs[j] = (mpc_dtor_t)f; }
+      }
+      break;
 
-  if (p->type == MPC_TYPE_MANY)  { return 1 + mpc_nodecount_unretained(p->data.repeat.x, 0); }
-  if (p->type == MPC_TYPE_MANY1) { return 1 + mpc_nodecount_unretained(p->data.repeat.x, 0); }
-  if (p->type == MPC_TYPE_COUNT) { return 1 + mpc_nodecount_unretained(p->data.repeat.x, 0); }
-  if (p->type == MPC_TYPE_SEPBY1) {
-    total = 1;
-    total += mpc_nodecount_unretained(p->data.sepby1.x, 0);
-    total += mpc_nodecount_unretained(p->data.sepby1.sep, 0);
-    total += mpc_nodecount_unretained(p->data.sepby1.x, 0);
-    return total;
-  }
+    case MPC_TYPE_SEPBY1:
+      x.sepby1.n = (int)mpc_image_get_int(r);
+      x.sepby1.f = (mpc_fold_t)mpc_image_get_fn(r, MPC_IMAGE_FN_FOLD, 1);
+      x.sepby1.x = mpc_image_get_ref(r);
+      x.sepby1.sep = mpc_image_get_ref(r);
+      break;
 
-  if (p->type == MPC_TYPE_OR) {
-    total = 1;
-    for(i = 0; i < p->data.or.n; i++) {
-      total += mpc_nodecount_unretained(p->data.or.xs[i], 0);
-    }
-    return total;
-  }
+    case MPC_TYPE_DFA:
+      x.dfa.x = mpc_image_get_ref(r);
+      n = (int)mpc_image_get_int(r);
+      if (r->error) { break; }
+      if (n < 1 || n > MPC_DFA_ITEMS_MAX) { r->error = "Image has an invalid table!"; break; }
+      mpc_image_get_bytes(r, kind, n);
+      for (j = 0; j < n && r->error == NULL; j++) {
+        if (kind[j] == '\0' || strchr("1?*+", kind[j]) == NULL) { r->error = "Image has an invalid table!"; }
+      }
+      if (r->build) {
+        d = malloc(sizeof(mpc_dfa_t));
+        d->n = n;
+        memcpy(d->kind, kind, n);
+        mpc_dfa_alloc(d);
+        x.dfa.d = d;
+      }
+      for (j = 0; j < n; j++) {
+        if (d) { d->expect[j] = mpc_image_get_str(r, 0, NULL); } else { mpc_image_get_str(r, 0, NULL); }
+        c.ranges = (int)mpc_image_get_int(r);
+        if (r->error == NULL && (c.ranges < 0 || c.ranges > MPC_DFA_RANGES_MAX)) {
+          r->error = "Image has an invalid table!";
+        }
+        memset(c.lo, 0, sizeof(c.lo));
+        memset(c.span, 0, sizeof(c.span));
+        mpc_image_get_bytes(r, c.lo, c.ranges);
+        mpc_image_get_bytes(r, c.span, c.ranges);
+        mpc_image_get_bytes(r, c.nibbles, 32);
+        c.newline = mpc_image_get_byte(r);
+        if (d) { d->classes[j] = c; }
+      }
+      b = mpc_image_get(r, (size_t)n * 2 * 256 * 2);
+      for (j = 0; b && j < n * 2 * 256; j++) {
+        t = (long)(b[2*j] | (b[2*j+1] << 8));
+        if (t >= 0x8000) { t -= 0x10000; }
+        if (t < MPC_DFA_FAIL || t >= 2 * n) { r->error = "Image has an invalid table!"; break; }
+        if (d) { d->next[j] = (short)t; }
+      }
+      break;
 
-  if (p->type == MPC_TYPE_AND) {
-    total = 1;
-    for(i = 0; i < p->data.and.n; i++) {
-      total += mpc_nodecount_unretained(p->data.and.xs[i], 0);
-    }
-    return total;
+    default:
+      if (r->error == NULL) { r->error = "Image has an invalid parser type!"; }
+      break;
   }
 
-  return 1;
+  /* Images are checked in full before building, so building can not fail */
+  if (!r->build) { return; }
 
+  p->type = (char)type;
+  p->data = x;
+  p->id = (int)id;
+  p->name = name;
 }
 
-void mpc_stats(mpc_parser_t* p) {
-  printf("Stats\n");
-  printf("=====\n");
-  printf("Node Count: %i\n", mpc_nodecount_unretained(p, 1));
-}
+mpc_err_t *mpc_image_load(const unsigned char *image, size_t size, const char *grammar, int n, ...) {
 
-static void mpc_optimise_unretained(mpc_parser_t *p, int force) {
+  int j, id;
+  mpc_image_reader_t r;
+  mpc_parser_t **roots;
+  unsigned long version, fns, hash, nodes;
+  size_t start;
+  va_list va;
 
-  int i, n, m;
-  mpc_parser_t *t;
+  r.data = image;
+  r.pos = 0;
+  r.size = size;
+  r.build = 0;
+  r.error = NULL;
 
-  if (p->retained && !force) { return; }
+  if (size < MPC_IMAGE_HEADER || memcmp(image, MPC_IMAGE_MAGIC, 4) != 0) {
+    return mpc_image_err("Not an image!", NULL);
+  }
 
-  /* Optimise Subexpressions */
+  r.pos = 4;
+  version = mpc_image_get_int(&r);
+  fns = mpc_image_get_int(&r);
+  hash = mpc_image_get_int(&r);
+  nodes = mpc_image_get_int(&r);
 
-  if (p->type == MPC_TYPE_EXPECT)     { mpc_optimise_unretained(p->data.expect.x, 0); }
-  if (p->type == MPC_TYPE_APPLY)      { mpc_optimise_unretained(p->data.apply.x, 0); }
-  if (p->type == MPC_TYPE_APPLY_TO)   { mpc_optimise_unretained(p->data.apply_to.x, 0); }
-  if (p->type == MPC_TYPE_CHECK)      { mpc_optimise_unretained(p->data.check.x, 0); }
-  if (p->type == MPC_TYPE_CHECK_WITH) { mpc_optimise_unretained(p->data.check_with.x, 0); }
-  if (p->type == MPC_TYPE_PREDICT)    { mpc_optimise_unretained(p->data.predict.x, 0); }
-  if (p->type == MPC_TYPE_NOT)        { mpc_optimise_unretained(p->data.not.x, 0); }
-  if (p->type == MPC_TYPE_MAYBE)      { mpc_optimise_unretained(p->data.not.x, 0); }
-  if (p->type == MPC_TYPE_MANY)       { mpc_optimise_unretained(p->data.repeat.x, 0); }
-  if (p->type == MPC_TYPE_MANY1)      { mpc_optimise_unretained(p->data.repeat.x, 0); }
-  if (p->type == MPC_TYPE_COUNT)      { mpc_optimise_unretained(p->data.repeat.x, 0); }
-  if (p->type == MPC_TYPE_SEPBY1)     {
-    mpc_optimise_unretained(p->data.sepby1.x, 0);
-    mpc_optimise_unretained(p->data.sepby1.sep, 0);
+  if (version != MPC_IMAGE_VERSION || fns != (unsigned long)MPC_IMAGE_FNS_NUM) {
+    return mpc_image_err("Image was saved by another version of mpc!", NULL);
   }
 
-  if (p->type == MPC_TYPE_OR) {
-    for(i = 0; i < p->data.or.n; i++) {
-      mpc_optimise_unretained(p->data.or.xs[i], 0);
-    }
+  if (hash != mpc_image_hash(grammar)) {
+    return mpc_image_err("Image was saved from another grammar!", NULL);
   }
 
-  if (p->type == MPC_TYPE_AND) {
-    for(i = 0; i < p->data.and.n; i++) {
-      mpc_optimise_unretained(p->data.and.xs[i], 0);
-    }
+  /* A node takes at least nine bytes */
+  if (mpc_image_get_int(&r) != (unsigned long)n
+  ||  nodes < (unsigned long)n || nodes > (size - MPC_IMAGE_HEADER) / 9) {
+    return mpc_image_err("Image does not hold the parsers given!", NULL);
   }
 
-  /* Perform optimisations */
-
-  while (1) {
-
-    /* Merge rhs `or` */
-    if (p->type == MPC_TYPE_OR
-    &&  p->data.or.xs[p->data.or.n-1]->type == MPC_TYPE_OR
-    && !p->data.or.xs[p->data.or.n-1]->retained) {
-      t = p->data.or.xs[p->data.or.n-1];
-      n = p->data.or.n; m = t->data.or.n;
-      p->data.or.n = n + m - 1;
-      p->data.or.xs = realloc(p->data.or.xs, sizeof(mpc_parser_t*) * (n + m -1));
-      memmove(p->data.or.xs + n - 1, t->data.or.xs, m * sizeof(mpc_parser_t*));
-      free(t->data.or.xs); free(t->name); free(t);
-      continue;
-    }
-
-    /* Merge lhs `or` */
-    if (p->type == MPC_TYPE_OR
-    &&  p->data.or.xs[0]->type == MPC_TYPE_OR
-    && !p->data.or.xs[0]->retained) {
-      t = p->data.or.xs[0];
-      n = p->data.or.n; m = t->data.or.n;
-      p->data.or.n = n + m - 1;
-      p->data.or.xs = realloc(p->data.or.xs, sizeof(mpc_parser_t*) * (n + m -1));
-      memmove(p->data.or.xs + m, p->data.or.xs + 1, (n - 1) * sizeof(mpc_parser_t*));
-      memmove(p->data.or.xs, t->data.or.xs, m * sizeof(mpc_parser_t*));
-      free(t->data.or.xs); free(t->name); free(t);
-      continue;
-    }
-
-    /* Remove ast `pass` */
-    if (p->type == MPC_TYPE_AND
-    &&  p->data.and.n == 2
-    &&  p->data.and.xs[0]->type == MPC_TYPE_PASS
-    && !p->data.and.xs[0]->retained
-    &&  p->data.and.f == mpcf_fold_ast) {
-      t = p->data.and.xs[1];
-      mpc_delete(p->data.and.xs[0]);
-      free(p->data.and.xs); free(p->data.and.dxs); free(p->name);
-      memcpy(p, t, sizeof(mpc_parser_t));
-      free(t);
-      continue;
-    }
-
-    /* Merge ast lhs `and` */
-    if (p->type == MPC_TYPE_AND
-    &&  p->data.and.f == mpcf_fold_ast
-    &&  p->data.and.xs[0]->type == MPC_TYPE_AND
-    && !p->data.and.xs[0]->retained
-    &&  p->data.and.xs[0]->data.and.f == mpcf_fold_ast) {
-      t = p->data.and.xs[0];
-      n = p->data.and.n; m = t->data.and.n;
-      p->data.and.n = n + m - 1;
-      p->data.and.xs = realloc(p->data.and.xs, sizeof(mpc_parser_t*) * (n + m - 1));
-      p->data.and.dxs = realloc(p->data.and.dxs, sizeof(mpc_dtor_t) * (n + m - 1 - 1));
-      memmove(p->data.and.xs + m, p->data.and.xs + 1, (n - 1) * sizeof(mpc_parser_t*));
-      memmove(p->data.and.xs, t->data.and.xs, m * sizeof(mpc_parser_t*));
-      for (i = 0; i < p->data.and.n-1; i++) { p->data.and.dxs[i] = (mpc_dtor_t)mpc_ast_delete; }
-      free(t->data.and.xs); free(t->data.and.dxs); free(t->name); free(t);
-      continue;
-    }
-
-    /* Merge ast rhs `and` */
-    if (p->type == MPC_TYPE_AND
-    &&  p->data.and.f == mpcf_fold_ast
-    &&  p->data.and.xs[p->data.and.n-1]->type == MPC_TYPE_AND
-    && !p->data.and.xs[p->data.and.n-1]->retained
-    &&  p->data.and.xs[p->data.and.n-1]->data.and.f == mpcf_fold_ast) {
-      t = p->data.and.xs[p->data.and.n-1];
-      n = p->data.and.n; m = t->data.and.n;
-      p->data.and.n = n + m - 1;
-      p->data.and.xs = realloc(p->data.and.xs, sizeof(mpc_parser_t*) * (n + m -1));
-      p->data.and.dxs = realloc(p->data.and.dxs, sizeof(mpc_dtor_t) * (n + m - 1 - 1));
-      memmove(p->data.and.xs + n - 1, t->data.and.xs, m * sizeof(mpc_parser_t*));
-      for (i = 0; i < p->data.and.n-1; i++) { p->data.and.dxs[i] = (mpc_dtor_t)mpc_ast_delete; }
-      free(t->data.and.xs); free(t->data.and.dxs); free(t->name); free(t);
-      continue;
-    }
+  r.roots = n;
+  r.nodes_num = (int)nodes;
+  r.nodes = malloc(sizeof(mpc_parser_t*) * (nodes ? nodes : 1));
+  r.owned = calloc(nodes ? nodes : 1, 1);
 
-    /* Remove re `lift` */
-    if (p->type == MPC_TYPE_AND
-    &&  p->data.and.n == 2
-    &&  p->data.and.xs[0]->type == MPC_TYPE_LIFT
-    &&  p->data.and.xs[0]->data.lift.lf == mpcf_ctor_str
-    && !p->data.and.xs[0]->retained
-    &&  p->data.and.f == mpcf_strfold) {
-      t = p->data.and.xs[1];
-      mpc_delete(p->data.and.xs[0]);
-      free(p->data.and.xs); free(p->data.and.dxs); free(p->name);
-      memcpy(p, t, sizeof(mpc_parser_t));
-      free(t);
-      continue;
-    }
+  va_start(va, n);
+  for (j = 0; j < n; j++) { r.nodes[j] = va_arg(va, mpc_parser_t*); }
+  va_end(va);
 
-    /* Merge re lhs `and` */
-    if (p->type == MPC_TYPE_AND
-    &&  p->data.and.f == mpcf_strfold
-    &&  p->data.and.xs[0]->type == MPC_TYPE_AND
-    && !p->data.and.xs[0]->retained
-    &&  p->data.and.xs[0]->data.and.f == mpcf_strfold) {
-      t = p->data.and.xs[0];
-      n = p->data.and.n; m = t->data.and.n;
-      p->data.and.n = n + m - 1;
-      p->data.and.xs = realloc(p->data.and.xs, sizeof(mpc_parser_t*) * (n + m - 1));
-      p->data.and.dxs = realloc(p->data.and.dxs, sizeof(mpc_dtor_t) * (n + m - 1 - 1));
-      memmove(p->data.and.xs + m, p->data.and.xs + 1, (n - 1) * sizeof(mpc_parser_t*));
-      memmove(p->data.and.xs, t->data.and.xs, m * sizeof(mpc_parser_t*));
-      for (i = 0; i < p->data.and.n-1; i++) { p->data.and.dxs[i] = free; }
-      free(t->data.and.xs); free(t->data.and.dxs); free(t->name); free(t);
-      continue;
-    }
+  start = r.pos;
+  for (r.node = 0; r.node < r.nodes_num && r.error == NULL; r.node++) {
+    mpc_image_get_node(&r, NULL);
+  }
+  for (j = n; j < r.nodes_num && r.error == NULL; j++) {
+    if (!r.owned[j]) { r.error = "Image has an invalid node!"; }
+  }
+  if (r.error == NULL && r.pos != size) { r.error = "Image has trailing bytes!"; }
 
-    /* Merge re rhs `and` */
-    if (p->type == MPC_TYPE_AND
-    &&  p->data.and.f == mpcf_strfold
-    &&  p->data.and.xs[p->data.and.n-1]->type == MPC_TYPE_AND
-    && !p->data.and.xs[p->data.and.n-1]->retained
-    &&  p->data.and.xs[p->data.and.n-1]->data.and.f == mpcf_strfold) {
-      t = p->data.and.xs[p->data.and.n-1];
-      n = p->data.and.n; m = t->data.and.n;
-      p->data.and.n = n + m - 1;
-      p->data.and.xs = realloc(p->data.and.xs, sizeof(mpc_parser_t*) * (n + m -1));
-      p->data.and.dxs = realloc(p->data.and.dxs, sizeof(mpc_dtor_t) * (n + m - 1 - 1));
-      memmove(p->data.and.xs + n - 1, t->data.and.xs, m * sizeof(mpc_parser_t*));
-      for (i = 0; i < p->data.and.n-1; i++) { p->data.and.dxs[i] = free; }
-      free(t->data.and.xs); free(t->data.and.dxs); free(t->name); free(t);
-      continue;
-    }
+  free(r.owned);
+  if (r.error) {
+    free(r.nodes);
+    return mpc_image_err(r.error, NULL);
+  }
 
-    return;
+  /* Roots are built aside and defined last, so references to them reach the parsers given */
+  roots = malloc(sizeof(mpc_parser_t*) * (n ? n : 1));
+  for (j = 0; j < n; j++) { roots[j] = mpc_undefined(); }
+  for (j = n; j < r.nodes_num; j++) { r.nodes[j] = mpc_undefined(); }
 
+  r.pos = start;
+  r.build = 1;
+  for (r.node = 0; r.node < r.nodes_num; r.node++) {
+    mpc_image_get_node(&r, r.node < n ? roots[r.node] : r.nodes[r.node]);
   }
 
-}
+  for (j = 0; j < n; j++) {
+    free(roots[j]->name);
+    id = roots[j]->id;
+    mpc_define(r.nodes[j], roots[j]);
+    r.nodes[j]->id = id;
+  }
 
-void mpc_optimise(mpc_parser_t *p) {
-  mpc_optimise_unretained(p, 1);
+  free(roots);
+  free(r.nodes);
+  return NULL;
 }
@@ -71,6 +71,51 @@ int mpc_parse_file(const char *filename, FILE *file, mpc_parser_t *p, mpc_result
 int mpc_parse_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result_t *r);
 int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r);
 
+/*
+** With MPC_PARSE_MEMO failures of composite parsers are
+** remembered by position so backtracking into the same
+** alternative again does not rerun it. Successes are not
+** remembered, a sub-parse that succeeds is run again by
+** every alternative that reaches it, so grammars which
+** share successful prefixes between alternatives can
+** still take exponential time. Parsers must not depend
+** on anything but the input for this to be safe.
+**
+** With MPC_PARSE_ARENA the result must be an AST, which
+** is built in an arena owned by its root. Deleting the
+** root frees the whole tree at once, so nodes of it must
+** not be deleted alone, kept, or added to other trees.
+*/
+
+enum {
+  MPC_PARSE_DEFAULT = 0,
+  MPC_PARSE_MEMO    = 1,
+  MPC_PARSE_ARENA   = 2
+};
+
+int mpc_parse_flags(int flags, const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r);
+
+/*
+** A parse of a pipe may read past the end of its result
+** while backtracking. mpc_parse_pipe can give only one
+** such character back to the pipe, to go on reading it
+** after a parse use a stream, which keeps them.
+**
+** A stream parses a file or pipe one result at a time,
+** each call continuing where the last one stopped, with
+** positions counted from the start of the stream. Only
+** the characters of the result being parsed are kept,
+** so memory does not grow with the length of the input.
+** The flags are those of mpc_parse_flags.
+*/
+
+struct mpc_stream_t;
+typedef struct mpc_stream_t mpc_stream_t;
+
+mpc_stream_t *mpc_stream_new(int flags, const char *filename, FILE *file);
+void mpc_stream_delete(mpc_stream_t *s);
+int mpc_stream_parse(mpc_stream_t *s, mpc_parser_t *p, mpc_result_t *r);
+
 /*
 ** Function Types
 */
@@ -280,6 +325,13 @@ mpc_parser_t *mpc_re_mode(const char *re, int mode);
 
 /*
 ** AST
+**
+** In trees built by mpca_lang and mpca_grammar `id` is
+** the innermost named rule a node matched, numbered by
+** the position of its parser in the argument list from 1,
+** or 0 if there is none. `punct` is set on nodes of the
+** string, char and regex literals that no named rule
+** matched, such as brackets and anchors.
 */
 
 typedef struct mpc_ast_t {
@@ -288,6 +340,9 @@ typedef struct mpc_ast_t {
   mpc_state_t state;
   int children_num;
   struct mpc_ast_t** children;
+  struct mpc_ast_arena_t *arena;
+  int id;
+  int punct;
 } mpc_ast_t;
 
 mpc_ast_t *mpc_ast_new(const char *tag, const char *contents);
@@ -384,6 +439,31 @@ int mpc_test_fail(mpc_parser_t *p, const char *s, const void *d,
   mpc_dtor_t destructor,
   void(*printer)(const void*));
 
+/*
+** Images
+*/
+
+/*
+** An image is a parser graph saved as bytes, with its
+** regular expressions already compiled, so it can be
+** loaded again without parsing or optimising anything.
+** Only graphs made of mpc's own functions, such as the
+** output of mpca_lang, can be saved, and every retained
+** parser they refer to must be one of the n given. An
+** image loads into parsers of the same names, given in
+** the same order, and only with the mpc that saved it.
+** mpc_image_save_c writes it as a C array called name.
+**
+** The grammar, usually the language given to mpca_lang,
+** is hashed into the image. Loading with a different one
+** fails, so a program can tell its image is stale and
+** build its parsers again.
+*/
+
+mpc_err_t *mpc_image_save(FILE *f, const char *grammar, int n, ...);
+mpc_err_t *mpc_image_save_c(FILE *f, const char *name, const char *grammar, int n, ...);
+mpc_err_t *mpc_image_load(const unsigned char *image, size_t size, const char *grammar, int n, ...);
+
 #ifdef __cplusplus
 }
 #endif